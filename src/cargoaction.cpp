@@ -203,9 +203,8 @@ bool StationCargoReroute::operator()(CargoPacket *cp)
 		this->destination->AddToCache(cp_new);
 	}
 
-	/* Legal, as insert doesn't invalidate iterators in the MultiMap, however
-	 * this might insert the packet between range.first and range.second (which might be end())
-	 * This is why we check for GetKey above to avoid infinite loops. */
+	/* Legal, as StationCargoList::ShiftCargo takes the list it's working on
+	 * out of the map, so adding other next hops doesn't invalidate it. */
 	this->destination->packets.Insert(next, cp_new);
 	return cp_new == cp;
 }
@@ -227,7 +226,8 @@ bool VehicleCargoReroute::operator()(CargoPacket *cp)
 		this->destination->AddToMeta(cp_new, VehicleCargoList::MTA_TRANSFER);
 	}
 
-	/* Legal, as front pushing doesn't invalidate iterators in std::list. */
+	/* Legal, as VehicleCargoList::ShiftCargo takes the packets it's working
+	 * on out of the list, so prepending doesn't move them. */
 	this->destination->packets.push_front(cp_new);
 	return cp_new == cp;
 }
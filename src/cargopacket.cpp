@@ -16,6 +16,11 @@
 #include "economy_base.h"
 #include "cargoaction.h"
 #include "order_type.h"
+#include "vehicle_base.h"
+#include "settings_type.h"
+#include "date_func.h"
+#include "cpu.h"
+#include "core/sort_func.hpp"
 
 /* Initialize the cargopacket-pool */
 CargoPacketPool _cargopacket_pool("CargoPacket");
@@ -42,13 +47,13 @@ CargoPacket::CargoPacket()
  * that, in contrary to all other pools, does not memset to 0.
  */
 CargoPacket::CargoPacket(StationID source, TileIndex source_xy, uint16 count, SourceType source_type, SourceID source_id) :
-	feeder_share(0),
+	loaded_at_xy(0),
 	count(count),
 	days_in_transit(0),
 	source_id(source_id),
 	source(source),
 	source_xy(source_xy),
-	loaded_at_xy(0)
+	feeder_share(0)
 {
 	assert(count != 0);
 	this->source_type  = source_type;
@@ -69,13 +74,13 @@ CargoPacket::CargoPacket(StationID source, TileIndex source_xy, uint16 count, So
  * that, in contrary to all other pools, does not memset to 0.
  */
 CargoPacket::CargoPacket(uint16 count, byte days_in_transit, StationID source, TileIndex source_xy, TileIndex loaded_at_xy, Money feeder_share, SourceType source_type, SourceID source_id) :
-		feeder_share(feeder_share),
+		loaded_at_xy(loaded_at_xy),
 		count(count),
 		days_in_transit(days_in_transit),
 		source_id(source_id),
 		source(source),
 		source_xy(source_xy),
-		loaded_at_xy(loaded_at_xy)
+		feeder_share(feeder_share)
 {
 	assert(count != 0);
 	this->source_type = source_type;
@@ -228,6 +233,91 @@ template <class Tinst, class Tcont>
 	}
 }
 
+/** Properties of a cargo packet deciding which other packets it may be merged with. */
+struct CargoPacketCompactKey {
+	TileIndex source_xy;         ///< Source location of the packet.
+	TileOrStationID load_place;  ///< Location the packet was loaded at, if relevant.
+	SourceID source_id;          ///< Source industry, town or HQ of the packet.
+	StationID source;            ///< Source station of the packet.
+	byte transit;                ///< Days in transit divided by the bucket size.
+	SourceTypeByte source_type;  ///< Type of source_id.
+	uint index;                  ///< Position of the packet in the list.
+};
+
+/**
+ * Sort packets by their compact key and keep packets with equal keys in
+ * their original order.
+ * @param a First key.
+ * @param b Second key.
+ * @return Negative, 0 or positive, like strcmp.
+ */
+static int CDECL CargoPacketCompactKeySorter(const CargoPacketCompactKey *a, const CargoPacketCompactKey *b)
+{
+	if (a->source_xy != b->source_xy) return a->source_xy < b->source_xy ? -1 : 1;
+	if (a->load_place != b->load_place) return a->load_place < b->load_place ? -1 : 1;
+	if (a->source_id != b->source_id) return a->source_id < b->source_id ? -1 : 1;
+	if (a->source != b->source) return a->source < b->source ? -1 : 1;
+	if (a->transit != b->transit) return a->transit < b->transit ? -1 : 1;
+	if (a->source_type != b->source_type) return a->source_type < b->source_type ? -1 : 1;
+	return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+/**
+ * Merge compatible packets in an array of packets, no matter where they are
+ * in the array. Packets are compatible if they come from the same source, are
+ * in the same bucket of days in transit and, optionally, were loaded at the
+ * same place. Each packet is merged into the first compatible packet in the
+ * array that still has room for it. The days in transit of merged packets
+ * are averaged, weighted by the amount of cargo. Merged packets are deleted
+ * and replaced by NULL in the array. The caches aren't updated.
+ * @param packets Packets to be merged.
+ * @param num Number of packets.
+ * @param transit_bucket Size of the buckets of days in transit. With 1 only
+ *                       packets with equal days in transit are merged.
+ * @param compare_load_place If loaded_at_xy has to be equal, too.
+ * @return Number of packets merged into others.
+ */
+template <class Tinst, class Tcont>
+/* static */ uint CargoList<Tinst, Tcont>::MergePackets(CargoPacket **packets, uint num, uint transit_bucket, bool compare_load_place)
+{
+	if (num < 2) return 0;
+	assert(transit_bucket > 0);
+
+	SmallVector<CargoPacketCompactKey, 64> keys;
+	keys.Resize(num);
+	for (uint i = 0; i < num; i++) {
+		const CargoPacket *cp = packets[i];
+		CargoPacketCompactKey &key = keys[i];
+		key.source_xy = cp->source_xy;
+		key.load_place = compare_load_place ? cp->loaded_at_xy : 0;
+		key.source_id = cp->source_id;
+		key.source = cp->source;
+		key.transit = cp->days_in_transit / transit_bucket;
+		key.source_type = cp->source_type;
+		key.index = i;
+	}
+	QSortT(keys.Begin(), num, &CargoPacketCompactKeySorter);
+
+	uint merged = 0;
+	const CargoPacketCompactKey *target = keys.Begin();
+	for (const CargoPacketCompactKey *key = target + 1; key != keys.End(); ++key) {
+		CargoPacket *icp = packets[target->index];
+		CargoPacket *cp = packets[key->index];
+		bool compatible = target->source_xy == key->source_xy && target->load_place == key->load_place &&
+				target->source_id == key->source_id && target->source == key->source &&
+				target->transit == key->transit && target->source_type == key->source_type;
+		if (!compatible || icp->count + cp->count > CargoPacket::MAX_COUNT) {
+			target = key;
+			continue;
+		}
+		icp->days_in_transit = (icp->days_in_transit * icp->count + cp->days_in_transit * cp->count) / (icp->count + cp->count);
+		icp->Merge(cp);
+		packets[key->index] = NULL;
+		merged++;
+	}
+	return merged;
+}
+
 /*
  *
  * Vehicle cargo list implementation.
@@ -254,6 +344,7 @@ void VehicleCargoList::Append(CargoPacket *cp, MoveToAction action)
 	assert(cp != NULL);
 	assert(action == MTA_LOAD ||
 			(action == MTA_KEEP && this->action_counts[MTA_LOAD] == 0));
+	this->ApplyAging();
 	this->AddToMeta(cp, action);
 
 	if (this->count == cp->count) {
@@ -286,14 +377,20 @@ void VehicleCargoList::Append(CargoPacket *cp, MoveToAction action)
 template<class Taction>
 void VehicleCargoList::ShiftCargo(Taction action)
 {
-	Iterator it(this->packets.begin());
-	while (it != this->packets.end() && action.MaxMove() > 0) {
-		CargoPacket *cp = *it;
-		if (action(cp)) {
-			it = this->packets.erase(it);
-		} else {
-			break;
-		}
+	/* Take the packets out of the list while working on them. The action may
+	 * prepend packets to this list, which would move them around. */
+	CargoPacketList packets;
+	packets.swap(this->packets);
+	while (!packets.empty() && action.MaxMove() > 0) {
+		if (!action(packets.front())) break;
+		packets.pop_front();
+	}
+
+	if (this->packets.empty()) {
+		this->packets.swap(packets);
+	} else {
+		/* Rerouted packets go in front of the remaining ones. */
+		for (Iterator it(packets.begin()); it != packets.end(); ++it) this->packets.push_back(*it);
 	}
 }
 
@@ -308,21 +405,9 @@ void VehicleCargoList::ShiftCargo(Taction action)
 template<class Taction>
 void VehicleCargoList::PopCargo(Taction action)
 {
-	if (this->packets.empty()) return;
-	Iterator it(--(this->packets.end()));
-	Iterator begin(this->packets.begin());
-	while (action.MaxMove() > 0) {
-		CargoPacket *cp = *it;
-		if (action(cp)) {
-			if (it != begin) {
-				this->packets.erase(it--);
-			} else {
-				this->packets.erase(it);
-				break;
-			}
-		} else {
-			break;
-		}
+	while (!this->packets.empty() && action.MaxMove() > 0) {
+		if (!action(this->packets.back())) break;
+		this->packets.pop_back();
 	}
 }
 
@@ -331,9 +416,11 @@ void VehicleCargoList::PopCargo(Taction action)
  * Decreases count, feeder share and days_in_transit.
  * @param cp Packet to be removed from cache.
  * @param count Amount of cargo from the given packet to be removed.
+ * @pre transit_offset == 0
  */
 void VehicleCargoList::RemoveFromCache(const CargoPacket *cp, uint count)
 {
+	assert(this->transit_offset == 0);
 	this->feeder_share -= cp->FeederShare(count);
 	this->Parent::RemoveFromCache(cp, count);
 }
@@ -342,9 +429,12 @@ void VehicleCargoList::RemoveFromCache(const CargoPacket *cp, uint count)
  * Update the cache to reflect adding of this packet.
  * Increases count, feeder share and days_in_transit.
  * @param cp New packet to be inserted.
+ * @pre transit_offset == 0
  */
 void VehicleCargoList::AddToCache(const CargoPacket *cp)
 {
+	assert(this->transit_offset == 0);
+	this->max_days_in_transit = max(this->max_days_in_transit, cp->days_in_transit);
 	this->feeder_share += cp->feeder_share;
 	this->Parent::AddToCache(cp);
 }
@@ -377,18 +467,47 @@ void VehicleCargoList::AddToMeta(const CargoPacket *cp, MoveToAction action)
 }
 
 /**
- * Ages the all cargo in this list.
+ * Ages the all cargo in this list. As long as no packet can reach the maximum
+ * days in transit this only counts the aging in transit_offset and updates the
+ * cache. The packets are updated when they are touched next.
  */
 void VehicleCargoList::AgeCargo()
 {
+	if (this->max_days_in_transit + this->transit_offset < 0xFF) {
+		this->transit_offset++;
+		this->cargo_days_in_transit += this->count;
+		return;
+	}
+
+	this->ApplyAging();
+	this->max_days_in_transit = 0;
 	for (ConstIterator it(this->packets.begin()); it != this->packets.end(); it++) {
 		CargoPacket *cp = *it;
 		/* If we're at the maximum, then we can't increase no more. */
-		if (cp->days_in_transit == 0xFF) continue;
+		if (cp->days_in_transit != 0xFF) {
+			cp->days_in_transit++;
+			this->cargo_days_in_transit += cp->count;
+		}
+		this->max_days_in_transit = max(this->max_days_in_transit, cp->days_in_transit);
+	}
+}
+
+/**
+ * Apply the aging counted in transit_offset to the packets. This has to be
+ * done before the days in transit of any packet are used or packets are added
+ * or removed. The cached days in transit already include the offset.
+ */
+void VehicleCargoList::ApplyAging()
+{
+	if (this->transit_offset == 0) return;
 
-		cp->days_in_transit++;
-		this->cargo_days_in_transit += cp->count;
+	this->max_days_in_transit = 0;
+	for (ConstIterator it(this->packets.begin()); it != this->packets.end(); it++) {
+		CargoPacket *cp = *it;
+		cp->days_in_transit += this->transit_offset;
+		this->max_days_in_transit = max(this->max_days_in_transit, cp->days_in_transit);
 	}
+	this->transit_offset = 0;
 }
 
 /**
@@ -448,19 +567,22 @@ bool VehicleCargoList::Stage(bool accepted, StationID current_station, StationID
 {
 	this->AssertCountConsistency();
 	assert(this->action_counts[MTA_LOAD] == 0);
+	this->ApplyAging();
 	this->action_counts[MTA_TRANSFER] = this->action_counts[MTA_DELIVER] = this->action_counts[MTA_KEEP] = 0;
-	Iterator deliver = this->packets.end();
-	Iterator it = this->packets.begin();
-	uint sum = 0;
+
+	/* The packets are sorted into the chunks first and written back in
+	 * order afterwards. Transferred cargo ends up in reverse order in front,
+	 * then delivered cargo, then kept cargo. */
+	static SmallVector<CargoPacket *, 16> chunks[MTA_KEEP + 1];
+	for (uint i = 0; i <= MTA_KEEP; i++) chunks[i].Clear();
 
 	bool force_keep = (order_flags & OUFB_NO_UNLOAD) != 0;
 	bool force_unload = (order_flags & OUFB_UNLOAD) != 0;
 	bool force_transfer = (order_flags & (OUFB_TRANSFER | OUFB_UNLOAD)) != 0;
-	assert(this->count > 0 || it == this->packets.end());
-	while (sum < this->count) {
+	assert(this->count > 0 || this->packets.empty());
+	for (Iterator it(this->packets.begin()); it != this->packets.end(); ++it) {
 		CargoPacket *cp = *it;
 
-		this->packets.erase(it++);
 		StationID cargo_next = INVALID_STATION;
 		MoveToAction action = MTA_LOAD;
 		if (force_keep) {
@@ -511,14 +633,9 @@ bool VehicleCargoList::Stage(bool accepted, StationID current_station, StationID
 		Money share;
 		switch (action) {
 			case MTA_KEEP:
-				this->packets.push_back(cp);
-				if (deliver == this->packets.end()) --deliver;
-				break;
 			case MTA_DELIVER:
-				this->packets.insert(deliver, cp);
 				break;
 			case MTA_TRANSFER:
-				this->packets.push_front(cp);
 				/* Add feeder share here to allow reusing field for next station. */
 				share = payment->PayTransfer(cp, cp->count);
 				cp->AddFeederShare(share);
@@ -528,9 +645,14 @@ bool VehicleCargoList::Stage(bool accepted, StationID current_station, StationID
 			default:
 				NOT_REACHED();
 		}
+		*chunks[action].Append() = cp;
 		this->action_counts[action] += cp->count;
-		sum += cp->count;
 	}
+
+	this->packets.clear();
+	for (uint i = chunks[MTA_TRANSFER].Length(); i > 0; i--) this->packets.push_back(chunks[MTA_TRANSFER][i - 1]);
+	for (CargoPacket **cp = chunks[MTA_DELIVER].Begin(); cp != chunks[MTA_DELIVER].End(); ++cp) this->packets.push_back(*cp);
+	for (CargoPacket **cp = chunks[MTA_KEEP].Begin(); cp != chunks[MTA_KEEP].End(); ++cp) this->packets.push_back(*cp);
 	this->AssertCountConsistency();
 	return this->action_counts[MTA_DELIVER] > 0 || this->action_counts[MTA_TRANSFER] > 0;
 }
@@ -538,10 +660,38 @@ bool VehicleCargoList::Stage(bool accepted, StationID current_station, StationID
 /** Invalidates the cached data and rebuild it. */
 void VehicleCargoList::InvalidateCache()
 {
+	this->ApplyAging();
 	this->feeder_share = 0;
 	this->Parent::InvalidateCache();
 }
 
+/**
+ * Merge compatible packets in this list, no matter where they are in the
+ * list. Only cargo which isn't being loaded or unloaded is merged, as
+ * otherwise the packets are sorted by their designations.
+ * @param transit_bucket Size of the buckets of days in transit of packets
+ *                       to be merged.
+ * @return Number of packets merged into others.
+ */
+uint VehicleCargoList::Compact(uint transit_bucket)
+{
+	if (this->action_counts[MTA_KEEP] != this->count) return 0;
+
+	this->ApplyAging();
+	SmallVector<CargoPacket *, 16> packets;
+	for (Iterator it(this->packets.begin()); it != this->packets.end(); ++it) *packets.Append() = *it;
+	uint merged = VehicleCargoList::MergePackets(packets.Begin(), packets.Length(), transit_bucket, true);
+	if (merged == 0) return 0;
+
+	this->packets.clear();
+	for (CargoPacket **cp = packets.Begin(); cp != packets.End(); ++cp) {
+		if (*cp != NULL) this->packets.push_back(*cp);
+	}
+	this->InvalidateCache();
+	this->action_counts[MTA_KEEP] = this->count;
+	return merged;
+}
+
 /**
  * Moves some cargo from one designation to another. You can only move
  * between adjacent designations. E.g. you can keep cargo that was previously
@@ -578,14 +728,15 @@ uint VehicleCargoList::Reassign<VehicleCargoList::MTA_DELIVER, VehicleCargoList:
 	max_move = min(this->action_counts[MTA_DELIVER], max_move);
 
 	uint sum = 0;
-	for (Iterator it(this->packets.begin()); sum < this->action_counts[MTA_TRANSFER] + max_move;) {
-		CargoPacket *cp = *it++;
+	for (uint pos = 0; sum < this->action_counts[MTA_TRANSFER] + max_move; ++pos) {
+		CargoPacket *cp = this->packets[pos];
 		sum += cp->Count();
 		if (sum <= this->action_counts[MTA_TRANSFER]) continue;
 		if (sum > this->action_counts[MTA_TRANSFER] + max_move) {
 			CargoPacket *cp_split = cp->Split(sum - this->action_counts[MTA_TRANSFER] + max_move);
 			sum -= cp_split->Count();
-			this->packets.insert(it, cp_split);
+			/* Insert behind this packet and skip it. */
+			this->packets.insert(++pos, cp_split);
 		}
 		cp->next_station = next_station;
 	}
@@ -605,6 +756,7 @@ uint VehicleCargoList::Reassign<VehicleCargoList::MTA_DELIVER, VehicleCargoList:
 uint VehicleCargoList::Return(uint max_move, StationCargoList *dest, StationID next)
 {
 	max_move = min(this->action_counts[MTA_LOAD], max_move);
+	this->ApplyAging();
 	this->PopCargo(CargoReturn(this, dest, max_move, next));
 	return max_move;
 }
@@ -618,6 +770,7 @@ uint VehicleCargoList::Return(uint max_move, StationCargoList *dest, StationID n
 uint VehicleCargoList::Shift(uint max_move, VehicleCargoList *dest)
 {
 	max_move = min(this->count, max_move);
+	this->ApplyAging();
 	this->PopCargo(CargoShift(this, dest, max_move));
 	return max_move;
 }
@@ -633,6 +786,7 @@ uint VehicleCargoList::Shift(uint max_move, VehicleCargoList *dest)
 uint VehicleCargoList::Unload(uint max_move, StationCargoList *dest, CargoPayment *payment)
 {
 	uint moved = 0;
+	this->ApplyAging();
 	if (this->action_counts[MTA_TRANSFER] > 0) {
 		uint move = min(this->action_counts[MTA_TRANSFER], max_move);
 		this->ShiftCargo(CargoTransfer(this, dest, move));
@@ -655,6 +809,7 @@ uint VehicleCargoList::Unload(uint max_move, StationCargoList *dest, CargoPaymen
 uint VehicleCargoList::Truncate(uint max_move)
 {
 	max_move = min(this->count, max_move);
+	this->ApplyAging();
 	this->PopCargo(CargoRemoval<VehicleCargoList>(this, max_move));
 	return max_move;
 }
@@ -670,6 +825,8 @@ uint VehicleCargoList::Truncate(uint max_move)
 uint VehicleCargoList::Reroute(uint max_move, VehicleCargoList *dest, StationID avoid, StationID avoid2, const GoodsEntry *ge)
 {
 	max_move = min(this->action_counts[MTA_TRANSFER], max_move);
+	this->ApplyAging();
+	dest->ApplyAging();
 	this->ShiftCargo(VehicleCargoReroute(this, dest, max_move, avoid, avoid2, ge));
 	return max_move;
 }
@@ -703,6 +860,33 @@ void StationCargoList::Append(CargoPacket *cp, StationID next)
 	list.push_back(cp);
 }
 
+/**
+ * Merge compatible packets with the same next hop in this list, no matter
+ * where they are in the list.
+ * @param transit_bucket Size of the buckets of days in transit of packets
+ *                       to be merged.
+ * @return Number of packets merged into others.
+ */
+uint StationCargoList::Compact(uint transit_bucket)
+{
+	uint merged = 0;
+	for (StationCargoPacketMap::MapIterator map_it(this->packets.begin()); map_it != this->packets.end(); ++map_it) {
+		StationCargoPacketMap::List &list = map_it->second;
+		uint list_merged = StationCargoList::MergePackets(list.begin(), list.size(), transit_bucket, false);
+		if (list_merged == 0) continue;
+
+		/* The first packet of each group is kept, so the list can't become empty. */
+		StationCargoPacketMap::ListIterator keep(list.begin());
+		for (StationCargoPacketMap::ListIterator it(list.begin()); it != list.end(); ++it) {
+			if (*it != NULL) *keep++ = *it;
+		}
+		list.truncate(keep);
+		merged += list_merged;
+	}
+	if (merged > 0) this->InvalidateCache();
+	return merged;
+}
+
 /**
  * Shifts cargo from the front of the packet list for a specific station and
  * applies some action to it.
@@ -718,17 +902,25 @@ void StationCargoList::Append(CargoPacket *cp, StationID next)
 template <class Taction>
 bool StationCargoList::ShiftCargo(Taction &action, StationID next)
 {
-	std::pair<Iterator, Iterator> range(this->packets.equal_range(next));
-	for (Iterator it(range.first); it != range.second && it.GetKey() == next;) {
-		if (action.MaxMove() == 0) return false;
-		CargoPacket *cp = *it;
-		if (action(cp)) {
-			it = this->packets.erase(it);
-		} else {
-			return false;
-		}
+	StationCargoPacketMap::MapIterator found(this->packets.find(next));
+	if (found == this->packets.end()) return true;
+
+	/* Take the packets out of the map while working on them. The action may
+	 * add packets for other next hops, which moves the lists in the map. */
+	StationCargoPacketMap::List list;
+	list.swap(found->second);
+	while (!list.empty() && action.MaxMove() > 0 && action(list.front())) {
+		list.pop_front();
+	}
+
+	found = this->packets.find(next);
+	assert(found != this->packets.end() && found->second.empty());
+	if (list.empty()) {
+		this->packets.erase(found);
+		return true;
 	}
-	return true;
+	found->second.swap(list);
+	return false;
 }
 
 /**
@@ -775,38 +967,55 @@ uint StationCargoList::Truncate(uint max_move, StationCargoAmountMap *cargo_per_
 	uint loop = 0;
 	bool do_count = cargo_per_source != NULL;
 	while (max_move > moved) {
-		for (Iterator it(this->packets.begin()); it != this->packets.end();) {
-			CargoPacket *cp = *it;
-			if (prev_count > max_move && RandomRange(prev_count) < prev_count - max_move) {
-				if (do_count && loop == 0) {
-					(*cargo_per_source)[cp->source] += cp->count;
+		for (StationCargoPacketMap::MapIterator map_it(this->packets.begin()); map_it != this->packets.end();) {
+			/* Remove packets by moving the ones to be kept to the front of
+			 * the list and cutting off the rest afterwards. */
+			StationCargoPacketMap::List &list = map_it->second;
+			StationCargoPacketMap::ListIterator keep(list.begin());
+			bool done = false;
+			for (StationCargoPacketMap::ListIterator it(list.begin()); it != list.end(); ++it) {
+				CargoPacket *cp = *it;
+				if (done) {
+					*keep++ = cp;
+					continue;
 				}
-				++it;
-				continue;
-			}
-			uint diff = max_move - moved;
-			if (cp->count > diff) {
-				if (diff > 0) {
-					this->RemoveFromCache(cp, diff);
-					cp->Reduce(diff);
-					moved += diff;
+				if (prev_count > max_move && RandomRange(prev_count) < prev_count - max_move) {
+					if (do_count && loop == 0) {
+						(*cargo_per_source)[cp->source] += cp->count;
+					}
+					*keep++ = cp;
+					continue;
 				}
-				if (loop > 0) {
-					if (do_count) (*cargo_per_source)[cp->source] -= diff;
-					return moved;
+				uint diff = max_move - moved;
+				if (cp->count > diff) {
+					if (diff > 0) {
+						this->RemoveFromCache(cp, diff);
+						cp->Reduce(diff);
+						moved += diff;
+					}
+					if (loop > 0) {
+						if (do_count) (*cargo_per_source)[cp->source] -= diff;
+						done = true;
+					} else {
+						if (do_count) (*cargo_per_source)[cp->source] += cp->count;
+					}
+					*keep++ = cp;
 				} else {
-					if (do_count) (*cargo_per_source)[cp->source] += cp->count;
-					++it;
+					if (do_count && loop > 0) {
+						(*cargo_per_source)[cp->source] -= cp->count;
+					}
+					moved += cp->count;
+					this->RemoveFromCache(cp, cp->count);
+					delete cp;
 				}
+			}
+			list.truncate(keep);
+			if (list.empty()) {
+				map_it = this->packets.erase(map_it);
 			} else {
-				it = this->packets.erase(it);
-				if (do_count && loop > 0) {
-					(*cargo_per_source)[cp->source] -= cp->count;
-				}
-				moved += cp->count;
-				this->RemoveFromCache(cp, cp->count);
-				delete cp;
+				++map_it;
 			}
+			if (done) return moved;
 		}
 		loop++;
 	}
@@ -863,6 +1072,50 @@ uint StationCargoList::Reroute(uint max_move, StationCargoList *dest, StationID
 	return this->ShiftCargo(StationCargoReroute(this, dest, max_move, avoid, avoid2, ge), avoid, false);
 }
 
+/** Statistics of the last complete compaction pass over all cargo lists. */
+CargoCompactionStats _cargo_compaction_last;
+/** Statistics of the compaction pass in progress. */
+CargoCompactionStats _cargo_compaction_current;
+
+/**
+ * Merge compatible cargo packets in the background. Every cargo list is
+ * compacted once every economy.cargo_compaction_interval days. The work is
+ * spread over the days of the interval by station and vehicle index.
+ */
+void CargoCompactionDailyLoop()
+{
+	uint interval = _settings_game.economy.cargo_compaction_interval;
+	if (interval == 0) return;
+
+	uint slice = _date % interval;
+	uint transit_bucket = _settings_game.economy.cargo_compaction_transit;
+	uint64 start = ottd_rdtsc();
+
+	Station *st;
+	FOR_ALL_STATIONS(st) {
+		if (st->index % interval != slice) continue;
+		for (CargoID c = 0; c < NUM_CARGO; c++) {
+			StationCargoList &cargo = st->goods[c].cargo;
+			if (cargo.Packets()->MapSize() == 0) continue;
+			_cargo_compaction_current.merged += cargo.Compact(transit_bucket);
+			_cargo_compaction_current.lists++;
+		}
+	}
+
+	Vehicle *v;
+	FOR_ALL_VEHICLES(v) {
+		if (v->index % interval != slice || v->cargo.TotalCount() == 0) continue;
+		_cargo_compaction_current.merged += v->cargo.Compact(transit_bucket);
+		_cargo_compaction_current.lists++;
+	}
+
+	_cargo_compaction_current.cycles += ottd_rdtsc() - start;
+	if (slice == interval - 1) {
+		_cargo_compaction_last = _cargo_compaction_current;
+		MemSetT(&_cargo_compaction_current, 0);
+	}
+}
+
 /*
  * We have to instantiate everything we want to be usable.
  */
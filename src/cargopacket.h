@@ -19,7 +19,7 @@
 #include "cargo_type.h"
 #include "vehicle_type.h"
 #include "core/multimap.hpp"
-#include <list>
+#include <map>
 
 /** Unique identifier for a single cargo packet. */
 typedef uint32 CargoPacketID;
@@ -43,17 +43,19 @@ typedef uint32 TileOrStationID;
  */
 struct CargoPacket : CargoPacketPool::PoolItem<&_cargopacket_pool> {
 private:
-	Money feeder_share;         ///< Value of feeder pickup to be paid for on delivery of cargo.
+	/* The fields used by the loops over all packets in a list come first, so
+	 * that they share a cache line with the index. */
+	union {
+		TileOrStationID loaded_at_xy; ///< Location where this cargo has been loaded into the vehicle.
+		TileOrStationID next_station; ///< Station where the cargo wants to go next.
+	};
 	uint16 count;               ///< The amount of cargo in this packet.
 	byte days_in_transit;       ///< Amount of days this packet has been in transit.
 	SourceTypeByte source_type; ///< Type of \c source_id.
 	SourceID source_id;         ///< Index of source, INVALID_SOURCE if unknown/invalid.
 	StationID source;           ///< The station where the cargo came from first.
 	TileIndex source_xy;        ///< The origin of the cargo (first station in feeder chain).
-	union {
-		TileOrStationID loaded_at_xy; ///< Location where this cargo has been loaded into the vehicle.
-		TileOrStationID next_station; ///< Station where the cargo wants to go next.
-	};
+	Money feeder_share;         ///< Value of feeder pickup to be paid for on delivery of cargo.
 
 	/** The CargoList caches, thus needs to know about it. */
 	template <class Tinst, class Tcont> friend class CargoList;
@@ -207,6 +209,196 @@ public:
  */
 #define FOR_ALL_CARGOPACKETS(var) FOR_ALL_CARGOPACKETS_FROM(var, 0)
 
+/**
+ * List of the cargo packets in a vehicle. The packets are referenced by their
+ * 32 bit pool indices in one block of memory instead of by pointers in
+ * separately allocated list nodes. That takes only a fraction of the memory
+ * per packet and loops over all packets stream through memory. There is free
+ * space at both ends of the block, so adding and removing packets at the
+ * front and at the back is cheap. Inserting in the middle moves all following
+ * packets, though.
+ */
+class CargoPacketList {
+public:
+	/** Iterator over the list, yielding pointers to the packets. */
+	class Iterator : public std::iterator<std::bidirectional_iterator_tag, CargoPacket *, ptrdiff_t, CargoPacket **, CargoPacket *> {
+	protected:
+		const CargoPacketID *pos; ///< Current position in the list.
+
+	public:
+		Iterator() : pos(NULL) {}
+
+		/**
+		 * Create an iterator for the given position.
+		 * @param pos Position in the list.
+		 */
+		explicit Iterator(const CargoPacketID *pos) : pos(pos) {}
+
+		inline CargoPacket *operator*() const { return CargoPacket::Get(*this->pos); }
+
+		/**
+		 * Get the ID of the packet at the current position.
+		 * @return Pool index of the packet.
+		 */
+		inline CargoPacketID GetID() const { return *this->pos; }
+
+		inline Iterator &operator++() { ++this->pos; return *this; }
+		inline Iterator operator++(int) { Iterator tmp = *this; ++this->pos; return tmp; }
+		inline Iterator &operator--() { --this->pos; return *this; }
+		inline Iterator operator--(int) { Iterator tmp = *this; --this->pos; return tmp; }
+		inline bool operator==(const Iterator &other) const { return this->pos == other.pos; }
+		inline bool operator!=(const Iterator &other) const { return this->pos != other.pos; }
+	};
+
+	typedef Iterator iterator;
+	typedef Iterator const_iterator;
+	typedef std::reverse_iterator<Iterator> reverse_iterator;
+	typedef std::reverse_iterator<Iterator> const_reverse_iterator;
+	typedef uint size_type;
+
+protected:
+	CargoPacketID *data; ///< Memory block holding the packet IDs.
+	uint first;          ///< Index of the first packet in data.
+	uint last;           ///< Index behind the last packet in data.
+	uint capacity;       ///< Number of packets there is space for in data.
+
+	/** Double the size of the memory block. */
+	inline void Grow()
+	{
+		this->capacity = max(4U, this->capacity * 2);
+		this->data = ReallocT(this->data, this->capacity);
+	}
+
+	/**
+	 * Move the packets to a new position in the memory block.
+	 * @param pos New index of the first packet.
+	 */
+	inline void MoveTo(uint pos)
+	{
+		uint items = this->size();
+		if (pos != this->first) MemMoveT(this->data + pos, this->data + this->first, items);
+		this->first = pos;
+		this->last = pos + items;
+	}
+
+	/* Lists are never copied; cargo is moved packet by packet. */
+	CargoPacketList(const CargoPacketList &other);
+	CargoPacketList &operator=(const CargoPacketList &other);
+
+public:
+	CargoPacketList() : data(NULL), first(0), last(0), capacity(0) {}
+
+	~CargoPacketList()
+	{
+		free(this->data);
+	}
+
+	inline iterator begin() const { return iterator(this->data + this->first); }
+	inline iterator end() const { return iterator(this->data + this->last); }
+	inline reverse_iterator rbegin() const { return reverse_iterator(this->end()); }
+	inline reverse_iterator rend() const { return reverse_iterator(this->begin()); }
+
+	inline size_type size() const { return this->last - this->first; }
+	inline bool empty() const { return this->last == this->first; }
+	inline CargoPacket *front() const { return CargoPacket::Get(this->data[this->first]); }
+	inline CargoPacket *back() const { return CargoPacket::Get(this->data[this->last - 1]); }
+
+	/**
+	 * Get the packet at a position in the list.
+	 * @param pos Position of the packet.
+	 * @return The packet.
+	 */
+	inline CargoPacket *operator[](uint pos) const
+	{
+		assert(pos < this->size());
+		return CargoPacket::Get(this->data[this->first + pos]);
+	}
+
+	/**
+	 * Append a packet by its ID. The packet doesn't need to exist yet, which
+	 * is useful when loading savegames.
+	 * @param id ID of the packet to append.
+	 */
+	void push_back(CargoPacketID id)
+	{
+		if (this->last == this->capacity) {
+			if (this->first <= this->size()) this->Grow();
+			this->MoveTo(0);
+		}
+		this->data[this->last++] = id;
+	}
+
+	/**
+	 * Append a packet.
+	 * @param cp Packet to append.
+	 */
+	inline void push_back(CargoPacket *cp)
+	{
+		this->push_back(cp->index);
+	}
+
+	/**
+	 * Prepend a packet. If there is no space in front of the first packet the
+	 * packets are moved to the middle of the memory block, growing it if
+	 * necessary.
+	 * @param cp Packet to prepend.
+	 */
+	void push_front(CargoPacket *cp)
+	{
+		if (this->first == 0) {
+			if (this->last == this->capacity) this->Grow();
+			this->MoveTo((this->capacity - this->size() + 1) / 2);
+		}
+		this->data[--this->first] = cp->index;
+	}
+
+	/** Remove the first packet. */
+	inline void pop_front()
+	{
+		assert(!this->empty());
+		if (++this->first == this->last) this->first = this->last = 0;
+	}
+
+	/** Remove the last packet. */
+	inline void pop_back()
+	{
+		assert(!this->empty());
+		if (--this->last == this->first) this->first = this->last = 0;
+	}
+
+	/**
+	 * Insert a packet in the middle of the list.
+	 * @param pos Position the packet will have in the list.
+	 * @param cp Packet to insert.
+	 */
+	void insert(uint pos, CargoPacket *cp)
+	{
+		assert(pos <= this->size());
+		this->push_back(cp);
+		CargoPacketID *insert = this->data + this->first + pos;
+		MemMoveT(insert + 1, insert, this->size() - pos - 1);
+		*insert = cp->index;
+	}
+
+	/** Remove all packets, but keep the memory. */
+	inline void clear()
+	{
+		this->first = this->last = 0;
+	}
+
+	/**
+	 * Exchange the contents of this list with another one without copying.
+	 * @param other List to swap with.
+	 */
+	inline void swap(CargoPacketList &other)
+	{
+		Swap(this->data, other.data);
+		Swap(this->first, other.first);
+		Swap(this->last, other.last);
+		Swap(this->capacity, other.capacity);
+	}
+};
+
 /**
  * Simple collection class for a list of cargo packets.
  * @tparam Tinst Actual instantiation of this cargo list.
@@ -246,6 +438,8 @@ protected:
 
 	static bool TryMerge(CargoPacket *cp, CargoPacket *icp);
 
+	static uint MergePackets(CargoPacket **packets, uint num, uint transit_bucket, bool compare_load_place);
+
 public:
 	/** Create the cargo list. */
 	CargoList() {}
@@ -275,8 +469,6 @@ public:
 	void InvalidateCache();
 };
 
-typedef std::list<CargoPacket *> CargoPacketList;
-
 /**
  * CargoList that is used for vehicles.
  */
@@ -287,6 +479,8 @@ protected:
 
 	Money feeder_share;                     ///< Cache for the feeder share.
 	uint action_counts[NUM_MOVE_TO_ACTION]; ///< Counts of cargo to be transfered, delivered, kept and loaded.
+	byte transit_offset;                    ///< Aging not applied to the packets, yet. Included in cargo_days_in_transit.
+	byte max_days_in_transit;               ///< Upper bound for the days in transit of all packets, without transit_offset.
 
 	template<class Taction>
 	void ShiftCargo(Taction action);
@@ -408,12 +602,16 @@ public:
 
 	void AgeCargo();
 
+	void ApplyAging();
+
 	void InvalidateCache();
 
 	void SetTransferLoadPlace(TileIndex xy);
 
 	bool Stage(bool accepted, StationID current_station, StationIDStack next_station, uint8 order_flags, const GoodsEntry *ge, CargoPayment *payment);
 
+	uint Compact(uint transit_bucket);
+
 	/**
 	 * Marks all cargo in the vehicle as to be kept. This is mostly useful for
 	 * loading old savegames. When loading is aborted the reserved cargo has
@@ -491,6 +689,8 @@ public:
 
 	void Append(CargoPacket *cp, StationID next);
 
+	uint Compact(uint transit_bucket);
+
 	/**
 	 * Check for cargo headed for a specific station.
 	 * @param next Station the cargo is headed for.
@@ -568,4 +768,14 @@ public:
 	}
 };
 
+/** Statistics about merging cargo packets in the background. */
+struct CargoCompactionStats {
+	uint lists;    ///< Number of cargo lists checked.
+	uint merged;   ///< Number of packets merged into others.
+	uint64 cycles; ///< CPU cycles spent.
+};
+
+extern CargoCompactionStats _cargo_compaction_last;
+extern CargoCompactionStats _cargo_compaction_current;
+
 #endif /* CARGOPACKET_H */
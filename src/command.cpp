@@ -196,6 +196,8 @@ CommandProc CmdReinitSeparation;
 
 CommandProc CmdOpenCloseAirport;
 
+CommandProc CmdPostponeLinkGraphJob;
+
 #define DEF_CMD(proc, flags, type) {proc, #proc, (CommandFlags)flags, type}
 
 /**
@@ -352,6 +354,8 @@ static const Command _command_proc_table[] = {
 	DEF_CMD(CmdReinitSeparation,                               0, CMDT_ROUTE_MANAGEMENT      ), // CMD_REINIT_SEPARATION
 
 	DEF_CMD(CmdOpenCloseAirport,                               0, CMDT_ROUTE_MANAGEMENT      ), // CMD_OPEN_CLOSE_AIRPORT
+
+	DEF_CMD(CmdPostponeLinkGraphJob,                  CMD_SERVER, CMDT_SERVER_SETTING        ), // CMD_POSTPONE_LINKGRAPH_JOB
 };
 
 /*!
@@ -547,12 +551,13 @@ bool DoCommandP(TileIndex tile, uint32 p1, uint32 p2, uint32 cmd, CommandCallbac
 	/* Cost estimation is generally only done when the
 	 * local user presses shift while doing somthing.
 	 * However, in case of incoming network commands,
-	 * map generation or the pause button we do want
-	 * to execute. */
+	 * map generation, the pause button or the link graph
+	 * jobs postponed by the server we do want to execute. */
 	bool estimate_only = _shift_pressed && IsLocalCompany() &&
 			!_generating_world &&
 			!(cmd & CMD_NETWORK_COMMAND) &&
-			(cmd & CMD_ID_MASK) != CMD_PAUSE;
+			(cmd & CMD_ID_MASK) != CMD_PAUSE &&
+			(cmd & CMD_ID_MASK) != CMD_POSTPONE_LINKGRAPH_JOB;
 
 	/* We're only sending the command, so don't do
 	 * fancy things for 'success'. */
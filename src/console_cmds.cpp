@@ -38,6 +38,10 @@
 #include "console_func.h"
 #include "engine_base.h"
 #include "game/game.hpp"
+#include "linkgraph/linkgraphschedule.h"
+#include "cargopacket.h"
+#include "vehicle_func.h"
+#include "core/sort_func.hpp"
 #include "table/strings.h"
 
 /* scriptfile handling */
@@ -1880,6 +1884,276 @@ DEF_CONSOLE_CMD(ConNewGRFReload)
 	return true;
 }
 
+/**
+ * Run the link graph handlers on a link graph and print the measurements.
+ * @param lg Link graph to be benchmarked.
+ */
+static void BenchmarkLinkGraph(const LinkGraph &lg)
+{
+	uint links = 0;
+	for (NodeID node = 0; node < lg.Size(); ++node) {
+		for (LinkGraph::ConstEdgeIterator it = lg[node].Begin(); it != lg[node].End(); ++it) links++;
+	}
+
+	LinkGraphSchedule::BenchmarkResult result;
+	if (!LinkGraphSchedule::Instance()->Benchmark(lg, result)) {
+		IConsoleError("Too many link graph jobs.");
+		return;
+	}
+
+	IConsolePrintF(CC_DEFAULT, "Link graph %u: %u nodes, %u links; CPU cycles per step:", lg.index, lg.Size(), links);
+	uint64 total = 0;
+	for (uint i = 0; i < LinkGraphSchedule::NUM_HANDLERS; ++i) {
+		IConsolePrintF(CC_DEFAULT, "  %-12s %10.3f Mcycles", LinkGraphSchedule::GetHandlerName(i), result.cycles[i] / 1000000.0);
+		total += result.cycles[i];
+	}
+	IConsolePrintF(CC_DEFAULT, "  %-12s %10.3f Mcycles", "total", total / 1000000.0);
+	IConsolePrintF(CC_DEFAULT, "  path memory: %u KiB for %u paths (other memory of the job isn't counted)", (uint)(result.path_memory / 1024), result.path_allocations);
+}
+
+DEF_CONSOLE_CMD(ConBenchmarkLinkGraph)
+{
+	if (argc == 0) {
+		IConsoleHelp("Run the cargo distribution calculation on link graphs and print the CPU cycles spent in each step and the memory used for paths. The game isn't affected. Usage: 'benchmark_linkgraph [<link graph id>]'");
+		IConsoleHelp("Without an ID all link graphs of the game are measured.");
+		IConsoleHelp("Usage: 'benchmark_linkgraph synthetic <nodes> [<links per node>] [<seed>]' measures a random link graph instead.");
+		return true;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "synthetic") == 0) {
+		if (argc < 3 || argc > 5) return false;
+		uint nodes = atoi(argv[2]);
+		uint links = argc > 3 ? atoi(argv[3]) : 2;
+		uint32 seed = argc > 4 ? strtoul(argv[4], NULL, 10) : 0;
+		if (nodes < 2 || nodes >= INVALID_NODE) {
+			IConsoleError("The number of nodes has to be between 2 and 65534.");
+			return true;
+		}
+		if (!LinkGraph::CanAllocateItem()) {
+			IConsoleError("Too many link graphs.");
+			return true;
+		}
+		LinkGraph *lg = new LinkGraph(CT_PASSENGERS);
+		lg->InitSynthetic(nodes, links, seed);
+		BenchmarkLinkGraph(*lg);
+		delete lg;
+		return true;
+	}
+
+	if (argc > 2) return false;
+
+	if (argc == 2) {
+		const LinkGraph *lg = LinkGraph::GetIfValid(atoi(argv[1]));
+		if (lg == NULL) {
+			IConsoleError("Invalid link graph ID.");
+			return true;
+		}
+		BenchmarkLinkGraph(*lg);
+		return true;
+	}
+
+	const LinkGraph *lg;
+	FOR_ALL_LINK_GRAPHS(lg) {
+		if (lg->Size() >= 2) BenchmarkLinkGraph(*lg);
+	}
+	return true;
+}
+
+DEF_CONSOLE_CMD(ConLinkGraphTimings)
+{
+	if (argc == 0) {
+		IConsoleHelp("List the timings of the last link graph jobs, oldest first. Usage: 'linkgraph_timings'");
+		IConsoleHelp("Times are given in million CPU cycles. 'wait' is the time the game was blocked joining the job.");
+		return true;
+	}
+
+	if (argc > 1) return false;
+
+	const LinkGraphSchedule::TimingsList &list = LinkGraphSchedule::Instance()->GetJobTimings();
+	for (LinkGraphSchedule::TimingsList::const_iterator it = list.begin(); it != list.end(); ++it) {
+		const LinkGraphSchedule::JobTimings &timings = *it;
+		YearMonthDay spawn, join;
+		ConvertDateToYMD(timings.spawn_date, &spawn);
+		ConvertDateToYMD(timings.join_date, &join);
+		IConsolePrintF(CC_DEFAULT, "Link graph %u, cargo %u: %u nodes, %u edges, spawned %d-%d-%d, joined %d-%d-%d",
+				timings.link_graph, timings.cargo, timings.nodes, timings.edges,
+				spawn.day, spawn.month + 1, spawn.year, join.day, join.month + 1, join.year);
+
+		char buffer[256];
+		char *p = buffer;
+		p += seprintf(p, lastof(buffer), "  queued %.3f, ran %.3f, wait %.3f, merge %.3f;",
+				(timings.started - timings.spawned) / 1000000.0, (timings.finished - timings.started) / 1000000.0,
+				timings.join_wait / 1000000.0, timings.merge / 1000000.0);
+		for (uint i = 0; i < LinkGraphSchedule::NUM_HANDLERS; ++i) {
+			p += seprintf(p, lastof(buffer), " %s %.3f", LinkGraphSchedule::GetHandlerName(i), timings.handlers[i] / 1000000.0);
+		}
+		IConsolePrint(CC_DEFAULT, buffer);
+	}
+	return true;
+}
+
+DEF_CONSOLE_CMD(ConCargoCompaction)
+{
+	if (argc == 0) {
+		IConsoleHelp("Show the occupancy of the cargo packet pool and the statistics of merging cargo packets. Usage: 'cargo_compaction'");
+		IConsoleHelp("Times are given in million CPU cycles.");
+		return true;
+	}
+
+	if (argc > 1) return false;
+
+	IConsolePrintF(CC_DEFAULT, "Cargo packets: %u in use, %u allocated, %u maximum",
+			(uint)_cargopacket_pool.items, (uint)_cargopacket_pool.size, (uint)CargoPacketPool::MAX_SIZE);
+	if (_settings_game.economy.cargo_compaction_interval == 0) {
+		IConsolePrint(CC_DEFAULT, "Merging cargo packets in the background is disabled.");
+	} else {
+		IConsolePrintF(CC_DEFAULT, "Merging every %u days", _settings_game.economy.cargo_compaction_interval);
+	}
+	IConsolePrintF(CC_DEFAULT, "Last pass: %u cargo lists, %u packets merged, %.3f",
+			_cargo_compaction_last.lists, _cargo_compaction_last.merged, _cargo_compaction_last.cycles / 1000000.0);
+	IConsolePrintF(CC_DEFAULT, "Current pass: %u cargo lists, %u packets merged, %.3f",
+			_cargo_compaction_current.lists, _cargo_compaction_current.merged, _cargo_compaction_current.cycles / 1000000.0);
+	return true;
+}
+
+/**
+ * Print the times of a vehicle tick profile per tick.
+ * @param profile Profile to print.
+ */
+static void PrintVehicleTickProfile(const VehicleTickProfile &profile)
+{
+	static const char * const type_names[] = { "train", "road", "ship", "aircraft", "effect", "disaster" };
+	assert_compile(lengthof(type_names) == VEH_END);
+
+	double ticks = max<uint32>(profile.ticks, 1);
+	char buffer[256];
+	char *p = buffer;
+	p += seprintf(p, lastof(buffer), "  total %.1f;", profile.total / ticks / 1000.0);
+	for (uint i = 0; i < VTP_END; i++) {
+		p += seprintf(p, lastof(buffer), " %s %.1f", GetVehicleTickPhaseName((VehicleTickPhase)i), profile.phases[i] / ticks / 1000.0);
+	}
+	IConsolePrint(CC_DEFAULT, buffer);
+
+	p = buffer;
+	p += seprintf(p, lastof(buffer), "  ticks:");
+	for (uint i = 0; i < VEH_END; i++) {
+		p += seprintf(p, lastof(buffer), " %s %.1f (%.0f)", type_names[i], profile.types[i] / ticks / 1000.0, profile.vehicles[i] / ticks);
+	}
+	IConsolePrint(CC_DEFAULT, buffer);
+}
+
+/**
+ * Sorter for vehicle tick profiles, slowest first.
+ * @param a First profile.
+ * @param b Second profile.
+ * @return Comparison result for QSortT.
+ */
+static int CDECL VehicleTickProfileSorter(const VehicleTickProfile * const *a, const VehicleTickProfile * const *b)
+{
+	if ((*a)->total == (*b)->total) return 0;
+	return (*a)->total > (*b)->total ? -1 : 1;
+}
+
+DEF_CONSOLE_CMD(ConVehicleTicks)
+{
+	if (argc == 0) {
+		IConsoleHelp("Profile the vehicle ticks. Usage: 'vehicle_ticks [start | stop | reset | spikes [<count>]]'");
+		IConsoleHelp("Without argument the average times per tick since the last reset are shown.");
+		IConsoleHelp("'spikes' lists the slowest of the recently measured ticks, 10 by default.");
+		IConsoleHelp("Times are given in thousand CPU cycles, the average number of vehicles in brackets.");
+		return true;
+	}
+
+	if (argc == 1) {
+		const VehicleTickProfile &total = GetVehicleTickProfileTotal();
+		IConsolePrintF(CC_DEFAULT, "Vehicle tick profiler %s, %u ticks measured", IsVehicleTickProfiling() ? "running" : "stopped", total.ticks);
+		if (total.ticks > 0) PrintVehicleTickProfile(total);
+		return true;
+	}
+
+	if (strcmp(argv[1], "start") == 0 && argc == 2) {
+		SetVehicleTickProfiling(true);
+	} else if (strcmp(argv[1], "stop") == 0 && argc == 2) {
+		SetVehicleTickProfiling(false);
+	} else if (strcmp(argv[1], "reset") == 0 && argc == 2) {
+		ResetVehicleTickProfiles();
+	} else if (strcmp(argv[1], "spikes") == 0 && argc <= 3) {
+		uint count = 10;
+		if (argc == 3 && !GetArgumentInteger(&count, argv[2])) return false;
+
+		SmallVector<const VehicleTickProfile *, 16> profiles;
+		for (uint age = 0; GetVehicleTickProfile(age) != NULL; age++) {
+			*profiles.Append() = GetVehicleTickProfile(age);
+		}
+		QSortT(profiles.Begin(), profiles.Length(), &VehicleTickProfileSorter);
+
+		for (uint i = 0; i < min(count, profiles.Length()); i++) {
+			const VehicleTickProfile &profile = *profiles[i];
+			YearMonthDay ymd;
+			ConvertDateToYMD(profile.date, &ymd);
+			IConsolePrintF(CC_DEFAULT, "Tick %u of %d-%d-%d", profile.date_fract, ymd.day, ymd.month + 1, ymd.year);
+			PrintVehicleTickProfile(profile);
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+DEF_CONSOLE_CMD(ConVehicleHashStats)
+{
+	if (argc == 0) {
+		IConsoleHelp("Show statistics about the lengths of the vehicle chains in the buckets of the vehicle tile hash. Usage: 'vehicle_hash_stats'");
+		return true;
+	}
+
+	if (argc > 1) return false;
+
+	VehicleTileHashStats stats;
+	GetVehicleTileHashStats(stats);
+	IConsolePrintF(CC_DEFAULT, "Vehicle tile hash: %ux%u buckets, %u used, %u vehicles, longest chain %u, average chain %.2f",
+			stats.size_x, stats.size_y, stats.used_buckets, stats.vehicles, stats.max_length,
+			stats.used_buckets == 0 ? 0.0 : (double)stats.vehicles / stats.used_buckets);
+	for (uint i = 0; i < lengthof(stats.histogram); i++) {
+		if (i == lengthof(stats.histogram) - 1) {
+			IConsolePrintF(CC_DEFAULT, "  %u or more vehicles: %u chains", 1 << i, stats.histogram[i]);
+		} else {
+			IConsolePrintF(CC_DEFAULT, "  %u to %u vehicles: %u chains", 1 << i, (2 << i) - 1, stats.histogram[i]);
+		}
+	}
+	return true;
+}
+
+DEF_CONSOLE_CMD(ConVehicleDayProc)
+{
+	if (argc == 0) {
+		IConsoleHelp("Show the estimated cost of the daily vehicle handlers run in each tick of the day. Usage: 'vehicle_day_proc'");
+		IConsoleHelp("A primary vehicle counts 16, any other vehicle part 1. Vehicles are moved from busy to quiet ticks automatically.");
+		return true;
+	}
+
+	if (argc > 1) return false;
+
+	uint32 total = 0;
+	uint32 busiest = 0;
+	for (uint i = 0; i < DAY_TICKS; i++) {
+		total += GetVehicleDayProcWeight(i);
+		busiest = max(busiest, GetVehicleDayProcWeight(i));
+	}
+	IConsolePrintF(CC_DEFAULT, "Daily vehicle handlers: %u per day, %.1f per tick on average, %u in the busiest tick", total, (double)total / DAY_TICKS, busiest);
+
+	for (uint i = 0; i < DAY_TICKS; i += 10) {
+		char buffer[128];
+		char *p = buffer;
+		p += seprintf(p, lastof(buffer), "  %2u:", i);
+		for (uint j = i; j < min<uint>(i + 10, DAY_TICKS); j++) {
+			p += seprintf(p, lastof(buffer), " %6u", GetVehicleDayProcWeight(j));
+		}
+		IConsolePrint(CC_DEFAULT, buffer);
+	}
+	return true;
+}
+
 #ifdef _DEBUG
 /******************
  *  debug commands
@@ -1934,6 +2208,12 @@ void IConsoleStdLibRegister()
 	IConsoleCmdRegister("list_settings",ConListSettings);
 	IConsoleCmdRegister("gamelog",      ConGamelogPrint);
 	IConsoleCmdRegister("rescan_newgrf", ConRescanNewGRF);
+	IConsoleCmdRegister("benchmark_linkgraph", ConBenchmarkLinkGraph, ConHookNoNetwork);
+	IConsoleCmdRegister("linkgraph_timings", ConLinkGraphTimings);
+	IConsoleCmdRegister("vehicle_ticks", ConVehicleTicks);
+	IConsoleCmdRegister("vehicle_hash_stats", ConVehicleHashStats);
+	IConsoleCmdRegister("vehicle_day_proc", ConVehicleDayProc);
+	IConsoleCmdRegister("cargo_compaction", ConCargoCompaction);
 
 	IConsoleAliasRegister("dir",          "ls");
 	IConsoleAliasRegister("del",          "rm %+");
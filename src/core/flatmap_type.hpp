@@ -0,0 +1,299 @@
+/* $Id$ */
+
+/*
+ * This file is part of OpenTTD.
+ * OpenTTD is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * OpenTTD is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with OpenTTD. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file flatmap_type.hpp Sorted mapping class storing its items in one contiguous block of memory. */
+
+#ifndef FLATMAP_TYPE_HPP
+#define FLATMAP_TYPE_HPP
+
+#include "alloc_func.hpp"
+#include "math_func.hpp"
+#include <utility>
+#include <iterator>
+#include <new>
+
+/**
+ * Map keeping its items sorted by key in a single array. Lookups are binary
+ * searches and iteration is a linear walk over contiguous memory, so this is
+ * a lot more cache friendly than std::map. Inserting or erasing in the middle
+ * moves all following items, though. Appending items in ascending key order
+ * is cheap, which is the common case when building a map from scratch.
+ *
+ * The interface is a subset of std::map's, so it can replace it directly.
+ * Unlike std::map, iterators are invalidated by any insertion or erasure.
+ *
+ * @note Keys and values don't need to be POD, but they are relocated with
+ *       memmove and realloc. They must not hold pointers to themselves.
+ * @tparam T Key type, ordered by operator<.
+ * @tparam U Value type.
+ * @tparam S Minimum number of items to allocate space for.
+ */
+template <typename T, typename U, uint S = 4>
+class FlatMap {
+public:
+	typedef T key_type;
+	typedef U mapped_type;
+	typedef std::pair<T, U> value_type;
+	typedef value_type *iterator;
+	typedef const value_type *const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	typedef uint size_type;
+
+protected:
+	value_type *data; ///< The sorted items.
+	uint items;       ///< Number of items stored.
+	uint capacity;    ///< Number of items there is space for.
+
+	/**
+	 * Resize the memory block to the current capacity. The items are moved
+	 * bytewise; the casts tell the compiler that's intended.
+	 */
+	inline void Reallocate()
+	{
+		this->data = (value_type *)ReallocT((byte *)this->data, this->capacity * sizeof(value_type));
+	}
+
+	/**
+	 * Make room for an item at the given position.
+	 * @param pos Position the new item will be constructed at.
+	 * @return Pointer to the uninitialised memory at pos.
+	 */
+	value_type *MakeRoom(uint pos)
+	{
+		assert(pos <= this->items);
+		if (this->items == this->capacity) {
+			this->capacity = max(S, this->capacity * 2);
+			this->Reallocate();
+		}
+		if (pos < this->items) memmove((void *)(this->data + pos + 1), (const void *)(this->data + pos), (this->items - pos) * sizeof(value_type));
+		this->items++;
+		return this->data + pos;
+	}
+
+	/**
+	 * Copy all items from another map into this empty one.
+	 * @param other Map to copy.
+	 */
+	void CopyFrom(const FlatMap &other)
+	{
+		assert(this->items == 0);
+		if (other.items > this->capacity) {
+			this->capacity = other.items;
+			this->Reallocate();
+		}
+		for (; this->items < other.items; this->items++) {
+			new (this->data + this->items) value_type(other.data[this->items]);
+		}
+	}
+
+public:
+	FlatMap() : data(NULL), items(0), capacity(0) {}
+
+	/**
+	 * Copy constructor.
+	 * @param other Map to copy.
+	 */
+	FlatMap(const FlatMap &other) : data(NULL), items(0), capacity(0)
+	{
+		this->CopyFrom(other);
+	}
+
+	/**
+	 * Assignment.
+	 * @param other Map to copy.
+	 * @return This map.
+	 */
+	FlatMap &operator=(const FlatMap &other)
+	{
+		if (&other == this) return *this;
+		this->clear();
+		this->CopyFrom(other);
+		return *this;
+	}
+
+	~FlatMap()
+	{
+		this->clear();
+		free(this->data);
+	}
+
+	inline iterator begin() { return this->data; }
+	inline const_iterator begin() const { return this->data; }
+	inline iterator end() { return this->data + this->items; }
+	inline const_iterator end() const { return this->data + this->items; }
+	inline reverse_iterator rbegin() { return reverse_iterator(this->end()); }
+	inline const_reverse_iterator rbegin() const { return const_reverse_iterator(this->end()); }
+	inline reverse_iterator rend() { return reverse_iterator(this->begin()); }
+	inline const_reverse_iterator rend() const { return const_reverse_iterator(this->begin()); }
+
+	/**
+	 * Get the number of items in the map.
+	 * @return Number of items.
+	 */
+	inline size_type size() const { return this->items; }
+
+	/**
+	 * Check if the map is empty.
+	 * @return If there are no items in the map.
+	 */
+	inline bool empty() const { return this->items == 0; }
+
+	/**
+	 * Destroy all items, but keep the memory for reuse.
+	 */
+	void clear()
+	{
+		for (uint i = 0; i < this->items; i++) this->data[i].~value_type();
+		this->items = 0;
+	}
+
+	/**
+	 * Exchange the contents of this map with another one without copying.
+	 * @param other Map to swap with.
+	 */
+	inline void swap(FlatMap &other)
+	{
+		Swap(this->data, other.data);
+		Swap(this->items, other.items);
+		Swap(this->capacity, other.capacity);
+	}
+
+	/**
+	 * Find the first item with a key not less than the given one.
+	 * @param key Key to look for.
+	 * @return Iterator to the item or end().
+	 */
+	const_iterator lower_bound(const T &key) const
+	{
+		const_iterator first = this->begin();
+		uint count = this->items;
+		while (count > 0) {
+			uint step = count / 2;
+			if (first[step].first < key) {
+				first += step + 1;
+				count -= step + 1;
+			} else {
+				count = step;
+			}
+		}
+		return first;
+	}
+
+	/**
+	 * Find the first item with a key greater than the given one.
+	 * @param key Key to look for.
+	 * @return Iterator to the item or end().
+	 */
+	const_iterator upper_bound(const T &key) const
+	{
+		const_iterator first = this->begin();
+		uint count = this->items;
+		while (count > 0) {
+			uint step = count / 2;
+			if (key < first[step].first) {
+				count = step;
+			} else {
+				first += step + 1;
+				count -= step + 1;
+			}
+		}
+		return first;
+	}
+
+	inline iterator lower_bound(const T &key) { return const_cast<iterator>(const_cast<const FlatMap *>(this)->lower_bound(key)); }
+	inline iterator upper_bound(const T &key) { return const_cast<iterator>(const_cast<const FlatMap *>(this)->upper_bound(key)); }
+
+	/**
+	 * Find the item with the given key.
+	 * @param key Key to look for.
+	 * @return Iterator to the item or end() if there is none.
+	 */
+	inline const_iterator find(const T &key) const
+	{
+		const_iterator it = this->lower_bound(key);
+		return (it == this->end() || key < it->first) ? this->end() : it;
+	}
+
+	inline iterator find(const T &key) { return const_cast<iterator>(const_cast<const FlatMap *>(this)->find(key)); }
+
+	/**
+	 * Insert an item if there is none with the same key yet.
+	 * @param item Item to insert.
+	 * @return Iterator to the item with the given key and whether it was inserted.
+	 */
+	std::pair<iterator, bool> insert(const value_type &item)
+	{
+		/* Fast path for building the map in key order. */
+		iterator it = (this->items == 0 || this->data[this->items - 1].first < item.first) ?
+				this->end() : this->lower_bound(item.first);
+		if (it != this->end() && !(item.first < it->first)) return std::make_pair(it, false);
+		it = this->MakeRoom(it - this->begin());
+		new (it) value_type(item);
+		return std::make_pair(it, true);
+	}
+
+	/**
+	 * Insert a range of items. Items with keys already in the map are ignored.
+	 * @param first First item to insert.
+	 * @param last Item after the last one to insert.
+	 */
+	template <typename Titer>
+	void insert(Titer first, Titer last)
+	{
+		for (; first != last; ++first) this->insert(*first);
+	}
+
+	/**
+	 * Get the value for a key, inserting a default constructed one if the key
+	 * isn't in the map yet.
+	 * @param key Key to look for.
+	 * @return Value for the key.
+	 */
+	U &operator[](const T &key)
+	{
+		iterator it = (this->items == 0 || this->data[this->items - 1].first < key) ?
+				this->end() : this->lower_bound(key);
+		if (it == this->end() || key < it->first) {
+			it = this->MakeRoom(it - this->begin());
+			new (it) value_type(key, U());
+		}
+		return it->second;
+	}
+
+	/**
+	 * Erase an item.
+	 * @param it Item to be erased.
+	 * @return Iterator to the item following the erased one.
+	 */
+	iterator erase(iterator it)
+	{
+		assert(it >= this->begin() && it < this->end());
+		it->~value_type();
+		uint pos = it - this->begin();
+		this->items--;
+		if (pos < this->items) memmove((void *)(this->data + pos), (const void *)(this->data + pos + 1), (this->items - pos) * sizeof(value_type));
+		return it;
+	}
+
+	/**
+	 * Erase the item with the given key, if there is one.
+	 * @param key Key of the item.
+	 * @return Number of erased items.
+	 */
+	size_type erase(const T &key)
+	{
+		iterator it = this->find(key);
+		if (it == this->end()) return 0;
+		this->erase(it);
+		return 1;
+	}
+};
+
+#endif /* FLATMAP_TYPE_HPP */
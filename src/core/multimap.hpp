@@ -12,80 +12,184 @@
 #ifndef MULTIMAP_HPP
 #define MULTIMAP_HPP
 
-#include <map>
-#include <list>
-
-template<typename Tkey, typename Tvalue, typename Tcompare>
-class MultiMap;
+#include "flatmap_type.hpp"
+#include "mem_func.hpp"
 
 /**
- * STL-style iterator for MultiMap.
- * @tparam Tmap_iter Iterator type for the map in the MultiMap.
- * @tparam Tlist_iter Iterator type for the lists in the MultiMap.
- * @tparam Tkey Key type of the MultiMap.
- * @tparam Tvalue Value type of the MultMap.
- * @tparam Tcompare Comparator type for keys of the MultiMap.
+ * Contiguous list of items with equal keys in a MultiMap. Items are appended
+ * at the back and usually taken from the front, so removing the first item
+ * only advances an offset. The free space in front is reused when the list
+ * has to grow.
+ * @note Items are moved bytewise and never destructed. Only use this for POD
+ *       types like pointers or IDs.
+ * @tparam T Type of the items.
  */
-template<class Tmap_iter, class Tlist_iter, class Tkey, class Tvalue, class Tcompare>
-class MultiMapIterator {
+template <typename T>
+class MultiMapList {
+public:
+	typedef T *iterator;
+	typedef const T *const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	typedef uint size_type;
+
 protected:
-	friend class MultiMap<Tkey, Tvalue, Tcompare>;
-	typedef MultiMapIterator<Tmap_iter, Tlist_iter, Tkey, Tvalue, Tcompare> Self;
+	T *data;       ///< Memory block holding the items.
+	uint first;    ///< Index of the first item in data.
+	uint last;     ///< Index behind the last item in data.
+	uint capacity; ///< Number of items there is space for in data.
 
-	Tlist_iter list_iter; ///< Iterator pointing to current position in the current list of items with equal keys.
-	Tmap_iter map_iter;   ///< Iterator pointing to the position of the current list of items with equal keys in the map.
+public:
+	MultiMapList() : data(NULL), first(0), last(0), capacity(0) {}
 
 	/**
-	 * Flag to show that the iterator has just "walked" a step in the map.
-	 * We cannot check the current list for that as we might have reached end() of the map. In that case we'd need to
-	 * set list_iter to some sort of "invalid" state, but that's impossible as operator== yields undefined behaviour
-	 * if the iterators don't belong to the same list and there is no list at end(). So if we created a static empty
-	 * list and an "invalid" iterator in that we could not determine if the iterator is invalid while it's valid. We
-	 * can also not determine if the map iterator is valid while we don't have the map; so in the end it's easiest to
-	 * just introduce an extra flag.
+	 * Copy constructor.
+	 * @param other List to copy.
 	 */
-	bool list_valid;
+	MultiMapList(const MultiMapList &other) : data(NULL), first(0), last(0), capacity(0)
+	{
+		this->assign(other.begin(), other.end());
+	}
 
-public:
 	/**
-	 * Simple, dangerous constructor to allow later assignment with operator=.
+	 * Assignment.
+	 * @param other List to copy.
+	 * @return This list.
 	 */
-	MultiMapIterator() : list_valid(false) {}
+	MultiMapList &operator=(const MultiMapList &other)
+	{
+		if (&other != this) this->assign(other.begin(), other.end());
+		return *this;
+	}
+
+	~MultiMapList()
+	{
+		free(this->data);
+	}
+
+	inline iterator begin() { return this->data + this->first; }
+	inline const_iterator begin() const { return this->data + this->first; }
+	inline iterator end() { return this->data + this->last; }
+	inline const_iterator end() const { return this->data + this->last; }
+	inline reverse_iterator rbegin() { return reverse_iterator(this->end()); }
+	inline const_reverse_iterator rbegin() const { return const_reverse_iterator(this->end()); }
+	inline reverse_iterator rend() { return reverse_iterator(this->begin()); }
+	inline const_reverse_iterator rend() const { return const_reverse_iterator(this->begin()); }
+
+	inline size_type size() const { return this->last - this->first; }
+	inline bool empty() const { return this->last == this->first; }
+	inline T &front() { return this->data[this->first]; }
+	inline const T &front() const { return this->data[this->first]; }
+	inline T &back() { return this->data[this->last - 1]; }
+	inline const T &back() const { return this->data[this->last - 1]; }
 
 	/**
-	 * Constructor to allow possibly const iterators to be assigned from possibly
-	 * non-const map iterators. You can assign end() like this.
-	 * @tparam Tnon_const Iterator type assignable to Tmap_iter (which might be const).
-	 * @param mi One such iterator.
+	 * Append an item. If the list is full the items are moved to the front
+	 * of the memory block, if that frees enough space, or the block grows.
+	 * @param item Item to append.
 	 */
-	template<class Tnon_const>
-	MultiMapIterator(Tnon_const mi) : map_iter(mi), list_valid(false) {}
+	void push_back(const T &item)
+	{
+		if (this->last == this->capacity) {
+			uint items = this->size();
+			if (this->first > items) {
+				MemMoveT(this->data, this->data + this->first, items);
+			} else {
+				this->capacity = max(4U, this->capacity * 2);
+				this->data = ReallocT(this->data, this->capacity);
+				if (this->first > 0) MemMoveT(this->data, this->data + this->first, items);
+			}
+			this->first = 0;
+			this->last = items;
+		}
+		this->data[this->last++] = item;
+	}
+
+	/** Remove the first item. */
+	inline void pop_front()
+	{
+		assert(!this->empty());
+		if (++this->first == this->last) this->first = this->last = 0;
+	}
 
 	/**
-	 * Constructor to allow specifying an exact position in map and list. You cannot
-	 * construct end() like this as the constructor will actually check li and mi->second
-	 * for list_valid.
-	 * @param mi Iterator in the map.
-	 * @param li Iterator in the list.
+	 * Remove all items from the given position to the end.
+	 * @param pos First item to be removed.
 	 */
-	MultiMapIterator(Tmap_iter mi, Tlist_iter li) : list_iter(li), map_iter(mi)
+	inline void truncate(iterator pos)
 	{
-		this->list_valid = (this->list_iter != this->map_iter->second.begin());
+		assert(pos >= this->begin() && pos <= this->end());
+		this->last = pos - this->data;
+		if (this->first == this->last) this->first = this->last = 0;
+	}
+
+	/** Remove all items, but keep the memory. */
+	inline void clear()
+	{
+		this->first = this->last = 0;
+	}
+
+	/**
+	 * Replace the contents of the list with a range of items.
+	 * @param first First item to be copied.
+	 * @param last Item behind the last one to be copied.
+	 */
+	template <typename Titer>
+	void assign(Titer first, Titer last)
+	{
+		this->clear();
+		for (; first != last; ++first) this->push_back(*first);
 	}
 
 	/**
-	 * Assignment iterator like constructor with the same signature.
+	 * Exchange the contents of this list with another one without copying.
+	 * @param other List to swap with.
+	 */
+	inline void swap(MultiMapList &other)
+	{
+		Swap(this->data, other.data);
+		Swap(this->first, other.first);
+		Swap(this->last, other.last);
+		Swap(this->capacity, other.capacity);
+	}
+};
+
+/**
+ * STL-style iterator for MultiMap. It points to a list in the map and a
+ * position in that list. An iterator at position 0 can be constructed from a
+ * plain map iterator, which is also how end() is represented.
+ * @tparam Tmap_iter Iterator type for the map in the MultiMap.
+ * @tparam Tvalue Value type of the MultiMap.
+ */
+template<class Tmap_iter, class Tvalue>
+class MultiMapIterator {
+protected:
+	typedef MultiMapIterator<Tmap_iter, Tvalue> Self;
+
+	Tmap_iter map_iter; ///< Iterator pointing to the list of items with the current key in the map.
+	uint pos;           ///< Position of the current item in that list.
+
+public:
+	/**
+	 * Simple, dangerous constructor to allow later assignment with operator=.
+	 */
+	MultiMapIterator() : map_iter(), pos(0) {}
+
+	/**
+	 * Constructor to allow possibly const iterators to be assigned from possibly
+	 * non-const map iterators. You can assign end() like this.
 	 * @tparam Tnon_const Iterator type assignable to Tmap_iter (which might be const).
 	 * @param mi One such iterator.
-	 * @return This iterator.
 	 */
 	template<class Tnon_const>
-	Self &operator=(Tnon_const mi)
-	{
-		this->map_iter = mi;
-		this->list_valid = false;
-		return *this;
-	}
+	MultiMapIterator(Tnon_const mi) : map_iter(mi), pos(0) {}
+
+	/**
+	 * Constructor to allow specifying an exact position in map and list.
+	 * @param mi Iterator in the map.
+	 * @param pos Position in the list.
+	 */
+	MultiMapIterator(Tmap_iter mi, uint pos) : map_iter(mi), pos(pos) {}
 
 	/**
 	 * Dereference operator. Works just like usual STL operator*() on various containers.
@@ -94,10 +198,8 @@ public:
 	 */
 	Tvalue &operator*() const
 	{
-		assert(!this->map_iter->second.empty());
-		return this->list_valid ?
-				this->list_iter.operator*() :
-				this->map_iter->second.begin().operator*();
+		assert(this->pos < this->map_iter->second.size());
+		return this->map_iter->second.begin()[this->pos];
 	}
 
 	/**
@@ -106,39 +208,25 @@ public:
 	 */
 	Tvalue *operator->() const
 	{
-		assert(!this->map_iter->second.empty());
-		return this->list_valid ?
-				this->list_iter.operator->() :
-				this->map_iter->second.begin().operator->();
+		return &this->operator*();
 	}
 
 	inline const Tmap_iter &GetMapIter() const { return this->map_iter; }
-	inline const Tlist_iter &GetListIter() const { return this->list_iter; }
-	inline bool ListValid() const { return this->list_valid; }
+	inline uint GetPos() const { return this->pos; }
 
-	const Tkey &GetKey() const { return this->map_iter->first; }
+	const typename std::iterator_traits<Tmap_iter>::value_type::first_type &GetKey() const { return this->map_iter->first; }
 
 	/**
 	 * Prefix increment operator. Increment the iterator and set it to the
-	 * next item in the MultiMap. This either increments the list iterator
-	 * or the map iterator and sets list_valid accordingly.
+	 * next item in the MultiMap.
 	 * @return This iterator after incrementing.
 	 */
 	Self &operator++()
 	{
 		assert(!this->map_iter->second.empty());
-		if (this->list_valid) {
-			if (++this->list_iter == this->map_iter->second.end()) {
-				++this->map_iter;
-				this->list_valid = false;
-			}
-		} else {
-			this->list_iter = ++(this->map_iter->second.begin());
-			if (this->list_iter == this->map_iter->second.end()) {
-				++this->map_iter;
-			} else {
-				this->list_valid = true;
-			}
+		if (++this->pos == this->map_iter->second.size()) {
+			++this->map_iter;
+			this->pos = 0;
 		}
 		return *this;
 	}
@@ -163,14 +251,12 @@ public:
 	 */
 	Self &operator--()
 	{
-		assert(!this->map_iter->second.empty());
-		if (!this->list_valid) {
+		if (this->pos == 0) {
 			--this->map_iter;
-			this->list_iter = this->map_iter->second.end();
 			assert(!this->map_iter->second.empty());
+			this->pos = this->map_iter->second.size();
 		}
-
-		this->list_valid = (--this->list_iter != this->map_iter->second.begin());
+		--this->pos;
 		return *this;
 	}
 
@@ -188,54 +274,41 @@ public:
 	}
 };
 
-/* Generic comparison functions for const/non-const MultiMap iterators and map iterators */
-
 /**
- * Compare two MultiMap iterators. Iterators are equal if
- * 1. Their map iterators are equal.
- * 2. They agree about list_valid.
- * 3. If list_valid they agree about list_iter.
- * Lots of template parameters to make all possible const and non-const types of MultiMap iterators
- * (on maps with const and non-const values) comparable to each other.
+ * Compare two MultiMap iterators. Iterators are equal if they point to the
+ * same position in the same list.
  * @param iter1 First iterator to compare.
  * @param iter2 Second iterator to compare.
  * @return If iter1 and iter2 are equal.
  */
-template<class Tmap_iter1, class Tlist_iter1, class Tmap_iter2, class Tlist_iter2, class Tkey, class Tvalue1, class Tvalue2, class Tcompare>
-bool operator==(const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue1, Tcompare> &iter1, const MultiMapIterator<Tmap_iter2, Tlist_iter2, Tkey, Tvalue2, Tcompare> &iter2)
+template<class Tmap_iter1, class Tmap_iter2, class Tvalue1, class Tvalue2>
+bool operator==(const MultiMapIterator<Tmap_iter1, Tvalue1> &iter1, const MultiMapIterator<Tmap_iter2, Tvalue2> &iter2)
 {
-	if (iter1.GetMapIter() != iter2.GetMapIter()) return false;
-	if (!iter1.ListValid()) return !iter2.ListValid();
-	return iter2.ListValid() ?
-			iter1.GetListIter() == iter2.GetListIter() : false;
+	return iter1.GetMapIter() == iter2.GetMapIter() && iter1.GetPos() == iter2.GetPos();
 }
 
 /**
  * Inverse of operator==().
- * Lots of template parameters to make all possible const and non-const types of MultiMap iterators
- * (on maps with const and non-const values) comparable to each other.
  * @param iter1 First iterator to compare.
  * @param iter2 Second iterator to compare.
  * @return If iter1 and iter2 are not equal.
  */
-template<class Tmap_iter1, class Tlist_iter1, class Tmap_iter2, class Tlist_iter2, class Tkey, class Tvalue1, class Tvalue2, class Tcompare>
-bool operator!=(const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue1, Tcompare> &iter1, const MultiMapIterator<Tmap_iter2, Tlist_iter2, Tkey, Tvalue2, Tcompare> &iter2)
+template<class Tmap_iter1, class Tmap_iter2, class Tvalue1, class Tvalue2>
+bool operator!=(const MultiMapIterator<Tmap_iter1, Tvalue1> &iter1, const MultiMapIterator<Tmap_iter2, Tvalue2> &iter2)
 {
 	return !(iter1 == iter2);
 }
 
 /**
  * Check if a MultiMap iterator is at the begin of a list pointed to by the given map iterator.
- * Lots of template parameters to make all possible const and non-const types of MultiMap iterators
- * (on maps with const and non-const values) comparable to all possible types of map iterators.
  * @param iter1 MultiMap iterator.
  * @param iter2 Map iterator.
  * @return If iter1 points to the begin of the list pointed to by iter2.
  */
-template<class Tmap_iter1, class Tlist_iter1, class Tmap_iter2, class Tkey, class Tvalue, class Tcompare >
-bool operator==(const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue, Tcompare> &iter1, const Tmap_iter2 &iter2)
+template<class Tmap_iter1, class Tmap_iter2, class Tvalue>
+bool operator==(const MultiMapIterator<Tmap_iter1, Tvalue> &iter1, const Tmap_iter2 &iter2)
 {
-	return !iter1.ListValid() && iter1.GetMapIter() == iter2;
+	return iter1.GetPos() == 0 && iter1.GetMapIter() == iter2;
 }
 
 /**
@@ -244,10 +317,10 @@ bool operator==(const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue, Tc
  * @param iter2 Map iterator.
  * @return If iter1 doesn't point to the begin of the list pointed to by iter2.
  */
-template<class Tmap_iter1, class Tlist_iter1, class Tmap_iter2, class Tkey, class Tvalue, class Tcompare >
-bool operator!=(const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue, Tcompare> &iter1, const Tmap_iter2 &iter2)
+template<class Tmap_iter1, class Tmap_iter2, class Tvalue>
+bool operator!=(const MultiMapIterator<Tmap_iter1, Tvalue> &iter1, const Tmap_iter2 &iter2)
 {
-	return iter1.ListValid() || iter1.GetMapIter() != iter2;
+	return iter1.GetPos() != 0 || iter1.GetMapIter() != iter2;
 }
 
 /**
@@ -256,10 +329,10 @@ bool operator!=(const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue, Tc
  * @param iter1 MultiMap iterator.
  * @return If iter1 points to the begin of the list pointed to by iter2.
  */
-template<class Tmap_iter1, class Tlist_iter1, class Tmap_iter2, class Tkey, class Tvalue, class Tcompare >
-bool operator==(const Tmap_iter2 &iter2, const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue, Tcompare> &iter1)
+template<class Tmap_iter1, class Tmap_iter2, class Tvalue>
+bool operator==(const Tmap_iter2 &iter2, const MultiMapIterator<Tmap_iter1, Tvalue> &iter1)
 {
-	return !iter1.ListValid() && iter1.GetMapIter() == iter2;
+	return iter1.GetPos() == 0 && iter1.GetMapIter() == iter2;
 }
 
 /**
@@ -268,57 +341,40 @@ bool operator==(const Tmap_iter2 &iter2, const MultiMapIterator<Tmap_iter1, Tlis
  * @param iter1 MultiMap iterator.
  * @return If iter1 doesn't point to the begin of the list pointed to by iter2.
  */
-template<class Tmap_iter1, class Tlist_iter1, class Tmap_iter2, class Tkey, class Tvalue, class Tcompare >
-bool operator!=(const Tmap_iter2 &iter2, const MultiMapIterator<Tmap_iter1, Tlist_iter1, Tkey, Tvalue, Tcompare> &iter1)
+template<class Tmap_iter1, class Tmap_iter2, class Tvalue>
+bool operator!=(const Tmap_iter2 &iter2, const MultiMapIterator<Tmap_iter1, Tvalue> &iter1)
 {
-	return iter1.ListValid() || iter1.GetMapIter() != iter2;
+	return iter1.GetPos() != 0 || iter1.GetMapIter() != iter2;
 }
 
 
 /**
- * Hand-rolled multimap as map of lists. Behaves mostly like a list, but is sorted
- * by Tkey so that you can easily look up ranges of equal keys. Those ranges are
- * internally ordered in a deterministic way (contrary to STL multimap). All
- * STL-compatible members are named in STL style, all others are named in OpenTTD
- * style.
+ * Hand-rolled multimap as flat map of contiguous lists. Behaves mostly like a
+ * list, but is sorted by Tkey so that you can easily look up ranges of equal
+ * keys. Those ranges are internally ordered in a deterministic way (contrary
+ * to STL multimap). All STL-compatible members are named in STL style, all
+ * others are named in OpenTTD style.
+ *
+ * There are never any empty lists in the map. Adding a new key moves the
+ * other lists around in memory, so it invalidates all iterators and
+ * references to lists. Take a list out of the map with swap() if you need to
+ * keep working on it while adding other keys.
+ * @tparam Tkey Key type, ordered by operator<.
+ * @tparam Tvalue Value type, has to be POD.
  */
-template<typename Tkey, typename Tvalue, typename Tcompare = std::less<Tkey> >
-class MultiMap : public std::map<Tkey, std::list<Tvalue>, Tcompare > {
+template<typename Tkey, typename Tvalue>
+class MultiMap : public FlatMap<Tkey, MultiMapList<Tvalue> > {
 public:
-	typedef typename std::list<Tvalue> List;
+	typedef MultiMapList<Tvalue> List;
 	typedef typename List::iterator ListIterator;
 	typedef typename List::const_iterator ConstListIterator;
 
-	typedef typename std::map<Tkey, List, Tcompare > Map;
+	typedef FlatMap<Tkey, List> Map;
 	typedef typename Map::iterator MapIterator;
 	typedef typename Map::const_iterator ConstMapIterator;
 
-	typedef MultiMapIterator<MapIterator, ListIterator, Tkey, Tvalue, Tcompare> iterator;
-	typedef MultiMapIterator<ConstMapIterator, ConstListIterator, Tkey, const Tvalue, Tcompare> const_iterator;
-
-	/**
-	 * Erase the value pointed to by an iterator. The iterator may be invalid afterwards.
-	 * @param it Iterator pointing at some value.
-	 * @return Iterator to the element after the deleted one (or invalid).
-	 */
-	iterator erase(iterator it)
-	{
-		List &list = it.map_iter->second;
-		assert(!list.empty());
-		if (it.list_valid) {
-			it.list_iter = list.erase(it.list_iter);
-			/* This can't be the first list element as otherwise list_valid would have
-			 * to be false. So the list cannot be empty here. */
-			if (it.list_iter == list.end()) {
-				++it.map_iter;
-				it.list_valid = false;
-			}
-		} else {
-			list.erase(list.begin());
-			if (list.empty()) this->Map::erase(it.map_iter++);
-		}
-		return it;
-	}
+	typedef MultiMapIterator<MapIterator, Tvalue> iterator;
+	typedef MultiMapIterator<ConstMapIterator, const Tvalue> const_iterator;
 
 	/**
 	 * Insert a value at the end of the range with the specified key.
@@ -327,9 +383,7 @@ public:
 	 */
 	void Insert(const Tkey &key, const Tvalue &val)
 	{
-		List &list = (*this)[key];
-		list.push_back(val);
-		assert(!list.empty());
+		(*this)[key].push_back(val);
 	}
 
 	/**
@@ -114,6 +114,17 @@ public:
 		data = NULL;
 	}
 
+	/**
+	 * Exchange the items with another list without copying them.
+	 * @param other The list to exchange the items with.
+	 */
+	inline void Swap(SmallVector &other)
+	{
+		::Swap(this->data, other.data);
+		::Swap(this->items, other.items);
+		::Swap(this->capacity, other.capacity);
+	}
+
 	/**
 	 * Compact the list down to the smallest block size boundary.
 	 */
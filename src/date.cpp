@@ -169,6 +169,7 @@ Ticks GetCurrentTickCount()
 extern void EnginesDailyLoop();
 extern void DisasterDailyLoop();
 extern void IndustryDailyLoop();
+extern void CargoCompactionDailyLoop();
 
 extern void CompaniesMonthlyLoop();
 extern void EnginesMonthlyLoop();
@@ -270,6 +271,7 @@ static void OnNewDay()
 
 	SetWindowWidgetDirty(WC_STATUS_BAR, 0, 0);
 	EnginesDailyLoop();
+	CargoCompactionDailyLoop();
 
 	/* Refresh after possible snowline change */
 	SetWindowClassesDirty(WC_TOWN_VIEW);
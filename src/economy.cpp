@@ -49,6 +49,7 @@
 #include "goal_base.h"
 #include "story_base.h"
 #include "linkgraph/refresh.h"
+#include <algorithm>
 
 #include "table/strings.h"
 #include "table/pricebase.h"
@@ -908,11 +909,21 @@ void StartupEconomy()
 
 }
 
+/**
+ * Stations which may have vehicles loading. Stations are appended when a
+ * vehicle starts loading and removed when they're found without any loading
+ * vehicles in LoadUnloadStations(), which also sorts them by ID.
+ */
+static SmallVector<StationID, 64> _loading_stations;
+static bool _loading_stations_valid = false; ///< If _loading_stations is up to date. Otherwise it's rebuilt from all stations.
+
 /**
  * Resets economy to initial values
  */
 void InitializeEconomy()
 {
+	_loading_stations.Clear();
+	_loading_stations_valid = false;
 	_economy.inflation_prices = _economy.inflation_payment = 1 << 16;
 	ClearCargoPickupMonitoring();
 	ClearCargoDeliveryMonitoring();
@@ -1219,6 +1230,7 @@ void PrepareUnload(Vehicle *front_v)
 {
 	Station *curr_station = Station::Get(front_v->last_station_visited);
 	curr_station->loading_vehicles.push_back(front_v);
+	if (_loading_stations_valid) *_loading_stations.Append() = curr_station->index;
 
 	/* At this moment loading cannot be finished */
 	ClrBit(front_v->vehicle_flags, VF_LOADING_FINISHED);
@@ -1440,11 +1452,18 @@ static void HandleStationRefit(Vehicle *v, CargoArray &consist_capleft, Station
 	cur_company.Restore();
 }
 
+/** Marker for parts of a consist whose load amount hasn't been determined in advance. */
+static const uint LOAD_AMOUNT_UNKNOWN = UINT_MAX;
+
 /**
  * Loads/unload the vehicle if possible.
  * @param front the vehicle to be (un)loaded
+ * @param load_amounts Load amounts of the parts of the consist, determined
+ *                     in advance, or NULL if the consist isn't going to be
+ *                     (un)loaded in this tick.
+ * @param num_load_amounts Number of parts load amounts are given for.
  */
-static void LoadUnloadVehicle(Vehicle *front)
+static void LoadUnloadVehicle(Vehicle *front, const uint *load_amounts, uint num_load_amounts)
 {
 	assert(front->current_order.IsType(OT_LOADING));
 
@@ -1463,6 +1482,7 @@ static void LoadUnloadVehicle(Vehicle *front)
 
 	/* We have not waited enough time till the next round of loading/unloading */
 	if (front->load_unload_ticks != 0) return;
+	assert(load_amounts != NULL);
 
 	if (front->type == VEH_TRAIN && (!IsTileType(front->tile, MP_STATION) || GetStationIndex(front->tile) != st->index)) {
 		/* The train reversed in the station. Take the "easy" way
@@ -1489,12 +1509,20 @@ static void LoadUnloadVehicle(Vehicle *front)
 	CargoPayment *payment = front->cargo_payment;
 
 	uint artic_part = 0; // Articulated part we are currently trying to load. (not counting parts without capacity)
-	for (Vehicle *v = front; v != NULL; v = v->Next()) {
-		if (v == front || !v->Previous()->HasArticulatedPart()) artic_part = 0;
+	uint part = 0;       // Position of the current part in the consist.
+	bool artic_refitted = false; // Whether the articulated vehicle we are currently loading has been refitted in this tick.
+	for (Vehicle *v = front; v != NULL; v = v->Next(), part++) {
+		if (v == front || !v->Previous()->HasArticulatedPart()) {
+			artic_part = 0;
+			artic_refitted = false;
+		}
 		if (v->cargo_cap == 0) continue;
 		artic_part++;
 
-		uint load_amount = GetLoadAmount(v);
+		/* A refit of an earlier part may have given this one a capacity or
+		 * another cargo, which the load amount depends on. */
+		uint load_amount = part < num_load_amounts && !artic_refitted ? load_amounts[part] : LOAD_AMOUNT_UNKNOWN;
+		if (load_amount == LOAD_AMOUNT_UNKNOWN) load_amount = GetLoadAmount(v);
 
 		GoodsEntry *ge = &st->goods[v->cargo_type];
 
@@ -1560,6 +1588,8 @@ static void LoadUnloadVehicle(Vehicle *front)
 		if (front->current_order.IsRefit() && artic_part == 1 && IsArticulatedVehicleEmpty(v)) {
 			HandleStationRefit(v, consist_capleft, st, next_station, front->current_order.GetRefitCargo());
 			ge = &st->goods[v->cargo_type];
+			artic_refitted = true;
+			load_amount = GetLoadAmount(v);
 		}
 
 		/* As we're loading here the following link can carry the full capacity of the vehicle. */
@@ -1743,12 +1773,25 @@ static void LoadUnloadVehicle(Vehicle *front)
 	}
 }
 
+/** Consist to be handled by LoadUnloadStations in the current tick. */
+struct LoadUnloadItem {
+	Station *st;          ///< Station the consist is loading at.
+	Vehicle *front;       ///< Front of the consist.
+	uint load_amounts;    ///< Index of the consist's load amounts in _load_amounts, or UINT_MAX if it isn't (un)loaded in this tick.
+	uint num_parts;       ///< Number of parts of the consist.
+};
+
+static SmallVector<LoadUnloadItem, 64> _load_unload_queue; ///< Consists to be handled in the current tick.
+static SmallVector<uint, 256> _load_amounts;                ///< Load amounts of all parts of the consists to be (un)loaded in the current tick.
+
 /**
- * Load/unload the vehicles in this station according to the order
- * they entered.
- * @param st the station to do the loading/unloading for
+ * Count down the loading time of the vehicles in this station and queue the
+ * consists which have to be handled in this tick. Those are all vehicles
+ * up to the last one which is going to load or unload, in the order they
+ * entered. Vehicles before that only reserve cargo.
+ * @param st the station to queue the vehicles for
  */
-void LoadUnloadStation(Station *st)
+static void QueueLoadUnloadStation(Station *st)
 {
 	/* No vehicle is here... */
 	if (st->loading_vehicles.empty()) return;
@@ -1777,16 +1820,74 @@ void LoadUnloadStation(Station *st)
 
 	for (iter = st->loading_vehicles.begin(); iter != st->loading_vehicles.end(); ++iter) {
 		Vehicle *v = *iter;
-		if (!(v->vehstatus & (VS_STOPPED | VS_CRASHED))) LoadUnloadVehicle(v);
+		if (!(v->vehstatus & (VS_STOPPED | VS_CRASHED))) {
+			LoadUnloadItem *item = _load_unload_queue.Append();
+			item->st = st;
+			item->front = v;
+			item->load_amounts = UINT_MAX;
+			item->num_parts = 0;
+		}
 		if (v == last_loading) break;
 	}
+}
 
-	/* Call the production machinery of industries */
-	const Industry * const *isend = _cargo_delivery_destinations.End();
-	for (Industry **iid = _cargo_delivery_destinations.Begin(); iid != isend; iid++) {
-		TriggerIndustryProduction(*iid);
+/**
+ * Load/unload the vehicles in all stations according to the order they
+ * entered. The work is done in two passes: First the consists to be handled
+ * are collected for all stations and the load amounts of the consists which
+ * are going to load or unload are determined, which doesn't change anything
+ * but involves NewGRF callbacks. Then the consists are loaded and unloaded
+ * one after another.
+ */
+void LoadUnloadStations()
+{
+	if (!_loading_stations_valid) {
+		_loading_stations.Clear();
+		Station *st;
+		FOR_ALL_STATIONS(st) {
+			if (!st->loading_vehicles.empty()) *_loading_stations.Append() = st->index;
+		}
+		_loading_stations_valid = true;
+	}
+
+	/* Only visit the stations with loading vehicles, in the order of their
+	 * IDs, and drop those which have become empty. */
+	std::sort(_loading_stations.Begin(), _loading_stations.End());
+	const StationID *unique_end = std::unique(_loading_stations.Begin(), _loading_stations.End());
+	StationID *last = _loading_stations.Begin();
+	for (const StationID *it = _loading_stations.Begin(); it != unique_end; ++it) {
+		Station *st = Station::GetIfValid(*it);
+		if (st == NULL || st->loading_vehicles.empty()) continue;
+		*last++ = *it;
+		QueueLoadUnloadStation(st);
+	}
+	_loading_stations.Resize(last - _loading_stations.Begin());
+	if (_load_unload_queue.Length() == 0) return;
+
+	const LoadUnloadItem *end = _load_unload_queue.End();
+	for (LoadUnloadItem *item = _load_unload_queue.Begin(); item != end; ++item) {
+		if (item->front->load_unload_ticks != 0) continue;
+		item->load_amounts = _load_amounts.Length();
+		for (Vehicle *v = item->front; v != NULL; v = v->Next()) {
+			*_load_amounts.Append() = v->cargo_cap == 0 ? LOAD_AMOUNT_UNKNOWN : GetLoadAmount(v);
+			item->num_parts++;
+		}
 	}
-	_cargo_delivery_destinations.Clear();
+
+	for (const LoadUnloadItem *item = _load_unload_queue.Begin(); item != end; ++item) {
+		LoadUnloadVehicle(item->front, item->load_amounts == UINT_MAX ? NULL : _load_amounts.Get(item->load_amounts), item->num_parts);
+
+		/* Call the production machinery of industries after each station */
+		if (item + 1 != end && item[1].st == item->st) continue;
+		const Industry * const *isend = _cargo_delivery_destinations.End();
+		for (Industry **iid = _cargo_delivery_destinations.Begin(); iid != isend; iid++) {
+			TriggerIndustryProduction(*iid);
+		}
+		_cargo_delivery_destinations.Clear();
+	}
+
+	_load_unload_queue.Clear();
+	_load_amounts.Clear();
 }
 
 /**
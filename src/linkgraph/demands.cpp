@@ -65,6 +65,19 @@ public:
 		return max(from.Supply() * max(1U, to.Supply()) * this->mod_size / 100 / this->demand_per_node, 1U);
 	}
 
+	/**
+	 * Get the effective supply of a node towards a whole region.
+	 * @param from The supplying node.
+	 * @param to_supply Supply of the receiving region.
+	 * @param to_demand Unused.
+	 * @return Effective supply.
+	 */
+	inline uint EffectiveSupply(const Node &from, uint to_supply, uint to_demand)
+	{
+		uint64 supply = (uint64)from.Supply() * max(1U, to_supply) * this->mod_size / 100 / this->demand_per_node;
+		return Clamp<uint64>(supply, 1, INT32_MAX);
+	}
+
 	/**
 	 * Check if there is any acceptance left for this node. In symmetric distribution
 	 * nodes only accept anything if they also supply something. So if
@@ -123,6 +136,19 @@ public:
 		return max(from.Supply() * to.Demand() / this->demand_per_node, (uint)1);
 	}
 
+	/**
+	 * Get the effective supply of a node towards a whole region.
+	 * @param from The supplying node.
+	 * @param to_supply Unused.
+	 * @param to_demand Demand of the receiving region.
+	 * @return Effective supply.
+	 */
+	inline uint EffectiveSupply(const Node &from, uint to_supply, uint to_demand)
+	{
+		uint64 supply = (uint64)from.Supply() * to_demand / this->demand_per_node;
+		return Clamp<uint64>(supply, 1, INT32_MAX);
+	}
+
 	/**
 	 * Check if there is any acceptance left for this node. In asymmetric distribution
 	 * nodes always accept as long as their demand > 0.
@@ -171,6 +197,113 @@ inline void Scaler::SetDemands(LinkGraphJob &job, NodeID from_id, NodeID to_id,
 	job[from_id].DeliverSupply(to_id, demand_forw);
 }
 
+/**
+ * Check if a value has changed by more than the given percentage.
+ * @param old_value Previous value.
+ * @param new_value Current value.
+ * @param threshold Percentage of the previous value.
+ * @return If the difference is larger than threshold percent of old_value.
+ */
+static inline bool ExceedsThreshold(uint64 old_value, uint64 new_value, uint threshold)
+{
+	uint64 diff = old_value > new_value ? old_value - new_value : new_value - old_value;
+	return diff * 100 > old_value * threshold;
+}
+
+/**
+ * Determine the nodes whose demands have to be recalculated. Those are all
+ * nodes if there is no usable cache. Otherwise they are the nodes which are
+ * new or have changed their station or location, and the ones whose supply
+ * rate or acceptance has changed beyond the threshold.
+ * @param job Job to calculate the demands for.
+ */
+void DemandCalculator::MarkChangedNodes(LinkGraphJob &job)
+{
+	const LinkGraphSettings &settings = job.Settings();
+	const LinkGraph::DemandCache &cache = job.CachedDemands();
+	bool usable = this->recalc_threshold > 0 && !cache.IsEmpty() &&
+			cache.distribution == settings.GetDistributionType(job.Cargo()) &&
+			cache.accuracy == settings.accuracy &&
+			cache.demand_size == settings.demand_size &&
+			cache.demand_distance == settings.demand_distance;
+
+	uint size = job.Size();
+	uint64 runtime = job.SupplyRuntime();
+	this->recalc.Resize(size);
+	for (NodeID node = 0; node < size; ++node) {
+		if (!usable || node >= cache.nodes.Length()) {
+			this->recalc[node] = true;
+			continue;
+		}
+		const LinkGraph::BaseNode &old_node = cache.nodes[node];
+		Node new_node = job[node];
+		/* Compare the supplies as rates, by scaling both to the product of the runtimes. */
+		this->recalc[node] = old_node.station != new_node.Station() || old_node.xy != new_node.XY() ||
+				ExceedsThreshold(old_node.demand, new_node.Demand(), this->recalc_threshold) ||
+				ExceedsThreshold(old_node.supply * runtime, new_node.Supply() * (uint64)cache.runtime, this->recalc_threshold);
+	}
+}
+
+/**
+ * Deliver the cached demands between nodes which don't have to be
+ * recalculated. The demands are scaled by the change of supply at the
+ * supplying node.
+ * @param job Job to calculate the demands for.
+ */
+void DemandCalculator::ApplyCachedDemands(LinkGraphJob &job)
+{
+	const LinkGraph::DemandCache &cache = job.CachedDemands();
+	uint size = min(job.Size(), cache.nodes.Length());
+	for (NodeID from_id = 0; from_id < size; ++from_id) {
+		uint old_supply = cache.nodes[from_id].supply;
+		if (this->recalc[from_id] || old_supply == 0) continue;
+
+		Node from = job[from_id];
+		for (uint i = cache.offsets[from_id]; i < cache.offsets[from_id + 1]; ++i) {
+			NodeID to_id = cache.targets[i];
+			if (to_id >= size || this->recalc[to_id]) continue;
+			uint demand = (uint64)cache.amounts[i] * from.Supply() / old_supply;
+			from.DeliverSupply(to_id, min(demand, from.UndeliveredSupply()));
+		}
+	}
+}
+
+/**
+ * Calculate the demand assigned from one node to another one in one round of
+ * the distribution.
+ * @param supply Effective supply of the supplying node towards the receiving one.
+ * @param distance Distance between the nodes.
+ * @param chance Number of unsuccessful tries so far, increased if this one fails, too.
+ * @param max_chance Number of tries after which any remaining supply is distributed.
+ * @return Demand to be assigned.
+ */
+inline uint DemandCalculator::BaseDemand(int32 supply, uint distance, uint &chance, uint max_chance) const
+{
+	assert(supply > 0);
+
+	/* Scale the distance by mod_dist around max_distance */
+	int32 scaled_distance = this->max_distance - (this->max_distance -
+			(int32)distance) * this->mod_dist / 100;
+
+	/* Scale the accuracy by distance around accuracy / 2 */
+	int32 divisor = this->accuracy * (this->mod_dist - 50) / 100 +
+			this->accuracy * scaled_distance / this->max_distance + 1;
+
+	assert(divisor > 0);
+
+	if (divisor <= supply) {
+		/* At first only distribute demand if
+		 * effective supply / accuracy divisor >= 1
+		 * Others are too small or too far away to be considered. */
+		return supply / divisor;
+	} else if (++chance > max_chance) {
+		/* After some trying, if there is still supply left, distribute
+		 * demand also to other nodes. */
+		return 1;
+	}
+	return 0;
+}
+
 /**
  * Do the actual demand calculation, called from constructor.
  * @param job Job to calculate the demands for.
@@ -184,6 +317,8 @@ void DemandCalculator::CalcDemand(LinkGraphJob &job, Tscaler scaler)
 	uint num_supplies = 0;
 	uint num_demands = 0;
 
+	this->MarkChangedNodes(job);
+
 	for (NodeID node = 0; node < job.Size(); node++) {
 		scaler.AddNode(job[node]);
 		if (job[node].Supply() > 0) {
@@ -204,10 +339,40 @@ void DemandCalculator::CalcDemand(LinkGraphJob &job, Tscaler scaler)
 	scaler.SetDemandPerNode(num_demands);
 	uint chance = 0;
 
+	/* Take the demands between unchanged nodes from the cache and only
+	 * distribute the remaining supply. Without cache all nodes are
+	 * recalculated and the lists stay as they are. */
+	this->ApplyCachedDemands(job);
+	for (NodeList::iterator i = supplies.begin(); i != supplies.end();) {
+		if (job[*i].UndeliveredSupply() == 0) {
+			i = supplies.erase(i);
+			num_supplies--;
+		} else {
+			++i;
+		}
+	}
+	uint num_recalc_demands = 0;
+	for (NodeList::iterator i = demands.begin(); i != demands.end();) {
+		if (!scaler.HasDemandLeft(job[*i])) {
+			i = demands.erase(i);
+			num_demands--;
+		} else {
+			if (this->recalc[*i]) num_recalc_demands++;
+			++i;
+		}
+	}
+
 	while (!supplies.empty() && !demands.empty()) {
 		NodeID from_id = supplies.front();
 		supplies.pop_front();
 
+		if (!this->recalc[from_id] && num_recalc_demands == 0) {
+			/* An unchanged node only supplies changed ones, and there are
+			 * none left. */
+			num_supplies--;
+			continue;
+		}
+
 		for (uint i = 0; i < num_demands; ++i) {
 			assert(!demands.empty());
 			NodeID to_id = demands.front();
@@ -220,31 +385,15 @@ void DemandCalculator::CalcDemand(LinkGraphJob &job, Tscaler scaler)
 				continue;
 			}
 
-			int32 supply = scaler.EffectiveSupply(job[from_id], job[to_id]);
-			assert(supply > 0);
-
-			/* Scale the distance by mod_dist around max_distance */
-			int32 distance = this->max_distance - (this->max_distance -
-					(int32)job[from_id][to_id].Distance()) * this->mod_dist / 100;
-
-			/* Scale the accuracy by distance around accuracy / 2 */
-			int32 divisor = this->accuracy * (this->mod_dist - 50) / 100 +
-					this->accuracy * distance / this->max_distance + 1;
-
-			assert(divisor > 0);
-
-			uint demand_forw = 0;
-			if (divisor <= supply) {
-				/* At first only distribute demand if
-				 * effective supply / accuracy divisor >= 1
-				 * Others are too small or too far away to be considered. */
-				demand_forw = supply / divisor;
-			} else if (++chance > this->accuracy * num_demands * num_supplies) {
-				/* After some trying, if there is still supply left, distribute
-				 * demand also to other nodes. */
-				demand_forw = 1;
+			if (!this->IsRecalculated(from_id, to_id)) {
+				/* Demand has been taken from the cache. */
+				demands.push_back(to_id);
+				continue;
 			}
 
+			int32 supply = scaler.EffectiveSupply(job[from_id], job[to_id]);
+			uint demand_forw = this->BaseDemand(supply, job[from_id].DistanceTo(to_id),
+					chance, this->accuracy * num_demands * num_supplies);
 			demand_forw = min(demand_forw, job[from_id].UndeliveredSupply());
 
 			scaler.SetDemands(job, from_id, to_id, demand_forw);
@@ -253,6 +402,7 @@ void DemandCalculator::CalcDemand(LinkGraphJob &job, Tscaler scaler)
 				demands.push_back(to_id);
 			} else {
 				num_demands--;
+				if (this->recalc[to_id]) num_recalc_demands--;
 			}
 
 			if (job[from_id].UndeliveredSupply() == 0) break;
@@ -266,6 +416,78 @@ void DemandCalculator::CalcDemand(LinkGraphJob &job, Tscaler scaler)
 	}
 }
 
+/**
+ * Calculate the demands of a job split into regions. Each node distributes
+ * its supply among the nodes of its own region and among the other regions,
+ * which are treated like single nodes located at their hubs. Supply for other
+ * regions is sent to the local hub and from there to the remote one. So each
+ * node only gets demands to the nodes of its region and to its hub, and the
+ * hubs get demands to each other, instead of demands between all nodes.
+ * @param job Job to calculate the demands for.
+ * @tparam Tscaler Scaler to be used for scaling demands.
+ */
+template<class Tscaler>
+void DemandCalculator::CalcRegionDemand(LinkGraphJob &job, Tscaler scaler)
+{
+	const RegionPartition &regions = job.Regions();
+	NodeList supplies;
+	uint num_supplies = 0;
+	uint num_demands = 0;
+
+	for (NodeID node = 0; node < job.Size(); node++) {
+		scaler.AddNode(job[node]);
+		if (job[node].Supply() > 0) {
+			supplies.push_back(node);
+			num_supplies++;
+		}
+		if (job[node].Demand() > 0) num_demands++;
+	}
+
+	if (num_supplies == 0 || num_demands == 0) return;
+
+	scaler.SetDemandPerNode(num_demands);
+	uint num_regions = regions.NumRegions();
+	uint num_targets = job.Size() / num_regions + num_regions;
+	uint chance = 0;
+
+	while (!supplies.empty()) {
+		NodeID from_id = supplies.front();
+		supplies.pop_front();
+		Node from = job[from_id];
+		uint region = regions.RegionOf(from_id);
+		uint max_chance = this->accuracy * num_targets * num_supplies;
+		bool demand_left = false;
+
+		for (const NodeID *i = regions.Begin(region); i != regions.End(region) && from.UndeliveredSupply() > 0; ++i) {
+			NodeID to_id = *i;
+			if (to_id == from_id || !scaler.HasDemandLeft(job[to_id])) continue;
+			demand_left = true;
+
+			int32 supply = scaler.EffectiveSupply(from, job[to_id]);
+			uint demand_forw = this->BaseDemand(supply, from.DistanceTo(to_id), chance, max_chance);
+			scaler.SetDemands(job, from_id, to_id, min(demand_forw, from.UndeliveredSupply()));
+		}
+
+		NodeID local_hub = regions.Hub(region);
+		for (uint remote = 0; remote < num_regions && from.UndeliveredSupply() > 0; ++remote) {
+			if (remote == region || regions.Demand(remote) == 0) continue;
+			demand_left = true;
+
+			NodeID remote_hub = regions.Hub(remote);
+			int32 supply = scaler.EffectiveSupply(from, regions.Supply(remote), regions.Demand(remote));
+			uint demand_forw = this->BaseDemand(supply, from.DistanceTo(remote_hub), chance, max_chance);
+			demand_forw = min(demand_forw, from.UndeliveredSupply());
+			if (demand_forw > 0) from.ExportSupply(local_hub, remote_hub, job[local_hub].DemandTo(remote_hub), demand_forw);
+		}
+
+		if (from.UndeliveredSupply() != 0 && demand_left) {
+			supplies.push_back(from_id);
+		} else {
+			num_supplies--;
+		}
+	}
+}
+
 /**
  * Create the DemandCalculator and immediately do the calculation.
  * @param job Job to calculate the demands for.
@@ -277,6 +499,7 @@ DemandCalculator::DemandCalculator(LinkGraphJob &job) :
 	CargoID cargo = job.Cargo();
 
 	this->accuracy = settings.accuracy;
+	this->recalc_threshold = settings.demand_recalc_threshold;
 	this->mod_dist = settings.demand_distance;
 	if (this->mod_dist > 100) {
 		/* Increase effect of mod_dist > 100 */
@@ -286,10 +509,18 @@ DemandCalculator::DemandCalculator(LinkGraphJob &job) :
 
 	switch (settings.GetDistributionType(cargo)) {
 		case DT_SYMMETRIC:
-			this->CalcDemand<SymmetricScaler>(job, SymmetricScaler(settings.demand_size));
+			if (job.Regions().IsEmpty()) {
+				this->CalcDemand<SymmetricScaler>(job, SymmetricScaler(settings.demand_size));
+			} else {
+				this->CalcRegionDemand<SymmetricScaler>(job, SymmetricScaler(settings.demand_size));
+			}
 			break;
 		case DT_ASYMMETRIC:
-			this->CalcDemand<AsymmetricScaler>(job, AsymmetricScaler());
+			if (job.Regions().IsEmpty()) {
+				this->CalcDemand<AsymmetricScaler>(job, AsymmetricScaler());
+			} else {
+				this->CalcRegionDemand<AsymmetricScaler>(job, AsymmetricScaler());
+			}
 			break;
 		default:
 			/* Nothing to do. */
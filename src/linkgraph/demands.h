@@ -17,9 +17,27 @@ private:
 	int32 max_distance; ///< Maximum distance possible on the map.
 	int32 mod_dist;     ///< Distance modifier, determines how much demands decrease with distance.
 	int32 accuracy;     ///< Accuracy of the calculation.
+	uint recalc_threshold;      ///< Change in percent beyond which cached demands of a node are recalculated.
+	SmallVector<bool, 16> recalc; ///< If the demands from and to each node have to be recalculated.
+
+	/**
+	 * Check if the demand between two nodes has to be recalculated or can be
+	 * taken from the cache.
+	 * @param from Supplying node.
+	 * @param to Receiving node.
+	 * @return If the demand has to be recalculated.
+	 */
+	inline bool IsRecalculated(NodeID from, NodeID to) const { return this->recalc[from] || this->recalc[to]; }
+
+	void MarkChangedNodes(LinkGraphJob &job);
+	void ApplyCachedDemands(LinkGraphJob &job);
+	uint BaseDemand(int32 supply, uint distance, uint &chance, uint max_chance) const;
 
 	template<class Tscaler>
 	void CalcDemand(LinkGraphJob &job, Tscaler scaler);
+
+	template<class Tscaler>
+	void CalcRegionDemand(LinkGraphJob &job, Tscaler scaler);
 };
 
 /**
@@ -29,10 +47,15 @@ class DemandHandler : public ComponentHandler {
 public:
 
 	/**
-	 * Call the demand calculator on the given component.
+	 * Call the demand calculator on the given component and cache the
+	 * resulting demands for the next job on the same link graph.
 	 * @param graph Component to calculate the demands for.
 	 */
-	virtual void Run(LinkGraphJob &job) const { DemandCalculator c(job); }
+	virtual void Run(LinkGraphJob &job) const
+	{
+		DemandCalculator c(job);
+		job.FillDemandCache();
+	}
 
 	/**
 	 * Virtual destructor has to be defined because of virtual Run().
@@ -46,20 +46,98 @@ void FlowMapper::Run(LinkGraphJob &job) const
 	for (NodeID node_id = 0; node_id < job.Size(); ++node_id) {
 		/* Remove local consumption shares marked as invalid. */
 		Node node = job[node_id];
-		FlowStatMap &flows = node.Flows();
-		flows.FinalizeLocalConsumption(node.Station());
-		if (this->scale) {
-			/* Scale by time the graph has been running without being compressed. */
-			uint runtime = job.JoinDate() - job.Settings().recalc_time - job.LastCompression();
-			for (FlowStatMap::iterator i = flows.begin(); i != flows.end(); ++i) {
-				i->second.ScaleToMonthly(runtime);
-			}
-		}
+		node.Flows().FinalizeLocalConsumption(node.Station());
+
 		/* Clear paths. */
 		PathList &paths = node.Paths();
 		for (PathList::iterator i = paths.begin(); i != paths.end(); ++i) {
-			delete *i;
+			job.Allocator().Free(*i);
 		}
 		paths.clear();
 	}
+
+	if (!this->scale) return;
+
+	if (!job.Regions().IsEmpty()) this->ForwardRegionExports(job);
+
+	/* Scale by time the graph has been running without being compressed. */
+	uint runtime = job.JoinDate() - job.Settings().recalc_time - job.LastCompression();
+	for (NodeID node_id = 0; node_id < job.Size(); ++node_id) {
+		FlowStatMap &flows = job[node_id].Flows();
+		for (FlowStatMap::iterator i = flows.begin(); i != flows.end(); ++i) {
+			i->second.ScaleToMonthly(runtime);
+		}
+	}
+}
+
+/**
+ * Forward the cargo nodes export to other regions at the hubs of their
+ * regions. The MCF only routes it to the hub, where it would be delivered.
+ * Instead the part of it that is exported is sent on like the hub's own
+ * cargo: the hub's flows are copied to the exporting nodes at each node they
+ * pass, scaled down to the exported amount.
+ * @param job Job calculated in regions.
+ */
+void FlowMapper::ForwardRegionExports(LinkGraphJob &job) const
+{
+	const RegionPartition &regions = job.Regions();
+	uint size = job.Size();
+
+	/* Find out how much of each node's cargo arrives at its hub to be
+	 * forwarded, and how much the hubs send out in total. */
+	SmallVector<uint, 16> forwarded;
+	SmallVector<uint, 16> hub_flows;
+	forwarded.Resize(size);
+	hub_flows.Resize(regions.NumRegions());
+	for (NodeID node_id = 0; node_id < size; ++node_id) forwarded[node_id] = 0;
+	for (uint region = 0; region < regions.NumRegions(); ++region) {
+		Node hub = job[regions.Hub(region)];
+		const FlowStatMap &flows = hub.Flows();
+		FlowStatMap::const_iterator own = flows.find(hub.Station());
+		hub_flows[region] = own == flows.end() ? 0 : own->second.GetShares()->rbegin()->first;
+		if (hub_flows[region] == 0) continue;
+
+		for (const NodeID *i = regions.Begin(region); i != regions.End(region); ++i) {
+			Node node = job[*i];
+			if (node.RegionExport() == 0) continue;
+			FlowStatMap::const_iterator it = flows.find(node.Station());
+			if (it == flows.end()) continue;
+			uint local = it->second.GetShare(hub.Station());
+			forwarded[*i] = (uint64)local * node.RegionExport() / node.DemandTo(regions.Hub(region)).Demand();
+		}
+	}
+
+	for (NodeID node_id = 0; node_id < size; ++node_id) {
+		FlowStatMap &flows = job[node_id].Flows();
+		for (uint region = 0; region < regions.NumRegions(); ++region) {
+			if (hub_flows[region] == 0) continue;
+			FlowStatMap::iterator it = flows.find(job[regions.Hub(region)].Station());
+			if (it == flows.end()) continue;
+
+			/* Copy the hub's flow as adding flows invalidates the iterator. */
+			FlowStat hub_flow = it->second;
+			for (const NodeID *i = regions.Begin(region); i != regions.End(region); ++i) {
+				if (forwarded[*i] == 0) continue;
+				StationID origin = job[*i].Station();
+				uint prev = 0;
+				for (FlowStat::SharesMap::const_iterator share = hub_flow.GetShares()->begin();
+						share != hub_flow.GetShares()->end(); ++share) {
+					uint64 flow = (uint64)(share->first - prev) * forwarded[*i] / hub_flows[region];
+					flows.AddFlow(origin, share->second, (uint)max<uint64>(flow, 1));
+					prev = share->first;
+				}
+			}
+		}
+	}
+
+	/* Only now remove the forwarded cargo from the hubs' local consumption,
+	 * so that the flows never become empty. */
+	for (uint region = 0; region < regions.NumRegions(); ++region) {
+		if (hub_flows[region] == 0) continue;
+		Node hub = job[regions.Hub(region)];
+		for (const NodeID *i = regions.Begin(region); i != regions.End(region); ++i) {
+			if (forwarded[*i] == 0) continue;
+			hub.Flows().find(job[*i].Station())->second.ChangeShare(hub.Station(), -(int)forwarded[*i]);
+		}
+	}
 }
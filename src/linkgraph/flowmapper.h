@@ -37,6 +37,7 @@ public:
 	 */
 	virtual ~FlowMapper() {}
 private:
+	void ForwardRegionExports(LinkGraphJob &job) const;
 
 	/**
 	 * Whether the flow mapper should scale all flows to monthly values.
@@ -11,7 +11,11 @@
 
 #include "../stdafx.h"
 #include "../core/pool_func.hpp"
+#include "../core/random_func.hpp"
+#include "../map_func.h"
 #include "linkgraph.h"
+#include <algorithm>
+#include <functional>
 
 /* Initialize the link-graph-pool */
 LinkGraphPool _link_graph_pool("LinkGraph");
@@ -19,14 +23,16 @@ INSTANTIATE_POOL_METHODS(LinkGraph)
 
 /**
  * Create a node or clear it.
+ * @param xy Location of the associated station.
  * @param st ID of the associated station.
  * @param demand Demand for cargo at the station.
  */
-inline void LinkGraph::BaseNode::Init(StationID st, uint demand)
+inline void LinkGraph::BaseNode::Init(TileIndex xy, StationID st, uint demand)
 {
 	this->supply = 0;
 	this->demand = demand;
 	this->station = st;
+	this->xy = xy;
 	this->last_update = INVALID_DATE;
 }
 
@@ -34,7 +40,7 @@ inline void LinkGraph::BaseNode::Init(StationID st, uint demand)
  * Create an edge.
  * @param distance Length of the link as manhattan distance.
  */
-inline void LinkGraph::BaseEdge::Init(uint distance)
+void LinkGraph::BaseEdge::Init(uint distance)
 {
 	this->distance = distance;
 	this->capacity = 0;
@@ -52,6 +58,7 @@ inline void LinkGraph::BaseEdge::Init(uint distance)
 void LinkGraph::ShiftDates(int interval)
 {
 	this->last_compression += interval;
+	this->expiry_dirty = true;
 	for (NodeID node1 = 0; node1 < this->Size(); ++node1) {
 		BaseNode &source = this->nodes[node1];
 		if (source.last_update != INVALID_DATE) source.last_update += interval;
@@ -109,6 +116,7 @@ void LinkGraph::Merge(LinkGraph *other)
 		new_start = other->edges[node1][node1];
 		if (new_start.next_edge != INVALID_NODE) new_start.next_edge += first;
 	}
+	this->expiry_dirty = true;
 	delete other;
 }
 
@@ -139,6 +147,7 @@ void LinkGraph::RemoveNode(NodeID id)
 	Station::Get(this->nodes[last_node].station)->goods[this->cargo].node = id;
 	this->nodes.Erase(this->nodes.Get(id));
 	this->edges.EraseColumn(id);
+	this->expiry_dirty = true;
 	/* Not doing EraseRow here, as having the extra invalid row doesn't hurt
 	 * and removing it would trigger a lot of memmove. The data has already
 	 * been copied around in the loop above. */
@@ -152,6 +161,8 @@ void LinkGraph::RemoveNode(NodeID id)
 void LinkGraph::UpdateDistances(NodeID id, TileIndex xy)
 {
 	assert(id < this->Size());
+	this->nodes[id].xy = xy;
+	this->expiry_dirty = true;
 	for (NodeID other = 0; other < this->Size(); ++other) {
 		if (other == id) continue;
 		this->edges[id][other].distance = this->edges[other][id].distance =
@@ -178,7 +189,7 @@ NodeID LinkGraph::AddNode(const Station *st)
 	this->edges.Resize(new_node + 1U,
 			max(new_node + 1U, this->edges.Height()));
 
-	this->nodes[new_node].Init(st->index,
+	this->nodes[new_node].Init(st->xy, st->index,
 			HasBit(good.acceptance_pickup, GoodsEntry::GES_ACCEPTANCE));
 
 	BaseEdge *new_edges = this->edges[new_node];
@@ -194,6 +205,97 @@ NodeID LinkGraph::AddNode(const Station *st)
 	return new_node;
 }
 
+/**
+ * Get the number of days a link between two stations may go without being
+ * refreshed before it times out.
+ * @param from Location of the link's source station.
+ * @param to Location of the link's destination station.
+ * @return Timeout in days.
+ */
+/* static */ uint LinkGraph::Timeout(TileIndex from, TileIndex to)
+{
+	return MIN_TIMEOUT_DISTANCE + (DistanceManhattan(from, to) >> 3);
+}
+
+/**
+ * Get the first date at which any outgoing link of a node is timed out, either
+ * completely or only in its restricted or unrestricted part.
+ * @param node Node to check.
+ * @return Expiry date or INT32_MAX if the node has no outgoing links.
+ */
+Date LinkGraph::NextExpiry(NodeID node) const
+{
+	Date expiry = INT32_MAX;
+	TileIndex from = Station::Get(this->nodes[node].station)->xy;
+	const BaseEdge *node_edges = this->edges[node];
+	for (NodeID to = node_edges[node].next_edge; to != INVALID_NODE; to = node_edges[to].next_edge) {
+		const BaseEdge &edge = node_edges[to];
+		Date last = max(edge.last_unrestricted_update, edge.last_restricted_update);
+		if (edge.last_unrestricted_update != INVALID_DATE) last = min(last, edge.last_unrestricted_update);
+		if (edge.last_restricted_update != INVALID_DATE) last = min(last, edge.last_restricted_update);
+		uint timeout = LinkGraph::Timeout(from, Station::Get(this->nodes[to].station)->xy);
+		expiry = min(expiry, last + (Date)timeout + 1);
+	}
+	return expiry;
+}
+
+/**
+ * Queue a node to be checked for timed out links at its next expiry date.
+ * This has to be called whenever a link is added to the node.
+ * @param node Node to be queued.
+ */
+void LinkGraph::ScheduleExpiry(NodeID node)
+{
+	if (this->expiry_dirty) return;
+	Date expiry = this->NextExpiry(node);
+	if (expiry == INT32_MAX) return;
+	ExpiryEntry *entry = this->expiry_queue.Append();
+	entry->date = expiry;
+	entry->node = node;
+	std::push_heap(this->expiry_queue.Begin(), this->expiry_queue.End(), std::greater<ExpiryEntry>());
+
+	/* Links updated before their expiry leave outdated entries behind. Get
+	 * rid of them once they dominate the queue. */
+	if (this->expiry_queue.Length() > 4 * this->Size() + 16) this->expiry_dirty = true;
+}
+
+/**
+ * Take all nodes with timed out links from the expiry queue. The queue is
+ * rebuilt first if necessary. The result only depends on the links, not on the
+ * history of the queue, so that it's the same for all clients in a network game.
+ * The caller is expected to reschedule the nodes after checking them.
+ * @param expired Output vector for the expired nodes, sorted by ID.
+ */
+void LinkGraph::PopExpiredNodes(SmallVector<NodeID, 16> &expired)
+{
+	std::greater<ExpiryEntry> later;
+	expired.Clear();
+	if (this->expiry_dirty) {
+		this->expiry_dirty = false;
+		this->expiry_queue.Clear();
+		for (NodeID node = 0; node < this->Size(); ++node) this->ScheduleExpiry(node);
+	}
+
+	while (this->expiry_queue.Length() > 0 && this->expiry_queue.Begin()->date <= _date) {
+		*expired.Append() = this->expiry_queue.Begin()->node;
+		std::pop_heap(this->expiry_queue.Begin(), this->expiry_queue.End(), later);
+		this->expiry_queue.Resize(this->expiry_queue.Length() - 1);
+	}
+	std::sort(expired.Begin(), expired.End());
+	NodeID *end = std::unique(expired.Begin(), expired.End());
+
+	/* Entries may have been too early. Requeue those nodes with their actual date. */
+	NodeID *last = expired.Begin();
+	for (NodeID *it = expired.Begin(); it != end; ++it) {
+		if (this->NextExpiry(*it) <= _date) {
+			*last++ = *it;
+		} else {
+			this->ScheduleExpiry(*it);
+		}
+	}
+	expired.Resize(last - expired.Begin());
+}
+
 /**
  * Fill an edge with values from a link. If usage < capacity set the usage,
  * otherwise set the restricted or unrestricted update timestamp.
@@ -315,3 +417,41 @@ void LinkGraph::Init(uint size)
 		for (uint j = 0; j < size; ++j) column[j].Init();
 	}
 }
+
+/**
+ * Fill an empty link graph with a random network, for benchmarking the link
+ * graph calculation. The nodes are placed randomly on the map and are linked
+ * in a ring, so that the graph is connected, plus some random shortcuts. The
+ * nodes don't refer to actual stations, they just get their own IDs as
+ * station IDs.
+ * @param size Number of nodes, at least 2.
+ * @param links Number of random links from each node to other nodes.
+ * @param seed Seed for the random numbers.
+ */
+void LinkGraph::InitSynthetic(uint size, uint links, uint32 seed)
+{
+	assert(size >= 2);
+	this->Init(size);
+
+	Randomizer random;
+	random.SetSeed(seed);
+	for (NodeID node = 0; node < size; ++node) {
+		BaseNode &base = this->nodes[node];
+		base.Init(TileXY(random.Next(MapMaxX()), random.Next(MapMaxY())), node, random.Next(4) != 0);
+		base.supply = random.Next(1000);
+	}
+	for (NodeID from = 0; from < size; ++from) {
+		for (NodeID to = 0; to < size; ++to) {
+			this->edges[from][to].Init(DistanceManhattan(this->nodes[from].xy, this->nodes[to].xy));
+		}
+	}
+	for (NodeID from = 0; from < size; ++from) {
+		Node node = (*this)[from];
+		for (uint i = 0; i <= links; ++i) {
+			NodeID to = i == 0 ? (from + 1) % size : random.Next(size);
+			if (to == from) continue;
+			uint capacity = 1 + random.Next(500);
+			node.UpdateEdge(to, capacity, random.Next(capacity + 1));
+		}
+	}
+}
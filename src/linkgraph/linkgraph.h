@@ -65,8 +65,9 @@ public:
 		uint supply;             ///< Supply at the station.
 		uint demand;             ///< Acceptance at the station.
 		StationID station;       ///< Station ID.
+		TileIndex xy;            ///< Location of the station referred to by the node.
 		Date last_update;        ///< When the supply was last updated.
-		void Init(StationID st = INVALID_STATION, uint demand = 0);
+		void Init(TileIndex xy = INVALID_TILE, StationID st = INVALID_STATION, uint demand = 0);
 	};
 
 	/**
@@ -180,6 +181,12 @@ public:
 		 */
 		StationID Station() const { return this->node.station; }
 
+		/**
+		 * Get the location of the station associated with the node.
+		 * @return Location of the station.
+		 */
+		TileIndex XY() const { return this->node.xy; }
+
 		/**
 		 * Get node's last update.
 		 * @return Last update.
@@ -445,6 +452,64 @@ public:
 	typedef SmallVector<BaseNode, 16> NodeVector;
 	typedef SmallMatrix<BaseEdge> EdgeMatrix;
 
+	/**
+	 * Demands calculated by the last job run on a link graph, together with
+	 * the nodes and settings they were calculated from. The next job can then
+	 * reuse the demands between nodes which haven't changed since. The
+	 * demands are packed into compressed sparse rows: the demands from node n
+	 * are found at [offsets[n], offsets[n + 1]) in targets and amounts.
+	 */
+	struct DemandCache {
+		NodeVector nodes;                ///< Nodes as seen by the demand calculation.
+		Date runtime;                    ///< Number of days the supplies of the nodes had been collected for.
+		DistributionTypeByte distribution; ///< Distribution type the demands were calculated for.
+		uint8 accuracy;                  ///< Accuracy the demands were calculated with.
+		uint8 demand_size;               ///< Supply modifier the demands were calculated with.
+		uint8 demand_distance;           ///< Distance modifier the demands were calculated with.
+		SmallVector<uint, 16> offsets;   ///< Index of the first demand from each node, plus the total number of demands.
+		SmallVector<NodeID, 16> targets; ///< Remote ends of the demands.
+		SmallVector<uint, 16> amounts;   ///< Amounts of the demands.
+
+		DemandCache() : runtime(0), accuracy(0), demand_size(0), demand_distance(0)
+		{
+			this->distribution = DT_MANUAL;
+		}
+
+		/**
+		 * Drop all cached demands.
+		 */
+		void Clear()
+		{
+			this->nodes.Clear();
+			this->offsets.Clear();
+			this->targets.Clear();
+			this->amounts.Clear();
+		}
+
+		/**
+		 * Exchange the cached demands with another cache without copying them.
+		 * @param other Cache to exchange the demands with.
+		 */
+		void Swap(DemandCache &other)
+		{
+			this->nodes.Swap(other.nodes);
+			::Swap(this->runtime, other.runtime);
+			::Swap(this->distribution, other.distribution);
+			::Swap(this->accuracy, other.accuracy);
+			::Swap(this->demand_size, other.demand_size);
+			::Swap(this->demand_distance, other.demand_distance);
+			this->offsets.Swap(other.offsets);
+			this->targets.Swap(other.targets);
+			this->amounts.Swap(other.amounts);
+		}
+
+		/**
+		 * Check if there are any cached demands.
+		 * @return If the cache is empty.
+		 */
+		inline bool IsEmpty() const { return this->nodes.Length() == 0; }
+	};
+
 	/** Minimum effective distance for timeout calculation. */
 	static const uint MIN_TIMEOUT_DISTANCE = 32;
 
@@ -465,14 +530,15 @@ public:
 	}
 
 	/** Bare constructor, only for save/load. */
-	LinkGraph() : cargo(INVALID_CARGO), last_compression(0) {}
+	LinkGraph() : cargo(INVALID_CARGO), last_compression(0), expiry_dirty(true) {}
 	/**
 	 * Real constructor.
 	 * @param cargo Cargo the link graph is about.
 	 */
-	LinkGraph(CargoID cargo) : cargo(cargo), last_compression(_date) {}
+	LinkGraph(CargoID cargo) : cargo(cargo), last_compression(_date), expiry_dirty(true) {}
 
 	void Init(uint size);
+	void InitSynthetic(uint size, uint links, uint32 seed);
 	void ShiftDates(int interval);
 	void Compress();
 	void Merge(LinkGraph *other);
@@ -531,9 +597,31 @@ public:
 	void RemoveNode(NodeID id);
 	void UpdateDistances(NodeID id, TileIndex xy);
 
+	static uint Timeout(TileIndex from, TileIndex to);
+	Date NextExpiry(NodeID node) const;
+	void ScheduleExpiry(NodeID node);
+	void PopExpiredNodes(SmallVector<NodeID, 16> &expired);
+
 protected:
+	/** Entry of the expiry queue. */
+	struct ExpiryEntry {
+		Date date;   ///< Date at which links of the node may time out.
+		NodeID node; ///< Node to be checked.
+
+		/**
+		 * Compare two entries by date and node, for keeping the earliest one at the top of the heap.
+		 * @param other Entry to compare with.
+		 * @return If this entry is due later than the other one.
+		 */
+		inline bool operator>(const ExpiryEntry &other) const
+		{
+			return this->date != other.date ? this->date > other.date : this->node > other.node;
+		}
+	};
+
 	friend class LinkGraph::ConstNode;
 	friend class LinkGraph::Node;
+	friend class LinkGraphJob;
 	friend const SaveLoad *GetLinkGraphDesc();
 	friend const SaveLoad *GetLinkGraphJobDesc();
 	friend void SaveLoad_LinkGraph(LinkGraph &lg);
@@ -542,6 +630,15 @@ protected:
 	Date last_compression; ///< Last time the capacities and supplies were compressed.
 	NodeVector nodes;      ///< Nodes in the component.
 	EdgeMatrix edges;      ///< Edges in the component.
+	DemandCache demand_cache; ///< Demands calculated by the last job on the component.
+
+	/**
+	 * Min-heap of the dates at which links of the nodes may time out. The
+	 * dates may be too early, but never too late. There may be several
+	 * entries for the same node. Not saved, it's rebuilt after loading.
+	 */
+	SmallVector<ExpiryEntry, 16> expiry_queue;
+	bool expiry_dirty;     ///< If the expiry queue has to be rebuilt before it can be used.
 };
 
 #define FOR_ALL_LINK_GRAPHS(var) FOR_ALL_ITEMS_FROM(LinkGraph, link_graph_index, var, 0)
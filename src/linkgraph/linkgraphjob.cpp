@@ -12,6 +12,7 @@
 #include "../stdafx.h"
 #include "../core/pool_func.hpp"
 #include "../window_func.h"
+#include "../cpu.h"
 #include "linkgraphjob.h"
 #include "linkgraphschedule.h"
 
@@ -22,17 +23,40 @@ INSTANTIATE_POOL_METHODS(LinkGraphJob)
 /**
  * Create a link graph job from a link graph. The link graph will be copied so
  * that the calculations don't interfer with the normal operations on the
- * original. The job is immediately started.
+ * original. Only the edges with capacity are copied, packed into compressed
+ * sparse rows sorted by their remote ends. The job is immediately started.
  * @param orig Original LinkGraph to be copied.
  */
 LinkGraphJob::LinkGraphJob(const LinkGraph &orig) :
-		/* Copying the link graph here also copies its index member.
-		 * This is on purpose. */
-		link_graph(orig),
+		link_graph_index(orig.index),
+		cargo(orig.cargo),
+		last_compression(orig.last_compression),
+		demand_cache(orig.demand_cache),
 		settings(_settings_game.linkgraph),
-		thread(NULL),
-		join_date(_date + _settings_game.linkgraph.recalc_time)
+		task(NULL),
+		spawn_date(_date),
+		join_date(_date + _settings_game.linkgraph.recalc_time),
+		join_delay(0),
+		merged_nodes(0),
+		joined(false)
 {
+	uint size = orig.Size();
+	this->graph_nodes.Assign(orig.nodes);
+	this->edge_offsets.Resize(size + 1);
+	for (NodeID from = 0; from < size; ++from) {
+		uint first = this->edge_targets.Length();
+		this->edge_offsets[from] = first;
+		const LinkGraph::BaseEdge *orig_edges = orig.edges[from];
+		for (NodeID to = orig_edges[from].next_edge; to != INVALID_NODE; to = orig_edges[to].next_edge) {
+			*this->edge_targets.Append() = to;
+		}
+		std::sort(this->edge_targets.Begin() + first, this->edge_targets.End());
+		for (uint i = first; i < this->edge_targets.Length(); ++i) {
+			*this->graph_edges.Append() = orig_edges[this->edge_targets[i]];
+		}
+	}
+	this->edge_offsets[size] = this->edge_targets.Length();
+	MemSetT(&this->timings, 0);
 }
 
 /**
@@ -47,13 +71,37 @@ void LinkGraphJob::EraseFlows(NodeID from)
 }
 
 /**
- * Spawn a thread if possible and run the link graph job in the thread. If
- * that's not possible run the job right now in the current thread.
+ * Task running a link graph job in one of the link graph worker threads.
+ */
+class LinkGraphJobTask : public ThreadPoolTask {
+private:
+	LinkGraphJob *job; ///< Job to be run.
+
+public:
+	/**
+	 * Create a task for a job.
+	 * @param job Job to be run.
+	 */
+	LinkGraphJobTask(LinkGraphJob *job) : job(job) {}
+
+	virtual void Run() { LinkGraphSchedule::Run(this->job); }
+};
+
+/**
+ * Queue the link graph job in the schedule's worker threads. If there are no
+ * worker threads run the job right now in the current thread.
  */
 void LinkGraphJob::SpawnThread()
 {
-	if (!ThreadObject::New(&(LinkGraphSchedule::Run), this, &this->thread)) {
-		this->thread = NULL;
+	this->timings.link_graph = this->link_graph_index;
+	this->timings.cargo = this->cargo;
+	this->timings.nodes = this->Size();
+	this->timings.edges = this->edge_targets.Length();
+	this->timings.spawn_date = this->spawn_date;
+	this->timings.spawned = ottd_rdtsc();
+
+	ThreadPool &workers = LinkGraphSchedule::Instance()->Workers();
+	if (workers.NumThreads() == 0) {
 		/* Of course this will hang a bit.
 		 * On the other hand, if you want to play games which make this hang noticably
 		 * on a platform without threads then you'll probably get other problems first.
@@ -62,18 +110,38 @@ void LinkGraphJob::SpawnThread()
 		 * smaller grained "Step" method for all handlers and add some more ticks where
 		 * "Step" is called. No problem in principle. */
 		LinkGraphSchedule::Run(this);
+		return;
 	}
+
+	this->task = new LinkGraphJobTask(this);
+	workers.Enqueue(this->task);
 }
 
 /**
- * Join the calling thread with this job's thread if threading is enabled.
+ * Wait for the job to be finished by the worker threads. If no worker has
+ * picked it up, yet, it is run in the calling thread.
  */
 void LinkGraphJob::JoinThread()
 {
-	if (this->thread != NULL) {
-		this->thread->Join();
-		delete this->thread;
-		this->thread = NULL;
+	if (this->task != NULL) {
+		LinkGraphSchedule::Instance()->Workers().Wait(this->task);
+		delete this->task;
+		this->task = NULL;
+	}
+}
+
+/**
+ * Remove the job from the worker threads' queue without running it, or wait
+ * for it to finish if a worker is already running it. Only use this if the
+ * result of the job is going to be discarded.
+ */
+void LinkGraphJob::AbortThread()
+{
+	if (this->task != NULL) {
+		ThreadPool &workers = LinkGraphSchedule::Instance()->Workers();
+		if (!workers.Dequeue(this->task)) workers.Wait(this->task);
+		delete this->task;
+		this->task = NULL;
 	}
 }
 
@@ -83,16 +151,68 @@ void LinkGraphJob::JoinThread()
 LinkGraphJob::~LinkGraphJob()
 {
 	this->JoinThread();
+}
 
-	/* Don't update stuff from other pools, when everything is being removed.
-	 * Accessing other pools may be invalid. */
-	if (CleaningPool()) return;
+/**
+ * Check if the calculation of the job has been completed, without waiting
+ * for it. The result depends on the speed of the local machine, so it must
+ * not influence the game state directly.
+ * @return If the handlers have been run completely.
+ */
+bool LinkGraphJob::IsCalculated() const
+{
+	return this->task == NULL || this->task->IsFinished();
+}
 
-	/* Link graph has been merged into another one. */
-	if (!LinkGraph::IsValidID(this->link_graph.index)) return;
+/**
+ * Join the job, waiting for it if it isn't finished, and store the demands
+ * cached by the demand handler in the link graph. Afterwards the results are
+ * ready to be merged and the demand annotations are freed, as they aren't
+ * saved either.
+ */
+void LinkGraphJob::Join()
+{
+	this->JoinThread();
+
+	/* Link graph has been merged into another one otherwise. */
+	if (LinkGraph::IsValidID(this->link_graph_index)) {
+		LinkGraph *lg = LinkGraph::Get(this->link_graph_index);
+		if (this->CachesDemands()) {
+			lg->demand_cache.Swap(this->result_cache);
+		} else {
+			lg->demand_cache.Clear();
+		}
+	}
+	this->result_cache.Clear();
+
+	this->demands.Reset();
+	this->joined = true;
+}
+
+/**
+ * Merge the flows calculated by the job into the stations. The merge can be
+ * spread over several calls, each of them merging the next nodes in order.
+ * The job has to be joined before, so merging never waits for the workers.
+ * @param max_nodes Maximum number of nodes to be merged, 0 for all remaining ones.
+ * @return Number of nodes merged.
+ */
+uint LinkGraphJob::Merge(uint max_nodes)
+{
+	assert(this->joined);
 
 	uint size = this->Size();
-	for (NodeID node_id = 0; node_id < size; ++node_id) {
+	uint end = (max_nodes == 0) ? size : min(size, this->merged_nodes + max_nodes);
+	uint begin = this->merged_nodes;
+
+	/* Link graph has been merged into another one. */
+	if (!LinkGraph::IsValidID(this->link_graph_index)) {
+		this->merged_nodes = size;
+		return 0;
+	}
+
+	LinkGraph *lg = LinkGraph::Get(this->link_graph_index);
+
+	for (NodeID node_id = begin; node_id < end; ++node_id) {
 		Node from = (*this)[node_id];
 
 		/* The station can have been deleted. Remove all flows originating from it then. */
@@ -105,19 +225,18 @@ LinkGraphJob::~LinkGraphJob()
 		/* Link graph merging and station deletion may change around IDs. Make
 		 * sure that everything is still consistent or ignore it otherwise. */
 		GoodsEntry &ge = st->goods[this->Cargo()];
-		if (ge.link_graph != this->link_graph.index || ge.node != node_id) {
+		if (ge.link_graph != this->link_graph_index || ge.node != node_id) {
 			this->EraseFlows(node_id);
 			continue;
 		}
 
-		LinkGraph *lg = LinkGraph::Get(ge.link_graph);
 		FlowStatMap &flows = from.Flows();
 
 		for (EdgeIterator it(from.Begin()); it != from.End(); ++it) {
-			if (from[it->first].Flow() == 0) continue;
+			if (it->second.Flow() == 0) continue;
 			StationID to = (*this)[it->first].Station();
 			Station *st2 = Station::GetIfValid(to);
-			if (st2 == NULL || st2->goods[this->Cargo()].link_graph != this->link_graph.index ||
+			if (st2 == NULL || st2->goods[this->Cargo()].link_graph != this->link_graph_index ||
 					st2->goods[this->Cargo()].node != it->first ||
 					(*lg)[node_id][it->first].LastUpdate() == INVALID_DATE) {
 				/* Edge has been removed. Delete flows. */
@@ -145,7 +264,7 @@ LinkGraphJob::~LinkGraphJob()
 				} else {
 					FlowStat shares(INVALID_STATION, 1);
 					it->second.SwapShares(shares);
-					ge.flows.erase(it++);
+					it = ge.flows.erase(it);
 					for (FlowStat::SharesMap::const_iterator shares_it(shares.GetShares()->begin());
 							shares_it != shares.GetShares()->end(); ++shares_it) {
 						RerouteCargo(st, this->Cargo(), shares_it->second, st->index);
@@ -160,25 +279,71 @@ LinkGraphJob::~LinkGraphJob()
 		ge.flows.insert(flows.begin(), flows.end());
 		InvalidateWindowData(WC_STATION_VIEW, st->index, this->Cargo());
 	}
+
+	this->merged_nodes = end;
+	return end - begin;
+}
+
+/**
+ * Store the demands calculated by the job, together with the nodes and
+ * settings they were calculated from, so that the next job on the same link
+ * graph only has to recalculate the demands of nodes that have changed. This
+ * is called by the demand handler in the job's thread, so that joining the
+ * job only has to swap the result into the link graph.
+ */
+void LinkGraphJob::FillDemandCache()
+{
+	LinkGraph::DemandCache &cache = this->result_cache;
+	cache.Clear();
+	if (!this->CachesDemands()) return;
+
+	uint size = this->Size();
+	cache.nodes.Assign(this->graph_nodes);
+	cache.runtime = this->SupplyRuntime();
+	cache.distribution = this->settings.GetDistributionType(this->cargo);
+	cache.accuracy = this->settings.accuracy;
+	cache.demand_size = this->settings.demand_size;
+	cache.demand_distance = this->settings.demand_distance;
+	cache.offsets.Resize(size + 1);
+	for (NodeID from = 0; from < size; ++from) {
+		cache.offsets[from] = cache.targets.Length();
+		const DemandAnnotation *node_demands = this->demands[from];
+		for (NodeID to = 0; to < size; ++to) {
+			if (node_demands[to].demand == 0) continue;
+			*cache.targets.Append() = to;
+			*cache.amounts.Append() = node_demands[to].demand;
+		}
+	}
+	cache.offsets[size] = cache.targets.Length();
 }
 
 /**
- * Initialize the link graph job: Resize nodes and edges and populate them.
- * This is done after the constructor so that we can do it in the calculation
- * thread without delaying the main game.
+ * Initialize the link graph job: Resize node, edge and demand annotations and
+ * populate them, and split very large components into regions. This is done
+ * after the constructor so that we can do it in the calculation thread without
+ * delaying the main game.
  */
 void LinkGraphJob::Init()
 {
 	uint size = this->Size();
 	this->nodes.Resize(size);
-	this->edges.Resize(size, size);
+	this->demands.Resize(size, size);
 	for (uint i = 0; i < size; ++i) {
-		this->nodes[i].Init(this->link_graph[i].Supply());
-		EdgeAnnotation *node_edges = this->edges[i];
+		this->nodes[i].Init(this->graph_nodes[i].supply);
+		DemandAnnotation *node_demands = this->demands[i];
 		for (uint j = 0; j < size; ++j) {
-			node_edges[j].Init();
+			node_demands[j].Init();
 		}
 	}
+
+	uint num_edges = this->NumEdges();
+	this->edges.Resize(num_edges);
+	for (uint i = 0; i < num_edges; ++i) {
+		this->edges[i].Init();
+	}
+
+	uint threshold = this->settings.hierarchical_threshold;
+	if (threshold != 0 && size > threshold) this->regions.Build(*this, this->settings.region_size);
 }
 
 /**
@@ -186,8 +351,15 @@ void LinkGraphJob::Init()
  */
 void LinkGraphJob::EdgeAnnotation::Init()
 {
-	this->demand = 0;
 	this->flow = 0;
+}
+
+/**
+ * Initialize the demand between two nodes.
+ */
+void LinkGraphJob::DemandAnnotation::Init()
+{
+	this->demand = 0;
 	this->unsatisfied_demand = 0;
 }
 
@@ -199,6 +371,7 @@ void LinkGraphJob::EdgeAnnotation::Init()
 void LinkGraphJob::NodeAnnotation::Init(uint supply)
 {
 	this->undelivered_supply = supply;
+	this->region_export = 0;
 	new (&this->flows) FlowStatMap;
 	new (&this->paths) PathList;
 }
@@ -268,3 +441,63 @@ Path::Path(NodeID n, bool source) :
 	num_children(0), parent(NULL)
 {}
 
+/**
+ * Create a path allocator without any memory.
+ */
+PathAllocator::PathAllocator() : mutex(ThreadMutex::New()), num_allocations(0)
+{
+}
+
+/**
+ * Release all memory of the path allocator. Paths still using it become
+ * invalid.
+ */
+PathAllocator::~PathAllocator()
+{
+	for (Path **block = this->blocks.Begin(); block != this->blocks.End(); ++block) {
+		free(*block);
+	}
+	delete this->mutex;
+}
+
+/**
+ * Get memory for a number of paths. The memory is uninitialized and has to be
+ * constructed with placement new.
+ * @param count Number of paths to allocate.
+ * @param slots Array to be filled with count pointers to memory for a path.
+ */
+void PathAllocator::Allocate(uint count, Path **slots)
+{
+	ThreadMutexLocker lock(this->mutex);
+	while (this->free_slots.Length() < count) {
+		Path *block = MallocT<Path>(BLOCK_SIZE);
+		*this->blocks.Append() = block;
+		Path **new_slots = this->free_slots.Append(BLOCK_SIZE);
+		for (uint i = 0; i < BLOCK_SIZE; ++i) new_slots[i] = block + i;
+	}
+	this->num_allocations += count;
+	uint remaining = this->free_slots.Length() - count;
+	MemCpyT(slots, this->free_slots.Begin() + remaining, count);
+	this->free_slots.Resize(remaining);
+}
+
+/**
+ * Destroy a path and give its memory back to the allocator.
+ * @param path Path to be freed.
+ */
+void PathAllocator::Free(Path *path)
+{
+	path->~Path();
+	ThreadMutexLocker lock(this->mutex);
+	*this->free_slots.Append() = path;
+}
+
+/**
+ * Get the memory reserved for paths. As blocks are never released before the
+ * allocator is destroyed this is also the peak memory used for paths.
+ * @return Memory usage in bytes.
+ */
+size_t PathAllocator::GetMemoryUsage() const
+{
+	return this->blocks.Length() * BLOCK_SIZE * sizeof(Path);
+}
@@ -12,14 +12,47 @@
 #ifndef LINKGRAPHJOB_H
 #define LINKGRAPHJOB_H
 
-#include "../thread/thread.h"
+#include "../thread/thread_pool.h"
 #include "linkgraph.h"
+#include "linkgraphschedule.h"
+#include "regions.h"
 #include <list>
+#include <algorithm>
 
 class LinkGraphJob;
 class Path;
 typedef std::list<Path *> PathList;
 
+/**
+ * Allocator for the paths of a link graph job. Memory for paths is taken from
+ * large blocks and recycled through a free list instead of being allocated
+ * and freed one path at a time. The blocks are only released together with
+ * the allocator.
+ */
+class PathAllocator {
+public:
+	PathAllocator();
+	~PathAllocator();
+
+	void Allocate(uint count, Path **slots);
+	void Free(Path *path);
+	size_t GetMemoryUsage() const;
+
+	/**
+	 * Get the number of paths allocated so far.
+	 * @return Number of allocations.
+	 */
+	inline uint GetNumAllocations() const { return this->num_allocations; }
+
+private:
+	static const uint BLOCK_SIZE = 1024; ///< Number of paths allocated at once.
+
+	ThreadMutex *mutex;                  ///< Mutex guarding the free list, as paths are allocated in multiple threads.
+	SmallVector<Path *, 16> blocks;      ///< Memory blocks the paths are taken from.
+	SmallVector<Path *, 64> free_slots;  ///< Memory for paths which are currently unused.
+	uint num_allocations;                ///< Number of paths allocated so far.
+};
+
 /** Type of the pool for link graph jobs. */
 typedef Pool<LinkGraphJob, LinkGraphJobID, 32, 0xFFFF> LinkGraphJobPool;
 /** The actual pool with link graph jobs. */
@@ -34,39 +67,79 @@ private:
 	 * Annotation for a link graph edge.
 	 */
 	struct EdgeAnnotation {
-		uint demand;             ///< Transport demand between the nodes.
-		uint unsatisfied_demand; ///< Demand over this edge that hasn't been satisfied yet.
 		uint flow;               ///< Planned flow over this edge.
 		void Init();
 	};
 
+	/**
+	 * Annotation for a pair of nodes, regardless of them being connected by
+	 * an edge or not.
+	 */
+	struct DemandAnnotation {
+		uint demand;             ///< Transport demand between the nodes.
+		uint unsatisfied_demand; ///< Demand between the nodes that hasn't been satisfied yet.
+		void Init();
+	};
+
 	/**
 	 * Annotation for a link graph node.
 	 */
 	struct NodeAnnotation {
 		uint undelivered_supply; ///< Amount of supply that hasn't been distributed yet.
+		uint region_export;      ///< Part of the demand to the node's region hub which is to be forwarded to other regions.
 		PathList paths;          ///< Paths through this node, sorted so that those with flow == 0 are in the back.
 		FlowStatMap flows;       ///< Planned flows to other nodes.
 		void Init(uint supply);
 	};
 
 	typedef SmallVector<NodeAnnotation, 16> NodeAnnotationVector;
-	typedef SmallMatrix<EdgeAnnotation> EdgeAnnotationMatrix;
+	typedef SmallVector<EdgeAnnotation, 16> EdgeAnnotationVector;
+	typedef SmallMatrix<DemandAnnotation> DemandAnnotationMatrix;
+	typedef SmallVector<uint, 16> EdgeOffsetVector;
+	typedef SmallVector<NodeID, 16> EdgeTargetVector;
+	typedef SmallVector<LinkGraph::BaseEdge, 16> EdgeVector;
 
 	friend const SaveLoad *GetLinkGraphJobDesc();
+	friend void SaveLinkGraphJobGraph(LinkGraphJob &lgj);
+	friend void LoadLinkGraphJobGraph(LinkGraphJob &lgj);
 	friend class LinkGraphSchedule;
 
 protected:
-	const LinkGraph link_graph;       ///< Link graph to by analyzed. Is copied when job is started and mustn't be modified later.
+	/* The link graph to be analyzed is copied when the job is started and
+	 * mustn't be modified later. Only the nodes are copied as they are. The
+	 * edges are packed into compressed sparse rows: the outgoing edges of node
+	 * n are found at [edge_offsets[n], edge_offsets[n + 1]) in edge_targets,
+	 * graph_edges and edges, sorted by their remote ends. */
+	LinkGraphID link_graph_index;     ///< ID of the link graph the job was spawned from.
+	CargoID cargo;                    ///< Cargo of the link graph.
+	Date last_compression;            ///< Last compression of the link graph at spawn time.
+	LinkGraph::NodeVector graph_nodes; ///< Nodes of the link graph.
+	LinkGraph::DemandCache demand_cache; ///< Demands calculated by the previous job on the link graph.
+	LinkGraph::DemandCache result_cache; ///< Demands calculated by this job, to be stored in the link graph when joining. Not saved.
+	EdgeOffsetVector edge_offsets;    ///< Index of the first outgoing edge of each node, plus the total number of edges.
+	EdgeTargetVector edge_targets;    ///< Remote ends of the edges.
+	EdgeVector graph_edges;           ///< Edges of the link graph.
+
 	const LinkGraphSettings settings; ///< Copy of _settings_game.linkgraph at spawn time.
-	ThreadObject *thread;             ///< Thread the job is running in or NULL if it's running in the main thread.
+	ThreadPoolTask *task;             ///< Task running the job in the worker threads or NULL if it's run in the main thread.
+	Date spawn_date;                  ///< Date when the job was spawned. Unlike join_date it never changes while the job runs.
 	Date join_date;                   ///< Date when the job is to be joined.
+	uint16 join_delay;                ///< Number of days the join date has been postponed by.
+	NodeID merged_nodes;              ///< Number of nodes whose flows have already been merged into the stations.
+	bool joined;                      ///< If the calculation has been joined and the results are ready to be merged.
 	NodeAnnotationVector nodes;       ///< Extra node data necessary for link graph calculation.
-	EdgeAnnotationMatrix edges;       ///< Extra edge data necessary for link graph calculation.
+	EdgeAnnotationVector edges;       ///< Extra edge data necessary for link graph calculation, parallel to graph_edges.
+	DemandAnnotationMatrix demands;   ///< Demands between all pairs of nodes.
+	PathAllocator path_allocator;     ///< Allocator for the paths found by the calculation.
+	RegionPartition regions;          ///< Regions of the nodes if the job is calculated hierarchically.
+	LinkGraphSchedule::JobTimings timings; ///< Measurements of the job.
 
 	void EraseFlows(NodeID from);
 	void JoinThread();
+	void Join();
 	void SpawnThread();
+	void AbortThread();
+	uint Merge(uint max_nodes);
 
 public:
 
@@ -86,18 +159,6 @@ public:
 		Edge(const LinkGraph::BaseEdge &edge, EdgeAnnotation &anno) :
 				LinkGraph::ConstEdge(edge), anno(anno) {}
 
-		/**
-		 * Get the transport demand between end the points of the edge.
-		 * @return Demand.
-		 */
-		uint Demand() const { return this->anno.demand; }
-
-		/**
-		 * Get the transport demand that hasn't been satisfied by flows, yet.
-		 * @return Unsatisfied demand.
-		 */
-		uint UnsatisfiedDemand() const { return this->anno.unsatisfied_demand; }
-
 		/**
 		 * Get the total flow on the edge.
 		 * @return Flow.
@@ -119,6 +180,33 @@ public:
 			assert(flow <= this->anno.flow);
 			this->anno.flow -= flow;
 		}
+	};
+
+	/**
+	 * Demand between two nodes of a job. Wraps a demand annotation. The nodes
+	 * don't have to be connected by an edge.
+	 */
+	class DemandEdge {
+	private:
+		DemandAnnotation &anno; ///< Annotation being wrapped.
+	public:
+		/**
+		 * Constructor.
+		 * @param anno Annotation to be wrapped.
+		 */
+		DemandEdge(DemandAnnotation &anno) : anno(anno) {}
+
+		/**
+		 * Get the transport demand between end the points of the edge.
+		 * @return Demand.
+		 */
+		uint Demand() const { return this->anno.demand; }
+
+		/**
+		 * Get the transport demand that hasn't been satisfied by flows, yet.
+		 * @return Unsatisfied demand.
+		 */
+		uint UnsatisfiedDemand() const { return this->anno.unsatisfied_demand; }
 
 		/**
 		 * Add some (not yet satisfied) demand.
@@ -142,20 +230,87 @@ public:
 	};
 
 	/**
-	 * Iterator for job edges.
+	 * Iterator for job edges. Iterates over the packed outgoing edges of a
+	 * node. Only edges with capacity are stored, so nothing is skipped.
 	 */
-	class EdgeIterator : public LinkGraph::BaseEdgeIterator<const LinkGraph::BaseEdge, Edge, EdgeIterator> {
-		EdgeAnnotation *base_anno; ///< Array of annotations to be (indirectly) iterated.
+	class EdgeIterator {
+	private:
+		const NodeID *targets;             ///< Remote ends of the edges being iterated.
+		const LinkGraph::BaseEdge *edges;  ///< Edges being iterated.
+		EdgeAnnotation *annos;             ///< Annotations of the edges being iterated.
+		uint current;                      ///< Current offset in the arrays.
+
+		/**
+		 * A "fake" pointer to enable operator-> on temporaries. See
+		 * LinkGraph::BaseEdgeIterator::FakePointer.
+		 */
+		class FakePointer : public SmallPair<NodeID, Edge> {
+		public:
+
+			/**
+			 * Construct a fake pointer from a pair of NodeID and edge.
+			 * @param pair Pair to be "pointed" to (in fact shallow-copied).
+			 */
+			FakePointer(const SmallPair<NodeID, Edge> &pair) : SmallPair<NodeID, Edge>(pair) {}
+
+			/**
+			 * Retrieve the pair by operator->.
+			 * @return Pair being "pointed" to.
+			 */
+			SmallPair<NodeID, Edge> *operator->() { return this; }
+		};
+
 	public:
 		/**
 		 * Constructor.
-		 * @param base Array of edges to be iterated.
-		 * @param base_anno Array of annotations to be iterated.
+		 * @param targets Remote ends of the edges to be iterated.
+		 * @param edges Edges to be iterated.
+		 * @param annos Annotations of the edges to be iterated.
 		 * @param current Start offset of iteration.
 		 */
-		EdgeIterator(const LinkGraph::BaseEdge *base, EdgeAnnotation *base_anno, NodeID current) :
-				LinkGraph::BaseEdgeIterator<const LinkGraph::BaseEdge, Edge, EdgeIterator>(base, current),
-				base_anno(base_anno) {}
+		EdgeIterator(const NodeID *targets, const LinkGraph::BaseEdge *edges, EdgeAnnotation *annos, uint current) :
+				targets(targets), edges(edges), annos(annos), current(current) {}
+
+		/**
+		 * Prefix-increment.
+		 * @return This.
+		 */
+		EdgeIterator &operator++()
+		{
+			this->current++;
+			return *this;
+		}
+
+		/**
+		 * Postfix-increment.
+		 * @return Version of this before increment.
+		 */
+		EdgeIterator operator++(int)
+		{
+			EdgeIterator ret(*this);
+			this->current++;
+			return ret;
+		}
+
+		/**
+		 * Compare with some other edge iterator.
+		 * @param other Other iterator.
+		 * @return If the iterators have the same edge array and offset.
+		 */
+		bool operator==(const EdgeIterator &other) const
+		{
+			return this->edges == other.edges && this->current == other.current;
+		}
+
+		/**
+		 * Compare for inequality with some other edge iterator.
+		 * @param other Other iterator.
+		 * @return If either the edge arrays or the offsets differ.
+		 */
+		bool operator!=(const EdgeIterator &other) const
+		{
+			return this->edges != other.edges || this->current != other.current;
+		}
 
 		/**
 		 * Dereference.
@@ -164,12 +319,11 @@ public:
 		 */
 		SmallPair<NodeID, Edge> operator*() const
 		{
-			return SmallPair<NodeID, Edge>(this->current, Edge(this->base[this->current], this->base_anno[this->current]));
+			return SmallPair<NodeID, Edge>(this->targets[this->current], Edge(this->edges[this->current], this->annos[this->current]));
 		}
 
 		/**
-		 * Dereference. Has to be repeated here as operator* is different than
-		 * in LinkGraph::EdgeWrapper.
+		 * Dereference with operator->.
 		 * @return Fake pointer to pair of NodeID/Edge.
 		 */
 		FakePointer operator->() const {
@@ -178,13 +332,17 @@ public:
 	};
 
 	/**
-	 * Link graph job node. Wraps a constant link graph node and a modifiable
-	 * node annotation.
+	 * Link graph job node. Wraps a constant link graph node, its packed
+	 * outgoing edges and the modifiable node, edge and demand annotations.
 	 */
-	class Node : public LinkGraph::ConstNode {
+	class Node : public LinkGraph::NodeWrapper<const LinkGraph::BaseNode, const LinkGraph::BaseEdge> {
 	private:
-		NodeAnnotation &node_anno;  ///< Annotation being wrapped.
-		EdgeAnnotation *edge_annos; ///< Edge annotations belonging to this node.
+		NodeAnnotation &node_anno;             ///< Annotation being wrapped.
+		const NodeID *targets;                 ///< Remote ends of the outgoing edges.
+		EdgeAnnotation *edge_annos;            ///< Edge annotations belonging to this node.
+		uint num_edges;                        ///< Number of outgoing edges.
+		DemandAnnotation *demand_annos;        ///< Demand annotations from this node to all others, NULL once the job has been joined.
+		const LinkGraph::BaseNode *all_nodes;  ///< All nodes of the job, for distance calculation.
 	public:
 
 		/**
@@ -193,31 +351,55 @@ public:
 		 * @param node ID of the node.
 		 */
 		Node (LinkGraphJob *lgj, NodeID node) :
-			LinkGraph::ConstNode(&lgj->link_graph, node),
-			node_anno(lgj->nodes[node]), edge_annos(lgj->edges[node])
+			LinkGraph::NodeWrapper<const LinkGraph::BaseNode, const LinkGraph::BaseEdge>(lgj->graph_nodes[node],
+					lgj->graph_edges.Begin() + lgj->edge_offsets[node], node),
+			node_anno(lgj->nodes[node]),
+			targets(lgj->edge_targets.Begin() + lgj->edge_offsets[node]),
+			edge_annos(lgj->edges.Begin() + lgj->edge_offsets[node]),
+			num_edges(lgj->edge_offsets[node + 1] - lgj->edge_offsets[node]),
+			demand_annos(lgj->joined ? NULL : lgj->demands[node]), all_nodes(lgj->graph_nodes.Begin())
 		{}
 
 		/**
 		 * Retrieve an edge starting at this node. Mind that this returns an
-		 * object, not a reference.
+		 * object, not a reference. The edge has to exist. As the edges are
+		 * sorted by their remote ends it's found by binary search.
 		 * @param to Remote end of the edge.
 		 * @return Edge between this node and "to".
 		 */
-		Edge operator[](NodeID to) const { return Edge(this->edges[to], this->edge_annos[to]); }
+		Edge operator[](NodeID to) const
+		{
+			const NodeID *it = std::lower_bound(this->targets, this->targets + this->num_edges, to);
+			assert(it != this->targets + this->num_edges && *it == to);
+			uint i = it - this->targets;
+			return Edge(this->edges[i], this->edge_annos[i]);
+		}
+
+		/**
+		 * Retrieve the demand between this node and some other one.
+		 * @param to Remote end of the demand.
+		 * @return Demand between this node and "to".
+		 */
+		DemandEdge DemandTo(NodeID to) const { return DemandEdge(this->demand_annos[to]); }
+
+		/**
+		 * Get the distance between this node and some other one.
+		 * @param to Other node.
+		 * @return Manhattan distance between the nodes' stations.
+		 */
+		uint DistanceTo(NodeID to) const { return DistanceManhattan(this->node.xy, this->all_nodes[to].xy); }
 
 		/**
-		 * Iterator for the "begin" of the edge array. Only edges with capacity
-		 * are iterated. The others are skipped.
+		 * Iterator for the "begin" of the edge array.
 		 * @return Iterator pointing to the first edge.
 		 */
-		EdgeIterator Begin() const { return EdgeIterator(this->edges, this->edge_annos, index); }
+		EdgeIterator Begin() const { return EdgeIterator(this->targets, this->edges, this->edge_annos, 0); }
 
 		/**
-		 * Iterator for the "end" of the edge array. Only edges with capacity
-		 * are iterated. The others are skipped.
+		 * Iterator for the "end" of the edge array.
 		 * @return Iterator pointing beyond the last edge.
 		 */
-		EdgeIterator End() const { return EdgeIterator(this->edges, this->edge_annos, INVALID_NODE); }
+		EdgeIterator End() const { return EdgeIterator(this->targets, this->edges, this->edge_annos, this->num_edges); }
 
 		/**
 		 * Get amount of supply that hasn't been delivered, yet.
@@ -258,7 +440,35 @@ public:
 		void DeliverSupply(NodeID to, uint amount)
 		{
 			this->node_anno.undelivered_supply -= amount;
-			(*this)[to].AddDemand(amount);
+			this->DemandTo(to).AddDemand(amount);
+		}
+
+		/**
+		 * Get the part of the demand to the hub of this node's region which
+		 * is to be forwarded to other regions.
+		 * @return Exported demand.
+		 */
+		uint RegionExport() const { return this->node_anno.region_export; }
+
+		/**
+		 * Deliver some supply to another region via the hub of this node's
+		 * region. The demand is added to the edge to the local hub and
+		 * remembered as export, and the hub gets the same demand to the
+		 * remote hub.
+		 * @param local_hub Hub of this node's region.
+		 * @param remote_hub Hub of the destination region.
+		 * @param hub_demand Demand from the local hub to the remote one.
+		 * @param amount Amount of supply to be delivered.
+		 */
+		void ExportSupply(NodeID local_hub, NodeID remote_hub, DemandEdge hub_demand, uint amount)
+		{
+			if (this->index == local_hub) {
+				this->DeliverSupply(remote_hub, amount);
+			} else {
+				this->DeliverSupply(local_hub, amount);
+				this->node_anno.region_export += amount;
+				hub_demand.AddDemand(amount);
+			}
 		}
 	};
 
@@ -266,8 +476,13 @@ public:
 	 * Bare constructor, only for save/load. link_graph, join_date and actually
 	 * settings have to be brutally const-casted in order to populate them.
 	 */
-	LinkGraphJob() : settings(_settings_game.linkgraph), thread(NULL),
-			join_date(INVALID_DATE) {}
+	LinkGraphJob() : link_graph_index(INVALID_LINK_GRAPH), cargo(INVALID_CARGO),
+			last_compression(0), settings(_settings_game.linkgraph), task(NULL),
+			spawn_date(INVALID_DATE), join_date(INVALID_DATE), join_delay(0), merged_nodes(0),
+			joined(false)
+	{
+		MemSetT(&this->timings, 0);
+	}
 
 	LinkGraphJob(const LinkGraph &orig);
 	~LinkGraphJob();
@@ -280,6 +495,15 @@ public:
 	 */
 	inline bool IsFinished() const { return this->join_date <= _date; }
 
+	bool IsCalculated() const;
+
+	/**
+	 * Check if the results of the job have been merged into the stations
+	 * completely.
+	 * @return True if all nodes have been merged.
+	 */
+	inline bool IsMerged() const { return this->merged_nodes >= this->Size(); }
+
 	/**
 	 * Get the date when the job should be finished.
 	 * @return Join date.
@@ -292,12 +516,67 @@ public:
 	 */
 	inline void ShiftJoinDate(int interval) { this->join_date += interval; }
 
+	/**
+	 * Postpone the join date because the calculation takes longer than
+	 * planned.
+	 * @param days Number of days to postpone the job by.
+	 */
+	inline void Postpone(uint days)
+	{
+		this->join_date += days;
+		this->join_delay += days;
+	}
+
+	/**
+	 * Get the number of days the job has been postponed by.
+	 * @return Number of days.
+	 */
+	inline uint JoinDelay() const { return this->join_delay; }
+
 	/**
 	 * Get the link graph settings for this component.
 	 * @return Settings.
 	 */
 	inline const LinkGraphSettings &Settings() const { return this->settings; }
 
+	/**
+	 * Get the allocator for paths in this job.
+	 * @return Path allocator.
+	 */
+	inline PathAllocator &Allocator() { return this->path_allocator; }
+
+	/**
+	 * Get the regions the job is calculated in.
+	 * @return Region partition, empty if the job isn't calculated hierarchically.
+	 */
+	inline const RegionPartition &Regions() const { return this->regions; }
+
+	/**
+	 * Get the demands calculated by the previous job on the same link graph.
+	 * @return Cached demands.
+	 */
+	inline const LinkGraph::DemandCache &CachedDemands() const { return this->demand_cache; }
+
+	/**
+	 * Check if the demands calculated by the job can be cached for the next
+	 * job on the same link graph. Demands calculated hierarchically include
+	 * the exports to other regions, which can't be reused for single node
+	 * pairs.
+	 * @return If the demands are cached.
+	 */
+	inline bool CachesDemands() const { return this->settings.demand_recalc_threshold > 0 && this->regions.IsEmpty(); }
+
+	void FillDemandCache();
+
+	/**
+	 * Get the number of days the supplies of the link graph had been
+	 * collected for when the job was spawned. This is read by the job's
+	 * thread, so it must not depend on the join date, which may be postponed
+	 * meanwhile.
+	 * @return Number of days, at least 1.
+	 */
+	inline Date SupplyRuntime() const { return max(this->spawn_date - this->last_compression, 1); }
+
 	/**
 	 * Get a node abstraction with the specified id.
 	 * @param num ID of the node.
@@ -309,31 +588,31 @@ public:
 	 * Get the size of the underlying link graph.
 	 * @return Size.
 	 */
-	inline uint Size() const { return this->link_graph.Size(); }
+	inline uint Size() const { return this->graph_nodes.Length(); }
 
 	/**
 	 * Get the cargo of the underlying link graph.
 	 * @return Cargo.
 	 */
-	inline CargoID Cargo() const { return this->link_graph.Cargo(); }
+	inline CargoID Cargo() const { return this->cargo; }
 
 	/**
 	 * Get the date when the underlying link graph was last compressed.
 	 * @return Compression date.
 	 */
-	inline Date LastCompression() const { return this->link_graph.LastCompression(); }
+	inline Date LastCompression() const { return this->last_compression; }
 
 	/**
 	 * Get the ID of the underlying link graph.
 	 * @return Link graph ID.
 	 */
-	inline LinkGraphID LinkGraphIndex() const { return this->link_graph.index; }
+	inline LinkGraphID LinkGraphIndex() const { return this->link_graph_index; }
 
 	/**
-	 * Get a reference to the underlying link graph. Only use this for save/load.
-	 * @return Link graph.
+	 * Get the number of edges in the job.
+	 * @return Number of edges.
 	 */
-	inline const LinkGraph &Graph() const { return this->link_graph; }
+	inline uint NumEdges() const { return this->edge_targets.Length(); }
 };
 
 #define FOR_ALL_LINK_GRAPH_JOBS(var) FOR_ALL_ITEMS_FROM(LinkGraphJob, link_graph_job_index, var, 0)
@@ -18,6 +18,7 @@
 
 typedef LinkGraphJob::Node Node;
 typedef LinkGraphJob::Edge Edge;
+typedef LinkGraphJob::DemandEdge DemandEdge;
 typedef LinkGraphJob::EdgeIterator EdgeIterator;
 
 #endif /* LINKGRAPHJOB_BASE_H */
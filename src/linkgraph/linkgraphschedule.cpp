@@ -10,90 +10,219 @@
 /** @file linkgraphschedule.cpp Definition of link graph schedule used for cargo distribution. */
 
 #include "../stdafx.h"
+#include "../settings_type.h"
+#include "../cpu.h"
+#include "../command_func.h"
+#include "../network/network.h"
 #include "linkgraphschedule.h"
 #include "init.h"
 #include "demands.h"
 #include "mcf.h"
 #include "flowmapper.h"
+#include "../network/network_admin.h"
 
 /**
- * Start the next job in the schedule.
+ * Start the next jobs in the schedule. Up to linkgraph.jobs_per_interval jobs
+ * are started at once, to be run concurrently by the worker threads.
  */
 void LinkGraphSchedule::SpawnNext()
 {
-	if (this->schedule.empty()) return;
-	LinkGraph *next = this->schedule.front();
-	LinkGraph *first = next;
-	while (next->Size() < 2) {
-		this->schedule.splice(this->schedule.end(), this->schedule, this->schedule.begin());
-		next = this->schedule.front();
-		if (next == first) return;
-	}
-	assert(next == LinkGraph::Get(next->index));
-	this->schedule.pop_front();
-	if (LinkGraphJob::CanAllocateItem()) {
-		LinkGraphJob *job = new LinkGraphJob(*next);
-		job->SpawnThread();
-		this->running.push_back(job);
-	} else {
-		NOT_REACHED();
+	for (uint spawned = 0; spawned < _settings_game.linkgraph.jobs_per_interval; ++spawned) {
+		if (this->schedule.empty()) return;
+		LinkGraph *next = this->schedule.front();
+		LinkGraph *first = next;
+		while (next->Size() < 2) {
+			this->schedule.splice(this->schedule.end(), this->schedule, this->schedule.begin());
+			next = this->schedule.front();
+			if (next == first) return;
+		}
+		assert(next == LinkGraph::Get(next->index));
+		this->schedule.pop_front();
+		if (LinkGraphJob::CanAllocateItem()) {
+			LinkGraphJob *job = new LinkGraphJob(*next);
+			job->SpawnThread();
+			this->running.push_back(job);
+		} else {
+			NOT_REACHED();
+		}
 	}
 }
 
 /**
- * Join the next finished job, if available.
+ * Join the next finished jobs, if available. As many jobs are joined as are
+ * spawned at once. Their results are merged into the game by MergeNext.
  */
 void LinkGraphSchedule::JoinNext()
 {
-	if (this->running.empty()) return;
-	LinkGraphJob *next = this->running.front();
-	if (!next->IsFinished()) return;
-	this->running.pop_front();
-	LinkGraphID id = next->LinkGraphIndex();
-	delete next; // implicitly joins the thread
-	if (LinkGraph::IsValidID(id)) {
-		LinkGraph *lg = LinkGraph::Get(id);
-		this->Unqueue(lg); // Unqueue to avoid double-queueing recycled IDs.
-		this->Queue(lg);
+	for (uint joined = 0; joined < _settings_game.linkgraph.jobs_per_interval; ++joined) {
+		if (this->running.empty()) return;
+		LinkGraphJob *next = this->running.front();
+		if (!next->IsFinished()) return;
+		this->running.pop_front();
+
+		uint64 join_start = ottd_rdtsc();
+		next->Join();
+		next->timings.join_date = _date;
+		next->timings.join_wait = ottd_rdtsc() - join_start;
+		this->merging.push_back(next);
 	}
 }
 
 /**
- * Run all handlers for the given Job. This method is tailored to
- * ThreadObject::New.
+ * Merge the results of joined jobs into the stations, for up to
+ * linkgraph.merge_batch nodes at once. Jobs are deleted as soon as they're
+ * merged completely and their link graphs are queued again.
+ */
+void LinkGraphSchedule::MergeNext()
+{
+	uint budget = _settings_game.linkgraph.merge_batch;
+	while (!this->merging.empty()) {
+		LinkGraphJob *job = this->merging.front();
+		uint64 merge_start = ottd_rdtsc();
+		uint merged = job->Merge(budget);
+		job->timings.merge += ottd_rdtsc() - merge_start;
+		if (!job->IsMerged()) return;
+
+		this->merging.pop_front();
+		LinkGraphID id = job->LinkGraphIndex();
+		this->AddTimings(job->timings);
+		delete job;
+		if (LinkGraph::IsValidID(id)) {
+			LinkGraph *lg = LinkGraph::Get(id);
+			this->Unqueue(lg); // Unqueue to avoid double-queueing recycled IDs.
+			this->Queue(lg);
+		}
+
+		if (budget != 0) {
+			budget -= merged;
+			if (budget == 0) return;
+		}
+	}
+}
+
+/**
+ * Postpone the jobs to be joined tomorrow whose calculation isn't finished,
+ * yet, as far as linkgraph.max_join_delay allows. Whether a job is finished
+ * depends on the local machine, so only the server decides this and the
+ * decision is distributed as a command in multiplayer. It is made a day in
+ * advance so that the command reaches all clients before the jobs are joined.
+ */
+void LinkGraphSchedule::PostponeUnfinished()
+{
+	if (_networking && !_network_server) return;
+	uint max_delay = _settings_game.linkgraph.max_join_delay;
+	if (max_delay == 0) return;
+
+	uint checked = 0;
+	for (JobList::iterator i = this->running.begin(); i != this->running.end() &&
+			checked < _settings_game.linkgraph.jobs_per_interval; ++i, ++checked) {
+		LinkGraphJob *job = *i;
+		if (job->JoinDate() > _date + 1 || job->IsCalculated()) continue;
+		uint days = min<uint>(_settings_game.linkgraph.recalc_interval, max_delay - min(max_delay, job->JoinDelay()));
+		if (days == 0) continue;
+		if (_networking) {
+			DoCommandP(0, job->index, days, CMD_POSTPONE_LINKGRAPH_JOB);
+		} else {
+			job->Postpone(days);
+		}
+	}
+}
+
+/**
+ * Run all handlers for the given Job. This is called from the worker threads
+ * or, if there are none, from the main thread.
  * @param j Pointer to a link graph job.
  */
 /* static */ void LinkGraphSchedule::Run(void *j)
 {
 	LinkGraphJob *job = (LinkGraphJob *)j;
 	LinkGraphSchedule *schedule = LinkGraphSchedule::Instance();
-	for (uint i = 0; i < lengthof(schedule->handlers); ++i) {
+	job->timings.started = ottd_rdtsc();
+	for (uint i = 0; i < NUM_HANDLERS; ++i) {
+		uint64 start = ottd_rdtsc();
 		schedule->handlers[i]->Run(*job);
+		job->timings.handlers[i] = ottd_rdtsc() - start;
 	}
+	job->timings.finished = ottd_rdtsc();
 }
 
 /**
- * Start all threads in the running list. This is only useful for save/load.
- * Usually threads are started when the job is created.
+ * Remember the timings of a joined job and send them to the admins.
+ * @param timings Timings of the job.
+ */
+void LinkGraphSchedule::AddTimings(const JobTimings &timings)
+{
+	this->timings.push_back(timings);
+	if (this->timings.size() > TIMINGS_HISTORY) this->timings.pop_front();
+#ifdef ENABLE_NETWORK
+	NetworkAdminLinkGraphJob(timings);
+#endif /* ENABLE_NETWORK */
+}
+
+/**
+ * Get a short name for one of the handlers run for each job.
+ * @param handler Index of the handler.
+ * @return Name of the handler.
+ */
+/* static */ const char *LinkGraphSchedule::GetHandlerName(uint handler)
+{
+	static const char * const names[] = {"init", "demands", "mcf1", "flowmapper1", "mcf2", "flowmapper2"};
+	assert_compile(lengthof(names) == NUM_HANDLERS);
+	assert(handler < NUM_HANDLERS);
+	return names[handler];
+}
+
+/**
+ * Run all handlers on a copy of the given link graph in the current thread
+ * and measure them. The worker threads still help with the path searches.
+ * The results are dropped afterwards without merging them. As the job is
+ * taken from the game's pool this must only be used in single player.
+ * @param lg Link graph to be calculated.
+ * @param result Measurements of the run.
+ * @return If the job could be allocated and run.
+ */
+bool LinkGraphSchedule::Benchmark(const LinkGraph &lg, BenchmarkResult &result)
+{
+	assert(!_networking);
+	if (!LinkGraphJob::CanAllocateItem()) return false;
+	LinkGraphJob *job = new LinkGraphJob(lg);
+	LinkGraphSchedule::Run(job);
+	for (uint i = 0; i < NUM_HANDLERS; ++i) result.cycles[i] = job->timings.handlers[i];
+	result.path_allocations = job->Allocator().GetNumAllocations();
+	result.path_memory = job->Allocator().GetMemoryUsage();
+	delete job;
+	return true;
+}
+
+/**
+ * Queue all jobs in the running list in the worker threads. This is only
+ * useful for save/load. Usually jobs are queued when they are created.
  */
 void LinkGraphSchedule::SpawnAll()
 {
 	for (JobList::iterator i = this->running.begin(); i != this->running.end(); ++i) {
 		(*i)->SpawnThread();
 	}
+	/* Jobs being merged have been joined and their results are saved. */
 }
 
 /**
- * Clear all link graphs and jobs from the schedule.
+ * Clear all link graphs, jobs and timings from the schedule. Jobs no worker
+ * has started, yet, are dropped without running them.
  */
 /* static */ void LinkGraphSchedule::Clear()
 {
 	LinkGraphSchedule *inst = LinkGraphSchedule::Instance();
 	for (JobList::iterator i(inst->running.begin()); i != inst->running.end(); ++i) {
-		(*i)->JoinThread();
+		(*i)->AbortThread();
+	}
+	for (JobList::iterator i(inst->merging.begin()); i != inst->merging.end(); ++i) {
+		(*i)->AbortThread();
 	}
 	inst->running.clear();
+	inst->merging.clear();
 	inst->schedule.clear();
+	inst->timings.clear();
 }
 
 /**
@@ -120,6 +249,9 @@ LinkGraphSchedule::LinkGraphSchedule()
 	this->handlers[3] = new FlowMapper(false);
 	this->handlers[4] = new MCFHandler<MCF2ndPass>;
 	this->handlers[5] = new FlowMapper(true);
+
+	uint threads = _settings_client.gui.linkgraph_threads;
+	this->workers.Start(threads != 0 ? threads : GetCPUCoreCount());
 }
 
 /**
@@ -128,7 +260,8 @@ LinkGraphSchedule::LinkGraphSchedule()
 LinkGraphSchedule::~LinkGraphSchedule()
 {
 	this->Clear();
-	for (uint i = 0; i < lengthof(this->handlers); ++i) {
+	this->workers.Stop();
+	for (uint i = 0; i < NUM_HANDLERS; ++i) {
 		delete this->handlers[i];
 	}
 }
@@ -143,18 +276,42 @@ LinkGraphSchedule::~LinkGraphSchedule()
 }
 
 /**
- * Spawn or join a link graph job or compress a link graph if any link graph is
- * due to do so.
+ * Spawn, postpone or join link graph jobs if any are due to do so and merge
+ * the results of joined jobs.
  */
 void OnTick_LinkGraph()
 {
-	if (_date_fract != LinkGraphSchedule::SPAWN_JOIN_TICK) return;
-	Date offset = _date % _settings_game.linkgraph.recalc_interval;
-	if (offset == 0) {
-		LinkGraphSchedule::Instance()->SpawnNext();
-	} else if (offset == _settings_game.linkgraph.recalc_interval / 2) {
-		LinkGraphSchedule::Instance()->JoinNext();
+	LinkGraphSchedule *schedule = LinkGraphSchedule::Instance();
+	if (_date_fract == LinkGraphSchedule::SPAWN_JOIN_TICK) {
+		Date interval = _settings_game.linkgraph.recalc_interval;
+		Date offset = _date % interval;
+		if (offset == 0) {
+			schedule->SpawnNext();
+		} else if (offset == interval / 2) {
+			schedule->JoinNext();
+		}
+		if (offset == (interval / 2 + interval - 1) % interval) schedule->PostponeUnfinished();
 	}
+	schedule->MergeNext();
+}
+
+/**
+ * Postpone a link graph job whose calculation takes longer than planned.
+ * @param tile unused
+ * @param flags type of operation
+ * @param p1 ID of the link graph job
+ * @param p2 number of days to postpone the job by
+ * @param text unused
+ * @return the cost of this operation or an error
+ */
+CommandCost CmdPostponeLinkGraphJob(TileIndex tile, DoCommandFlag flags, uint32 p1, uint32 p2, const char *text)
+{
+	LinkGraphJob *job = LinkGraphJob::GetIfValid(p1);
+	if (job == NULL || p2 == 0) return CMD_ERROR;
+	if (job->JoinDelay() + p2 > _settings_game.linkgraph.max_join_delay) return CMD_ERROR;
+
+	if (flags & DC_EXEC) job->Postpone(p2);
+	return CommandCost();
 }
 
 
@@ -12,6 +12,7 @@
 #ifndef LINKGRAPHSCHEDULE_H
 #define LINKGRAPHSCHEDULE_H
 
+#include "../thread/thread_pool.h"
 #include "linkgraph.h"
 
 class LinkGraphJob;
@@ -43,10 +44,47 @@ private:
 	typedef std::list<LinkGraphJob *> JobList;
 	friend const SaveLoad *GetLinkGraphScheduleDesc();
 
+public:
+	static const uint NUM_HANDLERS = 6; ///< Number of handlers run for each job.
+
+	/**
+	 * Measurements of a link graph job. Times are given in CPU cycles as
+	 * counted by ottd_rdtsc().
+	 */
+	struct JobTimings {
+		LinkGraphID link_graph;        ///< Link graph the job was spawned from.
+		CargoID cargo;                 ///< Cargo of the link graph.
+		uint nodes;                    ///< Number of nodes in the job.
+		uint edges;                    ///< Number of edges in the job.
+		Date spawn_date;               ///< Date when the job was spawned.
+		Date join_date;                ///< Date when the job was joined.
+		uint64 spawned;                ///< Time when the job was spawned.
+		uint64 started;                ///< Time when a thread started running the job.
+		uint64 finished;               ///< Time when the job was finished.
+		uint64 join_wait;              ///< Time the main thread was blocked waiting for the job when joining it.
+		uint64 merge;                  ///< Time spent merging the results into the game.
+		uint64 handlers[NUM_HANDLERS]; ///< Time spent in each handler.
+	};
+
+	typedef std::list<JobTimings> TimingsList;
+	static const uint TIMINGS_HISTORY = 32; ///< Number of joined jobs to keep the timings of.
+
+	/** Measurements taken while running all handlers on a link graph. */
+	struct BenchmarkResult {
+		uint64 cycles[NUM_HANDLERS]; ///< CPU cycles spent in each handler.
+		uint path_allocations;       ///< Number of paths allocated.
+		size_t path_memory;          ///< Peak memory reserved for paths, in bytes. Other memory of the job isn't counted.
+	};
+
 protected:
-	ComponentHandler *handlers[6]; ///< Handlers to be run for each job.
+	ComponentHandler *handlers[NUM_HANDLERS]; ///< Handlers to be run for each job.
 	GraphList schedule;            ///< Queue for new jobs.
 	JobList running;               ///< Currently running jobs.
+	JobList merging;               ///< Joined jobs whose results are being merged into the game.
+	ThreadPool workers;            ///< Worker threads running the jobs and helping with their calculations.
+	TimingsList timings;           ///< Timings of the last joined jobs, oldest first.
+
+	void AddTimings(const JobTimings &timings);
 
 public:
 	/* This is a tick where not much else is happening, so a small lag might go unnoticed. */
@@ -55,9 +93,25 @@ public:
 	static LinkGraphSchedule *Instance();
 	static void Run(void *j);
 	static void Clear();
+	static const char *GetHandlerName(uint handler);
+
+	/**
+	 * Get the worker threads available for link graph calculations.
+	 * @return Thread pool of the schedule.
+	 */
+	ThreadPool &Workers() { return this->workers; }
+
+	/**
+	 * Get the timings of the last joined jobs.
+	 * @return Timings, oldest first.
+	 */
+	const TimingsList &GetJobTimings() const { return this->timings; }
 
+	bool Benchmark(const LinkGraph &lg, BenchmarkResult &result);
 	void SpawnNext();
 	void JoinNext();
+	void MergeNext();
+	void PostponeUnfinished();
 	void SpawnAll();
 	void ShiftDates(int interval);
 
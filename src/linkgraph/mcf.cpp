@@ -3,7 +3,7 @@
 #include "../stdafx.h"
 #include "../core/math_func.hpp"
 #include "mcf.h"
-#include <set>
+#include "linkgraphschedule.h"
 
 typedef std::map<NodeID, Path *> PathViaMap;
 
@@ -71,14 +71,15 @@ public:
 };
 
 /**
- * Iterator class for getting the edges in the order of their next_edge
- * members.
+ * Iterator class for getting the edges in the order they are stored in the
+ * job, which is the order of the link graph's edge lists.
  */
 class GraphEdgeIterator {
 private:
-	LinkGraphJob &job; ///< Job being executed
-	EdgeIterator i;    ///< Iterator pointing to current edge.
-	EdgeIterator end;  ///< Iterator pointing beyond last edge.
+	LinkGraphJob &job;    ///< Job being executed
+	EdgeIterator i;       ///< Iterator pointing to next edge.
+	EdgeIterator end;     ///< Iterator pointing beyond last edge.
+	EdgeIterator current; ///< Iterator pointing to the edge last returned.
 
 public:
 
@@ -87,7 +88,7 @@ public:
 	 * @param job Job to iterate on.
 	 */
 	GraphEdgeIterator(LinkGraphJob &job) : job(job),
-		i(NULL, NULL, INVALID_NODE), end(NULL, NULL, INVALID_NODE)
+		i(NULL, NULL, NULL, 0), end(NULL, NULL, NULL, 0), current(NULL, NULL, NULL, 0)
 	{}
 
 	/**
@@ -97,8 +98,9 @@ public:
 	 */
 	void SetNode(NodeID source, NodeID node)
 	{
-		this->i = this->job[node].Begin();
-		this->end = this->job[node].End();
+		Node from = this->job[node];
+		this->i = from.Begin();
+		this->end = from.End();
 	}
 
 	/**
@@ -107,7 +109,18 @@ public:
 	 */
 	NodeID Next()
 	{
-		return this->i != this->end ? (this->i++)->first : INVALID_NODE;
+		if (this->i == this->end) return INVALID_NODE;
+		this->current = this->i++;
+		return this->current->first;
+	}
+
+	/**
+	 * Get the edge leading to the node last returned from Next().
+	 * @return Edge.
+	 */
+	Edge GetEdge() const
+	{
+		return this->current->second;
 	}
 };
 
@@ -121,18 +134,27 @@ private:
 	/** Lookup table for getting NodeIDs from StationIDs. */
 	std::map<StationID, NodeID> station_to_node;
 
+	/** Node whose flows are being iterated. */
+	NodeID node;
+
+	/** Node last returned from Next(). */
+	NodeID current;
+
 	/** Current iterator in the shares map. */
 	FlowStat::SharesMap::const_iterator it;
 
 	/** End of the shares map. */
 	FlowStat::SharesMap::const_iterator end;
+
+	/** Empty shares map for nodes without flows. Not function-local as it's used from multiple threads. */
+	static const FlowStat::SharesMap empty;
 public:
 
 	/**
 	 * Constructor.
 	 * @param job Link graph job to work with.
 	 */
-	FlowEdgeIterator(LinkGraphJob &job) : job(job)
+	FlowEdgeIterator(LinkGraphJob &job) : job(job), node(INVALID_NODE), current(INVALID_NODE)
 	{
 		for (NodeID i = 0; i < job.Size(); ++i) {
 			this->station_to_node[job[i].Station()] = i;
@@ -146,15 +168,15 @@ public:
 	 */
 	void SetNode(NodeID source, NodeID node)
 	{
-		static const FlowStat::SharesMap empty;
+		this->node = node;
 		const FlowStatMap &flows = this->job[node].Flows();
 		FlowStatMap::const_iterator it = flows.find(this->job[source].Station());
 		if (it != flows.end()) {
 			this->it = it->second.GetShares()->begin();
 			this->end = it->second.GetShares()->end();
 		} else {
-			this->it = empty.begin();
-			this->end = empty.end();
+			this->it = FlowEdgeIterator::empty.begin();
+			this->end = FlowEdgeIterator::empty.end();
 		}
 	}
 
@@ -165,10 +187,192 @@ public:
 	NodeID Next()
 	{
 		if (this->it == this->end) return INVALID_NODE;
-		return this->station_to_node[(this->it++)->second];
+		this->current = this->station_to_node[(this->it++)->second];
+		return this->current;
+	}
+
+	/**
+	 * Get the edge leading to the node last returned from Next().
+	 * @return Edge.
+	 */
+	Edge GetEdge() const
+	{
+		return this->job[this->node][this->current];
 	}
 };
 
+/* static */ const FlowStat::SharesMap FlowEdgeIterator::empty;
+
+/**
+ * Indexed 4-ary min-heap of annotations for the Dijkstra algorithm. The
+ * position of each node in the heap is tracked so that an improved annotation
+ * can be moved to its new place directly instead of being removed and
+ * reinserted. The memory is kept between searches, so a queue should be reused
+ * for all searches of a pass.
+ * @tparam Tannotation Annotation to be queued.
+ */
+template<class Tannotation>
+class AnnotationQueue {
+private:
+	static const uint ARITY = 4;             ///< Number of children of each heap node.
+	static const uint NOT_QUEUED = UINT_MAX; ///< Position of nodes which aren't queued.
+
+	SmallVector<Tannotation *, 16> heap; ///< Heap of annotations, best first.
+	SmallVector<uint, 16> positions;     ///< Position of each node in the heap, indexed by node ID.
+	typename Tannotation::Comparator better; ///< Relation determining if an annotation is better than another one.
+
+	/**
+	 * Put an annotation at the given position in the heap.
+	 * @param pos Position.
+	 * @param anno Annotation.
+	 */
+	inline void Place(uint pos, Tannotation *anno)
+	{
+		this->heap[pos] = anno;
+		this->positions[anno->GetNode()] = pos;
+	}
+
+	/**
+	 * Move an annotation towards the top of the heap until its parent is better.
+	 * @param pos Current position of the annotation.
+	 * @return New position of the annotation.
+	 */
+	uint SiftUp(uint pos)
+	{
+		Tannotation *anno = this->heap[pos];
+		while (pos > 0) {
+			uint parent = (pos - 1) / ARITY;
+			if (!this->better(anno, this->heap[parent])) break;
+			this->Place(pos, this->heap[parent]);
+			pos = parent;
+		}
+		this->Place(pos, anno);
+		return pos;
+	}
+
+	/**
+	 * Move an annotation towards the bottom of the heap until it's better than
+	 * all of its children.
+	 * @param pos Current position of the annotation.
+	 */
+	void SiftDown(uint pos)
+	{
+		Tannotation *anno = this->heap[pos];
+		uint size = this->heap.Length();
+		for (;;) {
+			uint first = pos * ARITY + 1;
+			if (first >= size) break;
+			uint best = first;
+			uint last = min(first + ARITY, size);
+			for (uint child = first + 1; child < last; ++child) {
+				if (this->better(this->heap[child], this->heap[best])) best = child;
+			}
+			if (!this->better(this->heap[best], anno)) break;
+			this->Place(pos, this->heap[best]);
+			pos = best;
+		}
+		this->Place(pos, anno);
+	}
+
+public:
+	/**
+	 * Empty the queue and prepare it for a graph of the given size.
+	 * @param size Number of nodes in the graph.
+	 */
+	void Reset(uint size)
+	{
+		this->heap.Clear();
+		this->positions.Resize(size);
+		for (uint i = 0; i < size; ++i) this->positions[i] = NOT_QUEUED;
+	}
+
+	/**
+	 * Check if there are annotations left in the queue.
+	 * @return If the queue is empty.
+	 */
+	inline bool IsEmpty() const { return this->heap.Length() == 0; }
+
+	/**
+	 * Add an annotation without restoring the heap property. Call Heapify()
+	 * after adding all annotations.
+	 * @param anno Annotation to be added.
+	 */
+	inline void Add(Tannotation *anno)
+	{
+		*this->heap.Append() = anno;
+		this->positions[anno->GetNode()] = this->heap.Length() - 1;
+	}
+
+	/**
+	 * Restore the heap property after annotations have been added.
+	 */
+	void Heapify()
+	{
+		if (this->heap.Length() < 2) return;
+		for (uint pos = (this->heap.Length() - 2) / ARITY + 1; pos-- > 0;) this->SiftDown(pos);
+	}
+
+	/**
+	 * Remove the best annotation from the queue.
+	 * @return Best annotation.
+	 */
+	Tannotation *Pop()
+	{
+		assert(!this->IsEmpty());
+		Tannotation *top = this->heap[0];
+		this->positions[top->GetNode()] = NOT_QUEUED;
+		Tannotation *last = this->heap[this->heap.Length() - 1];
+		this->heap.Resize(this->heap.Length() - 1);
+		if (last != top) {
+			this->Place(0, last);
+			this->SiftDown(0);
+		}
+		return top;
+	}
+
+	/**
+	 * Restore the position of an annotation after it has changed. If it isn't
+	 * queued anymore it's queued again. The annotation may have become better
+	 * or worse as the rating of some annotations also depends on free capacity.
+	 * @param anno Changed annotation.
+	 */
+	void Update(Tannotation *anno)
+	{
+		uint pos = this->positions[anno->GetNode()];
+		if (pos == NOT_QUEUED) {
+			*this->heap.Append() = anno;
+			this->SiftUp(this->heap.Length() - 1);
+		} else if (this->SiftUp(pos) == pos) {
+			this->SiftDown(pos);
+		}
+	}
+};
+
+/**
+ * Task searching paths for the source nodes of the current batch of an MCF
+ * pass, concurrently with other tasks and the thread running the pass.
+ * @tparam Tannotation Annotation to be used.
+ * @tparam Tedge_iterator Iterator to be used for getting outgoing edges.
+ */
+template<class Tannotation, class Tedge_iterator>
+class PathSearchTask : public ThreadPoolTask {
+private:
+	MultiCommodityFlow *mcf;             ///< MCF pass the task is searching paths for.
+	AnnotationQueue<Tannotation> queue; ///< Queue reused for all searches of the task.
+
+public:
+	/**
+	 * Create a path search task.
+	 * @param mcf MCF pass to search paths for.
+	 */
+	PathSearchTask(MultiCommodityFlow *mcf) : mcf(mcf) {}
+
+	/**
+	 * Search paths until all sources of the batch have been taken.
+	 */
+	virtual void Run() { this->mcf->SearchNextPaths<Tannotation, Tedge_iterator>(this->queue); }
+};
+
 /**
  * Determines if an extension to the given Path with the given parameters is
  * better than this path.
@@ -234,29 +438,44 @@ bool CapacityAnnotation::IsBetter(const CapacityAnnotation *base, uint cap,
  * @tparam Tedge_iterator Iterator to be used for getting outgoing edges.
  * @param source_node Node where the algorithm starts.
  * @param paths Container for the paths to be calculated.
+ * @param annos Queue to be used for the search.
  */
 template<class Tannotation, class Tedge_iterator>
-void MultiCommodityFlow::Dijkstra(NodeID source_node, PathVector &paths)
+void MultiCommodityFlow::Dijkstra(NodeID source_node, PathVector &paths, AnnotationQueue<Tannotation> &annos)
 {
-	typedef std::set<Tannotation *, typename Tannotation::Comparator> AnnoSet;
+	assert_compile(sizeof(Tannotation) == sizeof(Path));
 	Tedge_iterator iter(this->job);
 	uint size = this->job.Size();
-	AnnoSet annos;
 	paths.resize(size, NULL);
+	this->job.Allocator().Allocate(size, &paths[0]);
+	annos.Reset(size);
 	for (NodeID node = 0; node < size; ++node) {
-		Tannotation *anno = new Tannotation(node, node == source_node);
-		annos.insert(anno);
-		paths[node] = anno;
+		Tannotation *anno = new (paths[node]) Tannotation(node, node == source_node);
+		annos.Add(anno);
+	}
+	annos.Heapify();
+
+	/* Nodes of components calculated in regions only have demands to nearby
+	 * nodes, apart from the hubs. Stop searching as soon as all destinations
+	 * have been reached. Nodes settled twice are rare and only make the search
+	 * stop a bit earlier. */
+	Node origin = this->job[source_node];
+	uint targets_left = UINT_MAX;
+	if (!this->job.Regions().IsEmpty()) {
+		targets_left = 0;
+		for (const NodeID *i = this->TargetsBegin(source_node); i != this->TargetsEnd(source_node); ++i) {
+			if (origin.DemandTo(*i).UnsatisfiedDemand() > 0) ++targets_left;
+		}
 	}
-	while (!annos.empty()) {
-		typename AnnoSet::iterator i = annos.begin();
-		Tannotation *source = *i;
-		annos.erase(i);
+
+	while (!annos.IsEmpty() && targets_left > 0) {
+		Tannotation *source = annos.Pop();
 		NodeID from = source->GetNode();
+		if (targets_left != UINT_MAX && origin.DemandTo(from).UnsatisfiedDemand() > 0) --targets_left;
 		iter.SetNode(source_node, from);
 		for (NodeID to = iter.Next(); to != INVALID_NODE; to = iter.Next()) {
 			if (to == from) continue; // Not a real edge but a consumption sign.
-			Edge edge = this->job[from][to];
+			Edge edge = iter.GetEdge();
 			assert(edge.Distance() < UINT_MAX);
 			uint capacity = edge.Capacity();
 			if (this->max_saturation != UINT_MAX) {
@@ -268,14 +487,94 @@ void MultiCommodityFlow::Dijkstra(NodeID source_node, PathVector &paths)
 			uint distance = edge.Distance() + 1;
 			Tannotation *dest = static_cast<Tannotation *>(paths[to]);
 			if (dest->IsBetter(source, capacity, capacity - edge.Flow(), distance)) {
-				annos.erase(dest);
 				dest->Fork(source, capacity, capacity - edge.Flow(), distance);
-				annos.insert(dest);
+				annos.Update(dest);
 			}
 		}
 	}
 }
 
+/**
+ * Search the paths for all sources in [first, last). The searches only read
+ * the flows on the edges, so they are run concurrently on the link graph
+ * worker threads and the calling thread. As all searches of a batch see the
+ * same flows the result doesn't depend on the number of threads or on the
+ * order the sources are picked up in. The tasks and their queues are created
+ * for the first batch and reused for all further batches of the pass.
+ * @tparam Tannotation Annotation to be used.
+ * @tparam Tedge_iterator Iterator to be used for getting outgoing edges.
+ * @param first First source node of the batch.
+ * @param last Source node after the last one of the batch.
+ * @param paths Container for the paths, one entry per source of the batch.
+ */
+template<class Tannotation, class Tedge_iterator>
+void MultiCommodityFlow::SearchPaths(uint first, uint last, PathVectorBatch &paths)
+{
+	assert(last > first && paths.size() >= last - first);
+	this->batch_paths = &paths;
+	this->first_source = this->next_source = first;
+	this->last_source = last;
+
+	ThreadPool &workers = LinkGraphSchedule::Instance()->Workers();
+	uint num_tasks = min(workers.NumThreads(), last - first - 1) + 1;
+	while (this->search_tasks.Length() < num_tasks) {
+		*this->search_tasks.Append() = new PathSearchTask<Tannotation, Tedge_iterator>(this);
+	}
+
+	/* The first task is run by this thread, the others by the workers. */
+	for (uint i = 1; i < num_tasks; ++i) workers.Enqueue(this->search_tasks[i]);
+	this->search_tasks[0]->Run();
+	for (uint i = 1; i < num_tasks; ++i) workers.Wait(this->search_tasks[i]);
+
+	this->batch_paths = NULL;
+}
+
+/**
+ * Take source nodes from the current batch and search their paths until
+ * there are no more sources left.
+ * @tparam Tannotation Annotation to be used.
+ * @tparam Tedge_iterator Iterator to be used for getting outgoing edges.
+ * @param queue Queue to be used for the searches.
+ */
+template<class Tannotation, class Tedge_iterator>
+void MultiCommodityFlow::SearchNextPaths(AnnotationQueue<Tannotation> &queue)
+{
+	for (;;) {
+		this->search_mutex->BeginCritical();
+		uint source = this->next_source;
+		if (source < this->last_source) this->next_source++;
+		this->search_mutex->EndCritical();
+
+		if (source >= this->last_source) return;
+		this->Dijkstra<Tannotation, Tedge_iterator>(source, (*this->batch_paths)[source - this->first_source], queue);
+	}
+}
+
+/**
+ * Collect the nodes each node has demand to, so that the passes don't have to
+ * check the demands between all pairs of nodes in every round. Demand is only
+ * ever added by delivering supply, or to region hubs for forwarding exports,
+ * so only the rows of those nodes have to be checked.
+ */
+void MultiCommodityFlow::FindDemandTargets()
+{
+	uint size = this->job.Size();
+	const RegionPartition &regions = this->job.Regions();
+	this->target_offsets.Resize(size + 1);
+	for (NodeID from = 0; from < size; ++from) {
+		this->target_offsets[from] = this->targets.Length();
+		Node node = this->job[from];
+		if (node.UndeliveredSupply() == node.Supply() &&
+				(regions.IsEmpty() || regions.Hub(regions.RegionOf(from)) != from)) {
+			continue;
+		}
+		for (NodeID to = 0; to < size; ++to) {
+			if (node.DemandTo(to).Demand() > 0) *this->targets.Append() = to;
+		}
+	}
+	this->target_offsets[size] = this->targets.Length();
+}
+
 /**
  * Clean up paths that lead nowhere and the root path.
  * @param source_id ID of the root node.
@@ -294,12 +593,12 @@ void MultiCommodityFlow::CleanupPaths(NodeID source_id, PathVector &paths)
 			path->Detach();
 			if (path->GetNumChildren() == 0) {
 				paths[path->GetNode()] = NULL;
-				delete path;
+				this->job.Allocator().Free(path);
 			}
 			path = parent;
 		}
 	}
-	delete source;
+	this->job.Allocator().Free(source);
 	paths.clear();
 }
 
@@ -312,7 +611,7 @@ void MultiCommodityFlow::CleanupPaths(NodeID source_id, PathVector &paths)
  * @param max_saturation If < UINT_MAX only push flow up to the given
  * 	                     saturation, otherwise the path can be "overloaded".
  */
-uint MultiCommodityFlow::PushFlow(Edge &edge, Path *path, uint accuracy,
+uint MultiCommodityFlow::PushFlow(DemandEdge &edge, Path *path, uint accuracy,
 		uint max_saturation)
 {
 	assert(edge.UnsatisfiedDemand() > 0);
@@ -470,37 +769,45 @@ bool MCF1stPass::EliminateCycles()
  */
 MCF1stPass::MCF1stPass(LinkGraphJob &job) : MultiCommodityFlow(job)
 {
-	PathVector paths;
 	uint size = job.Size();
 	uint accuracy = job.Settings().accuracy;
+	uint batch = job.Settings().path_search_batch;
+	PathVectorBatch batch_paths(batch);
 	bool more_loops;
 
 	do {
 		more_loops = false;
-		for (NodeID source = 0; source < size; ++source) {
-			/* First saturate the shortest paths. */
-			this->Dijkstra<DistanceAnnotation, GraphEdgeIterator>(source, paths);
+		for (uint first = 0; first < size; first += batch) {
+			uint last = min(first + batch, size);
 
-			for (NodeID dest = 0; dest < size; ++dest) {
-				Edge edge = job[source][dest];
-				if (edge.UnsatisfiedDemand() > 0) {
-					Path *path = paths[dest];
-					assert(path != NULL);
-					/* Generally only allow paths that don't exceed the
-					 * available capacity. But if no demand has been assigned
-					 * yet, make an exception and allow any valid path *once*. */
-					if (path->GetFreeCapacity() > 0 && this->PushFlow(edge, path,
-							accuracy, this->max_saturation) > 0) {
-						/* If a path has been found there is a chance we can
-						 * find more. */
-						more_loops = more_loops || (edge.UnsatisfiedDemand() > 0);
-					} else if (edge.UnsatisfiedDemand() == edge.Demand() &&
-							path->GetFreeCapacity() > INT_MIN) {
-						this->PushFlow(edge, path, accuracy, UINT_MAX);
+			/* First saturate the shortest paths. */
+			this->SearchPaths<DistanceAnnotation, GraphEdgeIterator>(first, last, batch_paths);
+
+			for (NodeID source = first; source < last; ++source) {
+				PathVector &paths = batch_paths[source - first];
+				Node source_node = job[source];
+				for (const NodeID *i = this->TargetsBegin(source); i != this->TargetsEnd(source); ++i) {
+					NodeID dest = *i;
+					DemandEdge edge = source_node.DemandTo(dest);
+					if (edge.UnsatisfiedDemand() > 0) {
+						Path *path = paths[dest];
+						assert(path != NULL);
+						/* Generally only allow paths that don't exceed the
+						 * available capacity. But if no demand has been assigned
+						 * yet, make an exception and allow any valid path *once*. */
+						if (path->GetFreeCapacity() > 0 && this->PushFlow(edge, path,
+								accuracy, this->max_saturation) > 0) {
+							/* If a path has been found there is a chance we can
+							 * find more. */
+							more_loops = more_loops || (edge.UnsatisfiedDemand() > 0);
+						} else if (edge.UnsatisfiedDemand() == edge.Demand() &&
+								path->GetFreeCapacity() > INT_MIN) {
+							this->PushFlow(edge, path, accuracy, UINT_MAX);
+						}
 					}
 				}
+				this->CleanupPaths(source, paths);
 			}
-			this->CleanupPaths(source, paths);
 		}
 	} while (more_loops || this->EliminateCycles());
 }
@@ -513,23 +820,30 @@ MCF1stPass::MCF1stPass(LinkGraphJob &job) : MultiCommodityFlow(job)
 MCF2ndPass::MCF2ndPass(LinkGraphJob &job) : MultiCommodityFlow(job)
 {
 	this->max_saturation = UINT_MAX; // disable artificial cap on saturation
-	PathVector paths;
 	uint size = job.Size();
 	uint accuracy = job.Settings().accuracy;
+	uint batch = job.Settings().path_search_batch;
+	PathVectorBatch batch_paths(batch);
 	bool demand_left = true;
 	while (demand_left) {
 		demand_left = false;
-		for (NodeID source = 0; source < size; ++source) {
-			this->Dijkstra<CapacityAnnotation, FlowEdgeIterator>(source, paths);
-			for (NodeID dest = 0; dest < size; ++dest) {
-				Edge edge = this->job[source][dest];
-				Path *path = paths[dest];
-				if (edge.UnsatisfiedDemand() > 0 && path->GetFreeCapacity() > INT_MIN) {
-					this->PushFlow(edge, path, accuracy, UINT_MAX);
-					if (edge.UnsatisfiedDemand() > 0) demand_left = true;
+		for (uint first = 0; first < size; first += batch) {
+			uint last = min(first + batch, size);
+			this->SearchPaths<CapacityAnnotation, FlowEdgeIterator>(first, last, batch_paths);
+			for (NodeID source = first; source < last; ++source) {
+				PathVector &paths = batch_paths[source - first];
+				Node source_node = this->job[source];
+				for (const NodeID *i = this->TargetsBegin(source); i != this->TargetsEnd(source); ++i) {
+					NodeID dest = *i;
+					DemandEdge edge = source_node.DemandTo(dest);
+					Path *path = paths[dest];
+					if (edge.UnsatisfiedDemand() > 0 && path->GetFreeCapacity() > INT_MIN) {
+						this->PushFlow(edge, path, accuracy, UINT_MAX);
+						if (edge.UnsatisfiedDemand() > 0) demand_left = true;
+					}
 				}
+				this->CleanupPaths(source, paths);
 			}
-			this->CleanupPaths(source, paths);
 		}
 	}
 }
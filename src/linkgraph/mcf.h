@@ -7,6 +7,10 @@
 #include <vector>
 
 typedef std::vector<Path *> PathVector;
+typedef std::vector<PathVector> PathVectorBatch;
+
+template<class Tannotation, class Tedge_iterator> class PathSearchTask;
+template<class Tannotation> class AnnotationQueue;
 
 /**
  * Multi-commodity flow calculating base class.
@@ -18,18 +22,62 @@ protected:
 	 * @param job Link graph job being executed.
 	 */
 	MultiCommodityFlow(LinkGraphJob &job) : job(job),
-			max_saturation(job.Settings().short_path_saturation)
-	{}
+			max_saturation(job.Settings().short_path_saturation),
+			search_mutex(ThreadMutex::New()), batch_paths(NULL),
+			first_source(0), next_source(0), last_source(0)
+	{
+		this->FindDemandTargets();
+	}
+
+	/**
+	 * Destructor.
+	 */
+	~MultiCommodityFlow() { delete this->search_mutex; }
+
+	template<class Tannotation, class Tedge_iterator>
+	void Dijkstra(NodeID from, PathVector &paths, AnnotationQueue<Tannotation> &annos);
 
 	template<class Tannotation, class Tedge_iterator>
-	void Dijkstra(NodeID from, PathVector &paths);
+	void SearchPaths(uint first, uint last, PathVectorBatch &paths);
 
-	uint PushFlow(Edge &edge, Path *path, uint accuracy, uint max_saturation);
+	uint PushFlow(DemandEdge &edge, Path *path, uint accuracy, uint max_saturation);
 
 	void CleanupPaths(NodeID source, PathVector &paths);
 
+	/**
+	 * Get the first node the given node has demand to.
+	 * @param node Supplying node.
+	 * @return Pointer to the first receiving node.
+	 */
+	inline const NodeID *TargetsBegin(NodeID node) const { return this->targets.Begin() + this->target_offsets[node]; }
+
+	/**
+	 * Get the end of the nodes the given node has demand to.
+	 * @param node Supplying node.
+	 * @return Pointer behind the last receiving node.
+	 */
+	inline const NodeID *TargetsEnd(NodeID node) const { return this->targets.Begin() + this->target_offsets[node + 1]; }
+
 	LinkGraphJob &job;   ///< Job we're working with.
 	uint max_saturation; ///< Maximum saturation for edges.
+
+private:
+	template<class Tannotation, class Tedge_iterator> friend class PathSearchTask;
+
+	template<class Tannotation, class Tedge_iterator>
+	void SearchNextPaths(AnnotationQueue<Tannotation> &queue);
+
+	void FindDemandTargets();
+
+	SmallVector<uint, 16> target_offsets; ///< Index of the first demand target of each node in targets, plus the total number of targets.
+	SmallVector<NodeID, 16> targets;      ///< Nodes each node has demand to, sorted by supplying and receiving node.
+
+	ThreadMutex *search_mutex;     ///< Mutex guarding next_source while searching paths concurrently.
+	AutoDeleteSmallVector<ThreadPoolTask *, 8> search_tasks; ///< Tasks searching paths, kept for all batches of the pass.
+	PathVectorBatch *batch_paths;  ///< Paths for the sources of the current batch.
+	uint first_source;             ///< First source node of the current batch.
+	uint next_source;              ///< Next source node to be searched in the current batch.
+	uint last_source;              ///< Source node after the last one of the current batch.
 };
 
 /**
@@ -46,6 +94,8 @@ protected:
  *   time it will take.
  * - You can increase the recalculation interval to allow for longer running
  *   times without creating lags.
+ * - The path_search_batch setting allows the paths of multiple source nodes to
+ *   be searched concurrently, using the link graph worker threads.
  */
 class MCF1stPass : public MultiCommodityFlow {
 private:
@@ -14,9 +14,26 @@
 #include "../station_func.h"
 #include "../engine_base.h"
 #include "../vehicle_func.h"
+#include "../core/flatmap_type.hpp"
 #include "refresh.h"
 #include "linkgraph.h"
 
+/**
+ * Links predicted for the vehicles sharing an order list. Without refit orders
+ * the links a vehicle will visit only depend on the orders, the order the
+ * vehicle starts at and whether it's carrying cargo. So they are predicted
+ * once per start and reused for all vehicles; only the capacities are
+ * determined per vehicle.
+ */
+struct LinkPrediction {
+	SmallVector<uint64, 16> orders;                 ///< Orders the links were predicted for, packed with their refit cargo.
+	FlatMap<uint32, std::pair<uint, uint> > starts; ///< First link and number of links, by start order and cargo flag.
+	SmallVector<LinkRefresher::PredictedLink, 16> links; ///< Links predicted for all starts.
+};
+
+/** Predicted links by order list. Entries of deleted order lists are purged every now and then. */
+static std::map<OrderListID, LinkPrediction> _link_predictions;
+
 /**
  * Refresh all links the given vehicle will visit.
  * @param v Vehicle to refresh links for.
@@ -31,10 +48,79 @@
 	const Order *first = v->orders.list->GetNextDecisionNode(v->GetOrder(v->cur_implicit_order_index), 0);
 	if (first == NULL) return;
 
+	uint8 flags = v->last_loading_station != INVALID_STATION ? 1 << HAS_CARGO : 0;
+	uint num_links;
+	const PredictedLink *links = LinkRefresher::PredictLinks(v, first, flags, &num_links);
+
 	HopSet seen_hops;
 	LinkRefresher refresher(v, &seen_hops, allow_merge);
 
-	refresher.RefreshLinks(first, first, v->last_loading_station != INVALID_STATION ? 1 << HAS_CARGO : 0);
+	if (links == NULL) {
+		refresher.RefreshLinks(first, first, flags);
+		return;
+	}
+
+	for (const PredictedLink *link = links; link != links + num_links; ++link) {
+		refresher.RefreshLink(link->from, link->to, link->restricted);
+	}
+}
+
+/**
+ * Get the links a vehicle will visit from the prediction cache of its order
+ * list. If they haven't been predicted for the vehicle's start order, yet,
+ * predict them now. Order lists with refit orders aren't cached as the links
+ * also depend on the consist then.
+ * @param v Vehicle to get the links for.
+ * @param first First order to be evaluated.
+ * @param flags RefreshFlags for the first order.
+ * @param num_links Output for the number of links.
+ * @return Pointer to the first link or NULL if the links can't be cached.
+ */
+/* static */ const LinkRefresher::PredictedLink *LinkRefresher::PredictLinks(Vehicle *v, const Order *first, uint8 flags, uint *num_links)
+{
+	static SmallVector<uint64, 16> orders;
+
+	const OrderList *list = v->orders.list;
+	orders.Clear();
+	for (const Order *order = list->GetFirstOrder(); order != NULL; order = order->next) {
+		if ((order->IsType(OT_GOTO_DEPOT) || order->IsType(OT_GOTO_STATION)) &&
+				order->IsRefit() && !order->IsAutoRefit()) {
+			return NULL;
+		}
+		*orders.Append() = (uint64)order->GetRefitCargo() << 32 | order->Pack();
+	}
+
+	if (_link_predictions.size() > 2 * OrderList::GetNumItems() + 64) {
+		for (std::map<OrderListID, LinkPrediction>::iterator it = _link_predictions.begin(); it != _link_predictions.end();) {
+			if (OrderList::IsValidID(it->first)) {
+				++it;
+			} else {
+				_link_predictions.erase(it++);
+			}
+		}
+	}
+
+	LinkPrediction &prediction = _link_predictions[list->index];
+	if (prediction.orders.Length() != orders.Length() ||
+			memcmp(prediction.orders.Begin(), orders.Begin(), orders.Length() * sizeof(uint64)) != 0) {
+		prediction.orders = orders;
+		prediction.starts.clear();
+		prediction.links.Clear();
+	}
+
+	uint32 start = v->cur_implicit_order_index << 8 | flags;
+	FlatMap<uint32, std::pair<uint, uint> >::iterator it = prediction.starts.find(start);
+	if (it == prediction.starts.end()) {
+		uint begin = prediction.links.Length();
+		HopSet seen_hops;
+		LinkRefresher refresher(v, &seen_hops, true);
+		refresher.predicted_links = &prediction.links;
+		refresher.RefreshLinks(first, first, flags);
+		it = prediction.starts.insert(std::make_pair(start, std::make_pair(begin, prediction.links.Length() - begin))).first;
+	}
+
+	*num_links = it->second.second;
+	return prediction.links.Begin() + it->second.first;
 }
 
 /**
@@ -65,7 +151,8 @@ bool LinkRefresher::Hop::operator<(const Hop &other) const
  * @param allow_merge If the refresher is allowed to merge or extend link graphs.
  */
 LinkRefresher::LinkRefresher(Vehicle *vehicle, HopSet *seen_hops, bool allow_merge) :
-		vehicle(vehicle), seen_hops(seen_hops), cargo(CT_INVALID), allow_merge(allow_merge)
+		vehicle(vehicle), seen_hops(seen_hops), cargo(CT_INVALID), allow_merge(allow_merge),
+		predicted_links(NULL)
 {
 	/* Assemble list of capacities and set last loading stations to 0. */
 	for (Vehicle *v = this->vehicle; v != NULL; v = v->Next()) {
@@ -182,14 +269,35 @@ const Order *LinkRefresher::PredictNextOrder(const Order *cur, const Order *next
 }
 
 /**
- * Refresh link stats for the given pair of orders.
+ * Refresh link stats for the given pair of orders, or record the link if
+ * links are being predicted.
  * @param cur Last stop where the consist could interact with cargo.
  * @param next Next order to be processed.
  */
 void LinkRefresher::RefreshStats(const Order *cur, const Order *next)
 {
-	StationID next_station = next->GetDestination();
-	Station *st = Station::GetIfValid(cur->GetDestination());
+	/* A link is at least partly restricted if a
+	 * vehicle can't load at its source. */
+	bool restricted = (cur->GetLoadType() & OLFB_NO_LOAD) != 0;
+	if (this->predicted_links != NULL) {
+		PredictedLink *link = this->predicted_links->Append();
+		link->from = cur->GetDestination();
+		link->to = next->GetDestination();
+		link->restricted = restricted;
+	} else {
+		this->RefreshLink(cur->GetDestination(), next->GetDestination(), restricted);
+	}
+}
+
+/**
+ * Refresh link stats for a link with the consist's current capacities.
+ * @param from Station the link starts at.
+ * @param next_station Station the link leads to.
+ * @param restricted If the consist can't load at the start of the link.
+ */
+void LinkRefresher::RefreshLink(StationID from, StationID next_station, bool restricted)
+{
+	Station *st = Station::GetIfValid(from);
 	if (st != NULL && next_station != INVALID_STATION && next_station != st->index) {
 		for (CapacitiesMap::const_iterator i = this->capacities.begin(); i != this->capacities.end(); ++i) {
 			/* Refresh the link and give it a minimum capacity. */
@@ -203,10 +311,8 @@ void LinkRefresher::RefreshStats(const Order *cur, const Order *next)
 				continue;
 			}
 
-			/* A link is at least partly restricted if a
-			 * vehicle can't load at its source. */
 			IncreaseStats(st, c, next_station, i->second,
-					(cur->GetLoadType() & OLFB_NO_LOAD) == 0 ? LinkGraph::REFRESH_UNRESTRICTED : LinkGraph::REFRESH_RESTRICTED);
+					restricted ? LinkGraph::REFRESH_RESTRICTED : LinkGraph::REFRESH_UNRESTRICTED);
 		}
 	}
 }
@@ -25,6 +25,16 @@ class LinkRefresher {
 public:
 	static void Run(Vehicle *v, bool allow_merge = true);
 
+	/**
+	 * A link found by the refresh algorithm, independent of the consist's
+	 * capacities. Recorded for reuse by other vehicles with the same orders.
+	 */
+	struct PredictedLink {
+		StationID from;  ///< Station the link starts at.
+		StationID to;    ///< Station the link leads to.
+		bool restricted; ///< If the consist can't load at the start of the link.
+	};
+
 protected:
 	/**
 	 * Various flags about properties of the last examined link that might have
@@ -81,6 +91,7 @@ protected:
 	typedef std::list<RefitDesc> RefitList;
 	typedef std::map<CargoID, uint> CapacitiesMap;
 	typedef std::set<Hop> HopSet;
+	typedef SmallVector<PredictedLink, 16> PredictedLinkVector;
 
 	Vehicle *vehicle;           ///< Vehicle for which the links should be refreshed.
 	CapacitiesMap capacities;   ///< Current added capacities per cargo ID in the consist.
@@ -88,12 +99,16 @@ protected:
 	HopSet *seen_hops;          ///< Hops already seen. If the same hop is seen twice we stop the algorithm. This is shared between all Refreshers of the same run.
 	CargoID cargo;              ///< Cargo given in last refit order.
 	bool allow_merge;           ///< If the refresher is allowed to merge or extend link graphs.
+	PredictedLinkVector *predicted_links; ///< If not NULL, links are recorded here instead of being refreshed.
 
 	LinkRefresher(Vehicle *v, HopSet *seen_hops, bool allow_merge);
 
+	static const PredictedLink *PredictLinks(Vehicle *v, const Order *first, uint8 flags, uint *num_links);
+
 	void HandleRefit(const Order *next);
 	void ResetRefit();
 	void RefreshStats(const Order *cur, const Order *next);
+	void RefreshLink(StationID from, StationID to, bool restricted);
 	const Order *PredictNextOrder(const Order *cur, const Order *next, uint8 flags, uint num_hops = 0);
 
 	void RefreshLinks(const Order *cur, const Order *next, uint8 flags, uint num_hops = 0);
@@ -0,0 +1,113 @@
+/* $Id$ */
+
+/*
+ * This file is part of OpenTTD.
+ * OpenTTD is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * OpenTTD is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with OpenTTD. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file regions.cpp Definition of the partition of large link graph components into regions. */
+
+#include "../stdafx.h"
+#include "linkgraphjob_base.h"
+
+/**
+ * Split the nodes of a job into regions of up to about region_size nodes.
+ * Regions are grown breadth first along the edges, starting at the lowest
+ * node not assigned to a region, yet. Left-overs of less than half the size
+ * are added to an adjacent region. This takes time linear in the number of
+ * nodes and edges. If all nodes end up in one region the partition stays
+ * empty and the job is calculated as usual.
+ * @param job Job to be partitioned.
+ * @param region_size Number of nodes a region should have.
+ */
+void RegionPartition::Build(LinkGraphJob &job, uint region_size)
+{
+	static const uint16 NO_REGION = UINT16_MAX;
+	uint size = job.Size();
+	this->node_regions.Resize(size);
+	for (NodeID node = 0; node < size; ++node) this->node_regions[node] = NO_REGION;
+
+	SmallVector<uint, 16> region_sizes;
+	SmallVector<NodeID, 16> queue;
+	uint16 num = 0;
+	for (NodeID seed = 0; seed < size; ++seed) {
+		if (this->node_regions[seed] != NO_REGION) continue;
+
+		queue.Clear();
+		*queue.Append() = seed;
+		this->node_regions[seed] = num;
+		uint16 adjacent = NO_REGION;
+		for (uint i = 0; i < queue.Length(); ++i) {
+			Node node = job[queue[i]];
+			for (EdgeIterator it = node.Begin(); it != node.End(); ++it) {
+				NodeID to = it->first;
+				uint16 region = this->node_regions[to];
+				if (region == NO_REGION) {
+					if (queue.Length() < region_size) {
+						this->node_regions[to] = num;
+						*queue.Append() = to;
+					}
+				} else if (region != num && adjacent == NO_REGION) {
+					adjacent = region;
+				}
+			}
+		}
+
+		if (queue.Length() < region_size / 2 && adjacent != NO_REGION) {
+			for (uint i = 0; i < queue.Length(); ++i) this->node_regions[queue[i]] = adjacent;
+			region_sizes[adjacent] += queue.Length();
+		} else {
+			*region_sizes.Append() = queue.Length();
+			++num;
+		}
+	}
+
+	if (num < 2) {
+		this->num_regions = 0;
+		return;
+	}
+
+	this->num_regions = num;
+	this->offsets.Resize(num + 1);
+	this->offsets[0] = 0;
+	for (uint region = 0; region < num; ++region) {
+		this->offsets[region + 1] = this->offsets[region] + region_sizes[region];
+		region_sizes[region] = this->offsets[region];
+	}
+
+	/* Sort the nodes by region, keeping them sorted by ID within each
+	 * region, and choose the hubs. The hub is the node with the most supply
+	 * among the nodes with demand, so that cargo from other regions can be
+	 * delivered there. */
+	this->nodes.Resize(size);
+	this->hubs.Resize(num);
+	this->supplies.Resize(num);
+	this->demands.Resize(num);
+	for (uint region = 0; region < num; ++region) {
+		this->hubs[region] = INVALID_NODE;
+		this->supplies[region] = 0;
+		this->demands[region] = 0;
+	}
+	for (NodeID node = 0; node < size; ++node) {
+		uint region = this->node_regions[node];
+		this->nodes[region_sizes[region]++] = node;
+
+		Node candidate = job[node];
+		this->supplies[region] += candidate.Supply();
+		this->demands[region] += candidate.Demand();
+		NodeID hub = this->hubs[region];
+		if (hub == INVALID_NODE) {
+			this->hubs[region] = node;
+			continue;
+		}
+		Node current = job[hub];
+		bool accepts = candidate.Demand() > 0;
+		if (accepts != (current.Demand() > 0)) {
+			if (accepts) this->hubs[region] = node;
+		} else if (candidate.Supply() > current.Supply()) {
+			this->hubs[region] = node;
+		}
+	}
+}
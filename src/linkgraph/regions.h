@@ -0,0 +1,98 @@
+/* $Id$ */
+
+/*
+ * This file is part of OpenTTD.
+ * OpenTTD is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * OpenTTD is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with OpenTTD. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file regions.h Declaration of the partition of large link graph components into regions. */
+
+#ifndef REGIONS_H
+#define REGIONS_H
+
+#include "../core/smallvec_type.hpp"
+#include "linkgraph_type.h"
+
+class LinkGraphJob;
+
+/**
+ * Partition of the nodes of a link graph job into regions of neighbouring
+ * nodes. Very large components are calculated hierarchically: demands and
+ * flows are calculated between all nodes of the same region, but only between
+ * the "hubs" of different regions. Each region is treated as one big node
+ * there. Cargo from a node to other regions is sent to the hub of its own
+ * region first and forwarded from there.
+ */
+class RegionPartition {
+public:
+	RegionPartition() : num_regions(0) {}
+
+	void Build(LinkGraphJob &job, uint region_size);
+
+	/**
+	 * Check if the job is calculated hierarchically at all.
+	 * @return If there are no regions.
+	 */
+	inline bool IsEmpty() const { return this->num_regions == 0; }
+
+	/**
+	 * Get the number of regions.
+	 * @return Number of regions.
+	 */
+	inline uint NumRegions() const { return this->num_regions; }
+
+	/**
+	 * Get the region a node belongs to.
+	 * @param node Node to look up.
+	 * @return Index of the node's region.
+	 */
+	inline uint RegionOf(NodeID node) const { return this->node_regions[node]; }
+
+	/**
+	 * Get the hub of a region, the node representing it to other regions.
+	 * @param region Region to look up.
+	 * @return Hub of the region.
+	 */
+	inline NodeID Hub(uint region) const { return this->hubs[region]; }
+
+	/**
+	 * Get the sum of the supplies of a region's nodes.
+	 * @param region Region to look up.
+	 * @return Supply of the region.
+	 */
+	inline uint Supply(uint region) const { return this->supplies[region]; }
+
+	/**
+	 * Get the sum of the demands (acceptance) of a region's nodes.
+	 * @param region Region to look up.
+	 * @return Demand of the region.
+	 */
+	inline uint Demand(uint region) const { return this->demands[region]; }
+
+	/**
+	 * Get the first node of a region. The nodes of a region are sorted by ID.
+	 * @param region Region to look up.
+	 * @return Pointer to the first node of the region.
+	 */
+	inline const NodeID *Begin(uint region) const { return this->nodes.Begin() + this->offsets[region]; }
+
+	/**
+	 * Get the end of a region's nodes.
+	 * @param region Region to look up.
+	 * @return Pointer behind the last node of the region.
+	 */
+	inline const NodeID *End(uint region) const { return this->nodes.Begin() + this->offsets[region + 1]; }
+
+private:
+	uint num_regions;                      ///< Number of regions, 0 if the job isn't calculated hierarchically.
+	SmallVector<uint16, 16> node_regions;  ///< Region of each node.
+	SmallVector<uint, 16> offsets;         ///< Index of the first node of each region in nodes, plus the total number of nodes.
+	SmallVector<NodeID, 16> nodes;         ///< Nodes sorted by region.
+	SmallVector<NodeID, 16> hubs;          ///< Hub of each region.
+	SmallVector<uint, 16> supplies;        ///< Sum of the supplies of each region's nodes.
+	SmallVector<uint, 16> demands;         ///< Sum of the demands of each region's nodes.
+};
+
+#endif /* REGIONS_H */
@@ -43,6 +43,7 @@ void InitializeDockGui();
 void InitializeObjectGui();
 void InitializeIndustries();
 void InitializeObjects();
+void InitializeStationCatchmentIndex();
 void InitializeTrees();
 void InitializeCompanies();
 void InitializeCheats();
@@ -90,6 +91,7 @@ void InitializeGame(uint size_x, uint size_y, bool reset_date, bool reset_settin
 	InitializeTrees();
 	InitializeIndustries();
 	InitializeObjects();
+	InitializeStationCatchmentIndex();
 	InitializeBuildingCounts();
 
 	InitializeNPF();
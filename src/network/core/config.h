@@ -34,7 +34,7 @@ static const uint16 NETWORK_DEFAULT_DEBUGLOG_PORT = 3982;         ///< The defau
 
 static const uint16 SEND_MTU                      = 1460;         ///< Number of bytes we can pack in a single packet
 
-static const byte NETWORK_GAME_ADMIN_VERSION      =    1;         ///< What version of the admin network do we use?
+static const byte NETWORK_GAME_ADMIN_VERSION      =    2;         ///< What version of the admin network do we use?
 static const byte NETWORK_GAME_INFO_VERSION       =    4;         ///< What version of game-info do we use?
 static const byte NETWORK_COMPANY_INFO_VERSION    =    6;         ///< What version of company info is this?
 static const byte NETWORK_MASTER_SERVER_VERSION   =    2;         ///< What version of master-server-protocol do we use?
@@ -92,6 +92,8 @@ NetworkRecvStatus NetworkAdminSocketHandler::HandlePacket(Packet *p)
 		case ADMIN_PACKET_SERVER_CMD_LOGGING:     return this->Receive_SERVER_CMD_LOGGING(p);
 		case ADMIN_PACKET_SERVER_RCON_END:        return this->Receive_SERVER_RCON_END(p);
 		case ADMIN_PACKET_SERVER_PONG:            return this->Receive_SERVER_PONG(p);
+		case ADMIN_PACKET_SERVER_LINKGRAPH_JOB:   return this->Receive_SERVER_LINKGRAPH_JOB(p);
+		case ADMIN_PACKET_SERVER_VEHICLE_TICKS:   return this->Receive_SERVER_VEHICLE_TICKS(p);
 
 		default:
 			if (this->HasClientQuit()) {
@@ -170,5 +172,7 @@ NetworkRecvStatus NetworkAdminSocketHandler::Receive_SERVER_CMD_NAMES(Packet *p)
 NetworkRecvStatus NetworkAdminSocketHandler::Receive_SERVER_CMD_LOGGING(Packet *p) { return this->ReceiveInvalidPacket(ADMIN_PACKET_SERVER_CMD_LOGGING); }
 NetworkRecvStatus NetworkAdminSocketHandler::Receive_SERVER_RCON_END(Packet *p) { return this->ReceiveInvalidPacket(ADMIN_PACKET_SERVER_RCON_END); }
 NetworkRecvStatus NetworkAdminSocketHandler::Receive_SERVER_PONG(Packet *p) { return this->ReceiveInvalidPacket(ADMIN_PACKET_SERVER_PONG); }
+NetworkRecvStatus NetworkAdminSocketHandler::Receive_SERVER_LINKGRAPH_JOB(Packet *p) { return this->ReceiveInvalidPacket(ADMIN_PACKET_SERVER_LINKGRAPH_JOB); }
+NetworkRecvStatus NetworkAdminSocketHandler::Receive_SERVER_VEHICLE_TICKS(Packet *p) { return this->ReceiveInvalidPacket(ADMIN_PACKET_SERVER_VEHICLE_TICKS); }
 
 #endif /* ENABLE_NETWORK */
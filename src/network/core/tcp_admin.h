@@ -63,6 +63,8 @@ enum PacketAdminType {
 	ADMIN_PACKET_SERVER_GAMESCRIPT,      ///< The server gives the admin information from the GameScript in JSON.
 	ADMIN_PACKET_SERVER_RCON_END,        ///< The server indicates that the remote console command has completed.
 	ADMIN_PACKET_SERVER_PONG,            ///< The server replies to a ping request from the admin.
+	ADMIN_PACKET_SERVER_LINKGRAPH_JOB,   ///< The server gives the admin the timings of a finished link graph job.
+	ADMIN_PACKET_SERVER_VEHICLE_TICKS,   ///< The server gives the admin the profile of the vehicle ticks.
 
 	INVALID_ADMIN_PACKET = 0xFF,         ///< An invalid marker for admin packets.
 };
@@ -86,6 +88,8 @@ enum AdminUpdateType {
 	ADMIN_UPDATE_CMD_NAMES,       ///< The admin would like a list of all DoCommand names.
 	ADMIN_UPDATE_CMD_LOGGING,     ///< The admin would like to have DoCommand information.
 	ADMIN_UPDATE_GAMESCRIPT,      ///< The admin would like to have gamescript messages.
+	ADMIN_UPDATE_LINKGRAPH_JOBS,  ///< The admin would like to have the timings of link graph jobs.
+	ADMIN_UPDATE_VEHICLE_TICKS,   ///< The admin would like to have the profile of the vehicle ticks.
 	ADMIN_UPDATE_END,             ///< Must ALWAYS be on the end of this list!! (period)
 };
 
@@ -473,6 +477,49 @@ protected:
 	 */
 	virtual NetworkRecvStatus Receive_SERVER_PONG(Packet *p);
 
+	/**
+	 * Send the timings of a link graph job after it has been joined. Times
+	 * are CPU cycles; they are only meaningful relative to each other.
+	 * uint16  ID of the link graph.
+	 * uint8   ID of the cargo.
+	 * uint16  Number of nodes.
+	 * uint32  Number of edges.
+	 * uint32  Date when the job was spawned.
+	 * uint32  Date when the job was joined.
+	 * uint64  Time between spawning and starting the job.
+	 * uint64  Time between starting and finishing the job.
+	 * uint64  Time the game was blocked waiting for the job when joining it.
+	 * uint64  Time spent merging the results into the game.
+	 * uint8   Number of handlers.
+	 * For each handler:
+	 * uint64  Time spent in the handler.
+	 * @param p The packet that was just received.
+	 * @return The state the network should have.
+	 */
+	virtual NetworkRecvStatus Receive_SERVER_LINKGRAPH_JOB(Packet *p);
+
+	/**
+	 * Send the profile of the vehicle ticks measured since the profiler was
+	 * last reset. Times are CPU cycles; they are only meaningful relative to
+	 * each other. Nothing is measured unless the profiler has been started
+	 * with the "vehicle_ticks" console command.
+	 * uint32  Number of measured ticks.
+	 * uint64  Time spent in all vehicle ticks.
+	 * uint8   Number of phases.
+	 * For each phase:
+	 * uint64  Time spent in the phase.
+	 * uint8   Number of vehicle types.
+	 * For each vehicle type:
+	 * uint64  Time spent in the tick handlers of the vehicle type.
+	 * uint64  Number of ticked vehicles of the vehicle type, summed over all measured ticks.
+	 * uint32  Date of the slowest of the last measured ticks.
+	 * uint16  Fraction of the date of the slowest of the last measured ticks.
+	 * uint64  Time spent in the slowest of the last measured ticks.
+	 * @param p The packet that was just received.
+	 * @return The state the network should have.
+	 */
+	virtual NetworkRecvStatus Receive_SERVER_VEHICLE_TICKS(Packet *p);
+
 	/**
 	 * Notify the admin connection that the rcon command has finished.
 	 * string The command as requested by the admin connection.
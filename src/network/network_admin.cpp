@@ -24,6 +24,7 @@
 #include "../map_func.h"
 #include "../rev.h"
 #include "../game/game.hpp"
+#include "../vehicle_func.h"
 
 
 /* This file handles all the admin network commands. */
@@ -54,6 +55,8 @@ static const AdminUpdateFrequency _admin_update_type_frequencies[] = {
 	ADMIN_FREQUENCY_POLL,                                                                                                                                  ///< ADMIN_UPDATE_CMD_NAMES
 	                       ADMIN_FREQUENCY_AUTOMATIC,                                                                                                      ///< ADMIN_UPDATE_CMD_LOGGING
 	                       ADMIN_FREQUENCY_AUTOMATIC,                                                                                                      ///< ADMIN_UPDATE_GAMESCRIPT
+	                       ADMIN_FREQUENCY_AUTOMATIC,                                                                                                      ///< ADMIN_UPDATE_LINKGRAPH_JOBS
+	ADMIN_FREQUENCY_POLL | ADMIN_FREQUENCY_DAILY | ADMIN_FREQUENCY_WEEKLY | ADMIN_FREQUENCY_MONTHLY | ADMIN_FREQUENCY_QUARTERLY | ADMIN_FREQUENCY_ANUALLY, ///< ADMIN_UPDATE_VEHICLE_TICKS
 };
 /** Sanity check. */
 assert_compile(lengthof(_admin_update_type_frequencies) == ADMIN_UPDATE_END);
@@ -661,6 +664,69 @@ NetworkRecvStatus ServerNetworkAdminSocketHandler::SendCmdLogging(ClientID clien
 	return NETWORK_RECV_STATUS_OKAY;
 }
 
+/**
+ * Send the timings of a joined link graph job.
+ * @param timings The timings of the job.
+ */
+NetworkRecvStatus ServerNetworkAdminSocketHandler::SendLinkGraphJob(const LinkGraphSchedule::JobTimings &timings)
+{
+	Packet *p = new Packet(ADMIN_PACKET_SERVER_LINKGRAPH_JOB);
+
+	p->Send_uint16(timings.link_graph);
+	p->Send_uint8 (timings.cargo);
+	p->Send_uint16(timings.nodes);
+	p->Send_uint32(timings.edges);
+	p->Send_uint32(timings.spawn_date);
+	p->Send_uint32(timings.join_date);
+	p->Send_uint64(timings.started - timings.spawned);
+	p->Send_uint64(timings.finished - timings.started);
+	p->Send_uint64(timings.join_wait);
+	p->Send_uint64(timings.merge);
+	p->Send_uint8 (LinkGraphSchedule::NUM_HANDLERS);
+	for (uint i = 0; i < LinkGraphSchedule::NUM_HANDLERS; i++) {
+		p->Send_uint64(timings.handlers[i]);
+	}
+
+	this->SendPacket(p);
+
+	return NETWORK_RECV_STATUS_OKAY;
+}
+
+/** Send the profile of the vehicle ticks. */
+NetworkRecvStatus ServerNetworkAdminSocketHandler::SendVehicleTicks()
+{
+	const VehicleTickProfile &total = GetVehicleTickProfileTotal();
+
+	/* Find the slowest of the ticks kept by the profiler. */
+	const VehicleTickProfile *slowest = NULL;
+	for (uint age = 0; age < VEHICLE_TICK_PROFILE_HISTORY; age++) {
+		const VehicleTickProfile *profile = GetVehicleTickProfile(age);
+		if (profile == NULL) break;
+		if (slowest == NULL || profile->total > slowest->total) slowest = profile;
+	}
+
+	Packet *p = new Packet(ADMIN_PACKET_SERVER_VEHICLE_TICKS);
+
+	p->Send_uint32(total.ticks);
+	p->Send_uint64(total.total);
+	p->Send_uint8 (VTP_END);
+	for (uint i = 0; i < VTP_END; i++) {
+		p->Send_uint64(total.phases[i]);
+	}
+	p->Send_uint8 (VEH_END);
+	for (uint i = 0; i < VEH_END; i++) {
+		p->Send_uint64(total.types[i]);
+		p->Send_uint64(total.vehicles[i]);
+	}
+	p->Send_uint32(slowest == NULL ? 0 : slowest->date);
+	p->Send_uint16(slowest == NULL ? 0 : slowest->date_fract);
+	p->Send_uint64(slowest == NULL ? 0 : slowest->total);
+
+	this->SendPacket(p);
+
+	return NETWORK_RECV_STATUS_OKAY;
+}
+
 /***********
  * Receiving functions
  ************/
@@ -776,6 +842,11 @@ NetworkRecvStatus ServerNetworkAdminSocketHandler::Receive_ADMIN_POLL(Packet *p)
 			this->SendCmdNames();
 			break;
 
+		case ADMIN_UPDATE_VEHICLE_TICKS:
+			/* The admin is requesting the profile of the vehicle ticks. */
+			this->SendVehicleTicks();
+			break;
+
 		default:
 			/* An unsupported "poll" update type. */
 			DEBUG(net, 3, "[admin] Not supported poll %d (%d) from '%s' (%s).", type, d1, this->admin_name, this->admin_version);
@@ -1002,6 +1073,21 @@ void NetworkAdminCmdLogging(const NetworkClientSocket *owner, const CommandPacke
 	}
 }
 
+/**
+ * Send the timings of a joined link graph job to the admin network (if they
+ * did opt in for the respective update).
+ * @param timings The timings of the job.
+ */
+void NetworkAdminLinkGraphJob(const LinkGraphSchedule::JobTimings &timings)
+{
+	ServerNetworkAdminSocketHandler *as;
+	FOR_ALL_ACTIVE_ADMIN_SOCKETS(as) {
+		if (as->update_frequency[ADMIN_UPDATE_LINKGRAPH_JOBS] & ADMIN_FREQUENCY_AUTOMATIC) {
+			as->SendLinkGraphJob(timings);
+		}
+	}
+}
+
 /**
  * Send a Welcome packet to all connected admins
  */
@@ -1037,6 +1123,10 @@ void NetworkAdminUpdate(AdminUpdateFrequency freq)
 						as->SendCompanyStats();
 						break;
 
+					case ADMIN_UPDATE_VEHICLE_TICKS:
+						as->SendVehicleTicks();
+						break;
+
 					default: NOT_REACHED();
 				}
 			}
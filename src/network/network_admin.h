@@ -17,6 +17,7 @@
 #include "network_internal.h"
 #include "core/tcp_listen.h"
 #include "core/tcp_admin.h"
+#include "../linkgraph/linkgraphschedule.h"
 
 extern AdminIndex _redirect_console_to_admin;
 
@@ -71,6 +72,8 @@ public:
 	NetworkRecvStatus SendGameScript(const char *json);
 	NetworkRecvStatus SendCmdNames();
 	NetworkRecvStatus SendCmdLogging(ClientID client_id, const CommandPacket *cp);
+	NetworkRecvStatus SendLinkGraphJob(const LinkGraphSchedule::JobTimings &timings);
+	NetworkRecvStatus SendVehicleTicks();
 	NetworkRecvStatus SendRconEnd(const char *command);
 
 	static void Send();
@@ -123,6 +126,7 @@ void NetworkServerSendAdminRcon(AdminIndex admin_index, TextColour colour_code,
 void NetworkAdminConsole(const char *origin, const char *string);
 void NetworkAdminGameScript(const char *json);
 void NetworkAdminCmdLogging(const NetworkClientSocket *owner, const CommandPacket *cp);
+void NetworkAdminLinkGraphJob(const LinkGraphSchedule::JobTimings &timings);
 
 #endif /* ENABLE_NETWORK */
 #endif /* NETWORK_ADMIN_H */
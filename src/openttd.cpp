@@ -1321,6 +1321,8 @@ static void CheckCaches()
 	/* Check whether the caches are still valid */
 	FOR_ALL_VEHICLES(v) {
 		byte buff[sizeof(VehicleCargoList)];
+		/* Pending aging changes the packets, but not the caches. */
+		v->cargo.ApplyAging();
 		memcpy(buff, &v->cargo, sizeof(VehicleCargoList));
 		v->cargo.InvalidateCache();
 		assert(memcmp(&v->cargo, buff, sizeof(VehicleCargoList)) == 0);
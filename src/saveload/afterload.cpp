@@ -2915,6 +2915,17 @@ bool AfterLoadGame()
 	}
 
 
+	/* Vehicles of older savegames keep running their daily handlers in the tick
+	 * of the day given by their ID, as set when they were constructed. Invalid
+	 * ticks in newer savegames are reset to that, too. */
+	{
+		Vehicle *v;
+		FOR_ALL_VEHICLES(v) {
+			if (v->day_proc_slot >= DAY_TICKS) v->day_proc_slot = v->index % DAY_TICKS;
+		}
+	}
+	RebuildVehicleDayProcLists();
+
 	/* Station acceptance is some kind of cache */
 	if (IsSavegameVersionBefore(127)) {
 		Station *st;
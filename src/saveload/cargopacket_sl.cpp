@@ -114,8 +114,11 @@ const SaveLoad *GetCargoPacketDesc()
  */
 static void Save_CAPA()
 {
-	CargoPacket *cp;
+	/* Vehicles only age their packets when needed. */
+	Vehicle *v;
+	FOR_ALL_VEHICLES(v) v->cargo.ApplyAging();
 
+	CargoPacket *cp;
 	FOR_ALL_CARGOPACKETS(cp) {
 		SlSetArrayIndex(cp->index);
 		SlObject(cp, GetCargoPacketDesc());
@@ -20,6 +20,9 @@ typedef LinkGraph::BaseNode Node;
 typedef LinkGraph::BaseEdge Edge;
 
 const SettingDesc *GetSettingDescription(uint index);
+uint32 CountFlows(const FlowStatMap &flows);
+void SaveFlows(const FlowStatMap &flows);
+void LoadFlows(FlowStatMap &flows, uint32 num_flows);
 
 static uint _num_nodes;
 
@@ -72,10 +75,18 @@ const SaveLoad *GetLinkGraphJobDesc()
 			desc = GetSettingDescription(++setting);
 		}
 
+		/* The job's copy of the link graph header is saved in the same way
+		 * as a link graph, see GetLinkGraphDesc. */
 		const SaveLoad job_desc[] = {
-			SLE_VAR(LinkGraphJob, join_date,        SLE_INT32),
-			SLE_VAR(LinkGraphJob, link_graph.index, SLE_UINT16),
-			SLE_END()
+			 SLE_VAR(LinkGraphJob, join_date,        SLE_INT32),
+			 SLE_VAR(LinkGraphJob, link_graph_index, SLE_UINT16),
+			 SLE_VAR(LinkGraphJob, last_compression, SLE_INT32),
+			SLEG_VAR(_num_nodes,                     SLE_UINT16),
+			 SLE_VAR(LinkGraphJob, cargo,            SLE_UINT8),
+			SLE_CONDVAR(LinkGraphJob, join_delay,    SLE_UINT16, SL_LINKGRAPH_MERGE_VER, SL_MAX_VERSION),
+			SLE_CONDVAR(LinkGraphJob, merged_nodes,  SLE_UINT16, SL_LINKGRAPH_MERGE_VER, SL_MAX_VERSION),
+			SLE_CONDVAR(LinkGraphJob, joined,        SLE_BOOL,   SL_LINKGRAPH_MERGE_VER, SL_MAX_VERSION),
+			 SLE_END()
 		};
 
 		int i = 0;
@@ -96,6 +107,7 @@ const SaveLoad *GetLinkGraphScheduleDesc()
 	static const SaveLoad schedule_desc[] = {
 		SLE_LST(LinkGraphSchedule, schedule, REF_LINK_GRAPH),
 		SLE_LST(LinkGraphSchedule, running,  REF_LINK_GRAPH_JOB),
+		SLE_CONDLST(LinkGraphSchedule, merging, REF_LINK_GRAPH_JOB, SL_LINKGRAPH_MERGE_VER, SL_MAX_VERSION),
 		SLE_END()
 	};
 	return schedule_desc;
@@ -107,13 +119,27 @@ const SaveLoad *GetLinkGraphScheduleDesc()
  * SaveLoad desc for a link graph node.
  */
 static const SaveLoad _node_desc[] = {
-	SLE_VAR(Node, supply,      SLE_UINT32),
-	SLE_VAR(Node, demand,      SLE_UINT32),
-	SLE_VAR(Node, station,     SLE_UINT16),
-	SLE_VAR(Node, last_update, SLE_INT32),
-	SLE_END()
+	    SLE_VAR(Node, supply,      SLE_UINT32),
+	    SLE_VAR(Node, demand,      SLE_UINT32),
+	    SLE_VAR(Node, station,     SLE_UINT16),
+	SLE_CONDVAR(Node, xy,          SLE_UINT32, SL_LINKGRAPH_NODE_XY_VER, SL_MAX_VERSION),
+	    SLE_VAR(Node, last_update, SLE_INT32),
+	    SLE_END()
 };
 
+/**
+ * Set the location of a node loaded from a savegame predating node locations.
+ * If the station doesn't exist anymore the location doesn't matter as the
+ * node's flows will be discarded anyway.
+ * @param node Node to be updated.
+ */
+static void LoadNodeLocation(Node *node)
+{
+	if (!IsSavegameVersionBefore(SL_LINKGRAPH_NODE_XY_VER)) return;
+	const Station *st = Station::GetIfValid(node->station);
+	node->xy = st != NULL ? st->xy : 0;
+}
+
 /**
  * SaveLoad desc for a link graph edge.
  */
@@ -127,6 +153,67 @@ static const SaveLoad _edge_desc[] = {
 	    SLE_END()
 };
 
+static uint _num_cache_nodes;
+static uint _num_cache_demands;
+
+/**
+ * SaveLoad desc for the header of a demand cache.
+ */
+static const SaveLoad _demand_cache_desc[] = {
+	SLEG_VAR(_num_cache_nodes,   SLE_UINT16),
+	SLEG_VAR(_num_cache_demands, SLE_UINT32),
+	 SLE_VAR(LinkGraph::DemandCache, runtime,         SLE_INT32),
+	 SLE_VAR(LinkGraph::DemandCache, distribution,    SLE_UINT8),
+	 SLE_VAR(LinkGraph::DemandCache, accuracy,        SLE_UINT8),
+	 SLE_VAR(LinkGraph::DemandCache, demand_size,     SLE_UINT8),
+	 SLE_VAR(LinkGraph::DemandCache, demand_distance, SLE_UINT8),
+	 SLE_END()
+};
+
+/**
+ * Save/load the demands cached in a link graph or link graph job.
+ * @param cache Demand cache to be saved or loaded.
+ */
+static void SaveLoad_DemandCache(LinkGraph::DemandCache &cache)
+{
+	if (IsSavegameVersionBefore(SL_DEMAND_CACHE_VER)) return;
+
+	_num_cache_nodes = cache.nodes.Length();
+	_num_cache_demands = cache.targets.Length();
+	SlObject(&cache, _demand_cache_desc);
+	if (_num_cache_nodes == 0) return;
+
+	cache.nodes.Resize(_num_cache_nodes);
+	cache.offsets.Resize(_num_cache_nodes + 1);
+	cache.targets.Resize(_num_cache_demands);
+	cache.amounts.Resize(_num_cache_demands);
+	for (NodeID node = 0; node < _num_cache_nodes; ++node) {
+		SlObject(&cache.nodes[node], _node_desc);
+	}
+	SlArray(cache.offsets.Begin(), _num_cache_nodes + 1, SLE_UINT32);
+	SlArray(cache.targets.Begin(), _num_cache_demands, SLE_UINT16);
+	SlArray(cache.amounts.Begin(), _num_cache_demands, SLE_UINT32);
+}
+
+static uint32 _edge_flow;
+static uint32 _num_node_flows;
+
+/**
+ * SaveLoad desc for the planned flow over an edge of a joined job.
+ */
+static const SaveLoad _edge_flow_desc[] = {
+	SLEG_VAR(_edge_flow, SLE_UINT32),
+	 SLE_END()
+};
+
+/**
+ * SaveLoad desc for the header of the planned flows of a joined job's node.
+ */
+static const SaveLoad _node_flows_desc[] = {
+	SLEG_VAR(_num_node_flows, SLE_UINT32),
+	 SLE_END()
+};
+
 /**
  * Save/load a link graph.
  * @param comp Link graph to be saved or loaded.
@@ -137,10 +224,114 @@ void SaveLoad_LinkGraph(LinkGraph &lg)
 	for (NodeID from = 0; from < size; ++from) {
 		Node *node = &lg.nodes[from];
 		SlObject(node, _node_desc);
+		LoadNodeLocation(node);
 		for (NodeID to = 0; to < size; ++to) {
 			SlObject(&lg.edges[from][to], _edge_desc);
 		}
 	}
+	SaveLoad_DemandCache(lg.demand_cache);
+}
+
+/**
+ * Save the link graph copied into a link graph job. The packed edges are
+ * expanded again, so that the result is the same as for a link graph.
+ * @param lgj Link graph job to be saved.
+ */
+void SaveLinkGraphJobGraph(LinkGraphJob &lgj)
+{
+	uint size = lgj.Size();
+	SmallVector<uint, 16> row;
+	row.Resize(size);
+	for (NodeID from = 0; from < size; ++from) {
+		Node *node = &lgj.graph_nodes[from];
+		SlObject(node, _node_desc);
+
+		uint first = lgj.edge_offsets[from];
+		uint last = lgj.edge_offsets[from + 1];
+		for (NodeID to = 0; to < size; ++to) row[to] = UINT_MAX;
+		for (uint i = first; i < last; ++i) row[lgj.edge_targets[i]] = i;
+
+		for (NodeID to = 0; to < size; ++to) {
+			Edge edge;
+			if (row[to] != UINT_MAX) {
+				edge = lgj.graph_edges[row[to]];
+				edge.next_edge = row[to] + 1 < last ? lgj.edge_targets[row[to] + 1] : INVALID_NODE;
+			} else {
+				edge.Init(DistanceManhattan(node->xy, lgj.graph_nodes[to].xy));
+				if (to == from && first < last) edge.next_edge = lgj.edge_targets[first];
+			}
+			SlObject(&edge, _edge_desc);
+		}
+	}
+	SaveLoad_DemandCache(lgj.demand_cache);
+	if (!lgj.joined) return;
+
+	/* Save the results of the nodes which haven't been merged, yet. */
+	for (NodeID from = lgj.merged_nodes; from < size; ++from) {
+		for (uint i = lgj.edge_offsets[from]; i < lgj.edge_offsets[from + 1]; ++i) {
+			_edge_flow = lgj.edges[i].flow;
+			SlObject(NULL, _edge_flow_desc);
+		}
+		const FlowStatMap &flows = lgj.nodes[from].flows;
+		_num_node_flows = CountFlows(flows);
+		SlObject(NULL, _node_flows_desc);
+		SaveFlows(flows);
+	}
+}
+
+/**
+ * Load the link graph of a link graph job and pack its edges, sorted by their remote ends.
+ * @param lgj Link graph job to be loaded.
+ */
+void LoadLinkGraphJobGraph(LinkGraphJob &lgj)
+{
+	uint size = _num_nodes;
+	SmallVector<Edge, 16> row;
+	row.Resize(size);
+	lgj.graph_nodes.Resize(size);
+	lgj.edge_offsets.Resize(size + 1);
+	for (NodeID from = 0; from < size; ++from) {
+		Node *node = &lgj.graph_nodes[from];
+		SlObject(node, _node_desc);
+		LoadNodeLocation(node);
+		for (NodeID to = 0; to < size; ++to) {
+			row[to].Init();
+			SlObject(&row[to], _edge_desc);
+		}
+
+		uint first = lgj.edge_targets.Length();
+		lgj.edge_offsets[from] = first;
+		for (NodeID to = row[from].next_edge; to != INVALID_NODE; to = row[to].next_edge) {
+			*lgj.edge_targets.Append() = to;
+		}
+		/* Older savegames have the edges in the order of the link graph's edge lists. */
+		std::sort(lgj.edge_targets.Begin() + first, lgj.edge_targets.End());
+		for (uint i = first; i < lgj.edge_targets.Length(); ++i) {
+			*lgj.graph_edges.Append() = row[lgj.edge_targets[i]];
+		}
+	}
+	lgj.edge_offsets[size] = lgj.edge_targets.Length();
+	SaveLoad_DemandCache(lgj.demand_cache);
+
+	/* The spawn date isn't saved; the join date has been moved by the postponements since. */
+	lgj.spawn_date = lgj.join_date - lgj.join_delay - lgj.settings.recalc_time;
+	if (!lgj.joined) return;
+
+	/* Load the results of the nodes which haven't been merged, yet. The
+	 * demand annotations aren't needed for merging and stay empty. */
+	lgj.nodes.Resize(size);
+	for (NodeID node = 0; node < size; ++node) lgj.nodes[node].Init(0);
+	uint num_edges = lgj.NumEdges();
+	lgj.edges.Resize(num_edges);
+	for (uint i = 0; i < num_edges; ++i) lgj.edges[i].Init();
+	for (NodeID from = lgj.merged_nodes; from < size; ++from) {
+		for (uint i = lgj.edge_offsets[from]; i < lgj.edge_offsets[from + 1]; ++i) {
+			SlObject(NULL, _edge_flow_desc);
+			lgj.edges[i].flow = _edge_flow;
+		}
+		SlObject(NULL, _node_flows_desc);
+		LoadFlows(lgj.nodes[from].flows, _num_node_flows);
+	}
 }
 
 /**
@@ -149,10 +340,9 @@ void SaveLoad_LinkGraph(LinkGraph &lg)
  */
 static void DoSave_LGRJ(LinkGraphJob *lgj)
 {
-	SlObject(lgj, GetLinkGraphJobDesc());
 	_num_nodes = lgj->Size();
-	SlObject(const_cast<LinkGraph *>(&lgj->Graph()), GetLinkGraphDesc());
-	SaveLoad_LinkGraph(const_cast<LinkGraph &>(lgj->Graph()));
+	SlObject(lgj, GetLinkGraphJobDesc());
+	SaveLinkGraphJobGraph(*lgj);
 }
 
 /**
@@ -197,10 +387,7 @@ static void Load_LGRJ()
 		}
 		LinkGraphJob *lgj = new (index) LinkGraphJob();
 		SlObject(lgj, GetLinkGraphJobDesc());
-		LinkGraph &lg = const_cast<LinkGraph &>(lgj->Graph());
-		SlObject(&lg, GetLinkGraphDesc());
-		lg.Init(_num_nodes);
-		SaveLoad_LinkGraph(lg);
+		LoadLinkGraphJobGraph(*lgj);
 	}
 }
 
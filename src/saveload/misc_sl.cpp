@@ -24,6 +24,7 @@
 extern TileIndex _cur_tileloop_tile;
 extern uint16 _disaster_delay;
 extern byte _trees_tick_ctr;
+extern uint32 _day_proc_weights[DAY_TICKS];
 
 /* Keep track of current game position */
 int _saved_scrollpos_x;
@@ -90,6 +91,7 @@ static const SaveLoadGlobVarList _date_desc[] = {
 	    SLEG_VAR(_trees_tick_ctr,         SLE_UINT8),
 	SLEG_CONDVAR(_pause_mode,             SLE_UINT8,                   4, SL_MAX_VERSION),
 	SLE_CONDNULL(4, 11, 119),
+	SLEG_CONDARR(_day_proc_weights,       SLE_UINT32, DAY_TICKS, SL_VEHICLE_DAY_PROC_VER, SL_MAX_VERSION),
 	    SLEG_END()
 };
 
@@ -115,6 +117,7 @@ static const SaveLoadGlobVarList _date_check_desc[] = {
 	    SLE_NULL(1),                       // _trees_tick_ctr
 	SLE_CONDNULL(1, 4, SL_MAX_VERSION),    // _pause_mode
 	SLE_CONDNULL(4, 11, 119),
+	SLE_CONDNULL(4 * DAY_TICKS, SL_VEHICLE_DAY_PROC_VER, SL_MAX_VERSION), // _day_proc_weights
 	    SLEG_END()
 };
 
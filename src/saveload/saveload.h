@@ -16,6 +16,14 @@
 #include "../strings_type.h"
 
 #define SL_TTSEP_VER 200
+#define SL_PATH_SEARCH_BATCH_VER 201
+#define SL_LINKGRAPH_NODE_XY_VER 202
+#define SL_LINKGRAPH_JOBS_PER_INTERVAL_VER 203
+#define SL_DEMAND_CACHE_VER 204
+#define SL_LINKGRAPH_MERGE_VER 205
+#define SL_LINKGRAPH_REGIONS_VER 206
+#define SL_CARGO_COMPACTION_VER 207
+#define SL_VEHICLE_DAY_PROC_VER 208
 
 /** Save or load result codes. */
 enum SaveOrLoadResult {
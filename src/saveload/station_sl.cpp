@@ -309,18 +309,32 @@ static void SwapPackets(GoodsEntry *ge)
 	StationCargoPacketMap &ge_packets = const_cast<StationCargoPacketMap &>(*ge->cargo.Packets());
 
 	if (_packets.empty()) {
-		std::map<StationID, std::list<CargoPacket *> >::iterator it(ge_packets.find(INVALID_STATION));
+		StationCargoPacketMap::MapIterator it(ge_packets.find(INVALID_STATION));
 		if (it == ge_packets.end()) {
 			return;
 		} else {
-			it->second.swap(_packets);
+			_packets.assign(it->second.begin(), it->second.end());
+			ge_packets.erase(it);
 		}
 	} else {
-		assert(ge_packets[INVALID_STATION].empty());
-		ge_packets[INVALID_STATION].swap(_packets);
+		assert(ge_packets.find(INVALID_STATION) == ge_packets.end());
+		ge_packets[INVALID_STATION].assign(_packets.begin(), _packets.end());
+		_packets.clear();
 	}
 }
 
+/**
+ * Save, load or fix the pointers of the packets for one next hop. The packets
+ * are stored in a std::list for that, as SLE_LST expects one.
+ * @param it Next hop and its packets.
+ */
+static void SlCargoList(StationCargoPacketMap::MapIterator it)
+{
+	StationCargoPair pair(it->first, std::list<CargoPacket *>(it->second.begin(), it->second.end()));
+	SlObject(&pair, _cargo_list_desc);
+	it->second.assign(pair.second.begin(), pair.second.end());
+}
+
 static void Load_STNS()
 {
 	int index;
@@ -461,6 +475,63 @@ const SaveLoad *GetBaseStationDescription()
 	return _base_station_desc;
 }
 
+/**
+ * Count the flows of a flow map, one per share of each flow stat.
+ * @param flows Flow map to be saved.
+ * @return Number of flows SaveFlows will write.
+ */
+uint32 CountFlows(const FlowStatMap &flows)
+{
+	uint32 num_flows = 0;
+	for (FlowStatMap::const_iterator it(flows.begin()); it != flows.end(); ++it) {
+		num_flows += (uint32)it->second.GetShares()->size();
+	}
+	return num_flows;
+}
+
+/**
+ * Save the flows of a flow map. The number of flows has to be saved before.
+ * @param flows Flow map to be saved.
+ */
+void SaveFlows(const FlowStatMap &flows)
+{
+	for (FlowStatMap::const_iterator outer_it(flows.begin()); outer_it != flows.end(); ++outer_it) {
+		const FlowStat::SharesMap *shares = outer_it->second.GetShares();
+		uint32 sum_shares = 0;
+		FlowSaveLoad flow;
+		flow.source = outer_it->first;
+		for (FlowStat::SharesMap::const_iterator inner_it(shares->begin()); inner_it != shares->end(); ++inner_it) {
+			flow.via = inner_it->second;
+			flow.share = inner_it->first - sum_shares;
+			flow.restricted = inner_it->first > outer_it->second.GetUnrestricted();
+			sum_shares = inner_it->first;
+			assert(flow.share > 0);
+			SlObject(&flow, _flow_desc);
+		}
+	}
+}
+
+/**
+ * Load flows into a flow map.
+ * @param flows Flow map to load the flows into.
+ * @param num_flows Number of flows to be loaded.
+ */
+void LoadFlows(FlowStatMap &flows, uint32 num_flows)
+{
+	FlowSaveLoad flow;
+	FlowStat *fs = NULL;
+	StationID prev_source = INVALID_STATION;
+	for (uint32 j = 0; j < num_flows; ++j) {
+		SlObject(&flow, _flow_desc);
+		if (fs == NULL || prev_source != flow.source) {
+			fs = &(flows.insert(std::make_pair(flow.source, FlowStat(flow.via, flow.share))).first->second);
+		} else {
+			fs->AppendShare(flow.via, flow.share, flow.restricted);
+		}
+		prev_source = flow.source;
+	}
+}
+
 static void RealSave_STNN(BaseStation *bst)
 {
 	bool waypoint = (bst->facilities & FACIL_WAYPOINT) != 0;
@@ -470,27 +541,12 @@ static void RealSave_STNN(BaseStation *bst)
 		Station *st = Station::From(bst);
 		for (CargoID i = 0; i < NUM_CARGO; i++) {
 			_num_dests = (uint32)st->goods[i].cargo.Packets()->MapSize();
-			_num_flows = 0;
-			for (FlowStatMap::const_iterator it(st->goods[i].flows.begin()); it != st->goods[i].flows.end(); ++it) {
-				_num_flows += (uint32)it->second.GetShares()->size();
-			}
+			_num_flows = CountFlows(st->goods[i].flows);
 			SlObject(&st->goods[i], GetGoodsDesc());
-			for (FlowStatMap::const_iterator outer_it(st->goods[i].flows.begin()); outer_it != st->goods[i].flows.end(); ++outer_it) {
-				const FlowStat::SharesMap *shares = outer_it->second.GetShares();
-				uint32 sum_shares = 0;
-				FlowSaveLoad flow;
-				flow.source = outer_it->first;
-				for (FlowStat::SharesMap::const_iterator inner_it(shares->begin()); inner_it != shares->end(); ++inner_it) {
-					flow.via = inner_it->second;
-					flow.share = inner_it->first - sum_shares;
-					flow.restricted = inner_it->first > outer_it->second.GetUnrestricted();
-					sum_shares = inner_it->first;
-					assert(flow.share > 0);
-					SlObject(&flow, _flow_desc);
-				}
-			}
-			for (StationCargoPacketMap::ConstMapIterator it(st->goods[i].cargo.Packets()->begin()); it != st->goods[i].cargo.Packets()->end(); ++it) {
-				SlObject(const_cast<StationCargoPacketMap::value_type *>(&(*it)), _cargo_list_desc);
+			SaveFlows(st->goods[i].flows);
+			StationCargoPacketMap &packets = const_cast<StationCargoPacketMap &>(*st->goods[i].cargo.Packets());
+			for (StationCargoPacketMap::MapIterator it(packets.begin()); it != packets.end(); ++it) {
+				SlCargoList(it);
 			}
 		}
 	}
@@ -533,26 +589,17 @@ static void Load_STNN()
 
 			for (CargoID i = 0; i < NUM_CARGO; i++) {
 				SlObject(&st->goods[i], GetGoodsDesc());
-				FlowSaveLoad flow;
-				FlowStat *fs = NULL;
-				StationID prev_source = INVALID_STATION;
-				for (uint32 j = 0; j < _num_flows; ++j) {
-					SlObject(&flow, _flow_desc);
-					if (fs == NULL || prev_source != flow.source) {
-						fs = &(st->goods[i].flows.insert(std::make_pair(flow.source, FlowStat(flow.via, flow.share))).first->second);
-					} else {
-						fs->AppendShare(flow.via, flow.share, flow.restricted);
-					}
-					prev_source = flow.source;
-				}
+				LoadFlows(st->goods[i].flows, _num_flows);
 				if (IsSavegameVersionBefore(183)) {
 					SwapPackets(&st->goods[i]);
 				} else {
 					StationCargoPair pair;
 					for (uint j = 0; j < _num_dests; ++j) {
 						SlObject(&pair, _cargo_list_desc);
-						const_cast<StationCargoPacketMap &>(*(st->goods[i].cargo.Packets()))[pair.first].swap(pair.second);
-						assert(pair.second.empty());
+						/* Older versions may have saved empty lists. */
+						if (pair.second.empty()) continue;
+						const_cast<StationCargoPacketMap &>(*(st->goods[i].cargo.Packets()))[pair.first].assign(pair.second.begin(), pair.second.end());
+						pair.second.clear();
 					}
 				}
 			}
@@ -583,8 +630,9 @@ static void Ptrs_STNN()
 				SwapPackets(ge);
 			} else {
 				SlObject(ge, GetGoodsDesc());
-				for (StationCargoPacketMap::ConstMapIterator it = ge->cargo.Packets()->begin(); it != ge->cargo.Packets()->end(); ++it) {
-					SlObject(const_cast<StationCargoPair *>(&(*it)), _cargo_list_desc);
+				StationCargoPacketMap &packets = const_cast<StationCargoPacketMap &>(*ge->cargo.Packets());
+				for (StationCargoPacketMap::MapIterator it = packets.begin(); it != packets.end(); ++it) {
+					SlCargoList(it);
 				}
 			}
 		}
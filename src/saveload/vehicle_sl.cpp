@@ -22,6 +22,7 @@
 
 #include "saveload.h"
 
+#include <list>
 #include <map>
 
 /**
@@ -559,6 +560,7 @@ static uint16 _cargo_count;
 static uint16 _cargo_paid_for;
 static Money  _cargo_feeder_share;
 static uint32 _cargo_loaded_at_xy;
+static std::list<CargoPacket *> _cargo_packets; ///< Temporary storage for the cargo packets of a vehicle.
 
 /**
  * Make it possible to make the saveload tables "friends" of other classes.
@@ -615,11 +617,12 @@ const SaveLoad *GetVehicleDescription(VehicleType vt)
 		     SLE_VAR(Vehicle, cargo_cap,             SLE_UINT16),
 		 SLE_CONDVAR(Vehicle, refit_cap,             SLE_UINT16,                 182, SL_MAX_VERSION),
 		SLEG_CONDVAR(         _cargo_count,          SLE_UINT16,                   0,  67),
-		 SLE_CONDLST(Vehicle, cargo.packets,         REF_CARGO_PACKET,            68, SL_MAX_VERSION),
+		SLEG_CONDLST(         _cargo_packets,        REF_CARGO_PACKET,            68, SL_MAX_VERSION),
 		 SLE_CONDARR(Vehicle, cargo.action_counts,   SLE_UINT, VehicleCargoList::NUM_MOVE_TO_ACTION, 181, SL_MAX_VERSION),
 		 SLE_CONDVAR(Vehicle, cargo_age_counter,     SLE_UINT16,                 162, SL_MAX_VERSION),
 
 		     SLE_VAR(Vehicle, day_counter,           SLE_UINT8),
+		 SLE_CONDVAR(Vehicle, day_proc_slot,         SLE_UINT8,                  SL_VEHICLE_DAY_PROC_VER, SL_MAX_VERSION),
 		     SLE_VAR(Vehicle, tick_counter,          SLE_UINT8),
 		 SLE_CONDVAR(Vehicle, running_ticks,         SLE_UINT8,                   88, SL_MAX_VERSION),
 
@@ -866,8 +869,11 @@ static void Save_VEHS()
 	/* Write the vehicles */
 	FOR_ALL_VEHICLES(v) {
 		SlSetArrayIndex(v->index);
+		const CargoPacketList *packets = v->cargo.Packets();
+		_cargo_packets.assign(packets->begin(), packets->end());
 		SlObject(v, GetVehicleDescription(v->type));
 	}
+	_cargo_packets.clear();
 }
 
 /** Will be called when vehicles need to be loaded. */
@@ -894,6 +900,16 @@ void Load_VEHS()
 
 		SlObject(v, GetVehicleDescription(vtype));
 
+		/* The list only holds the references, yet. Keep the packet IDs, the
+		 * packets themselves are checked in Ptrs_VEHS. */
+		CargoPacketList &packets = const_cast<CargoPacketList &>(*v->cargo.Packets());
+		for (std::list<CargoPacket *>::iterator it = _cargo_packets.begin(); it != _cargo_packets.end(); ++it) {
+			size_t ref = (size_t)*it;
+			if (ref == 0) SlErrorCorrupt("Referencing invalid CargoPacket");
+			packets.push_back((CargoPacketID)(ref - 1));
+		}
+		_cargo_packets.clear();
+
 		if (_cargo_count != 0 && IsCompanyBuildableVehicleType(v) && CargoPacket::CanAllocateItem()) {
 			/* Don't construct the packet with station here, because that'll fail with old savegames */
 			CargoPacket *cp = new CargoPacket(_cargo_count, _cargo_days, _cargo_source, _cargo_source_xy, _cargo_loaded_at_xy, _cargo_feeder_share);
@@ -924,6 +940,11 @@ static void Ptrs_VEHS()
 	Vehicle *v;
 	FOR_ALL_VEHICLES(v) {
 		SlObject(v, GetVehicleDescription(v->type));
+
+		const CargoPacketList *packets = v->cargo.Packets();
+		for (CargoPacketList::Iterator it = packets->begin(); it != packets->end(); ++it) {
+			if (!CargoPacket::IsValidID(it.GetID())) SlErrorCorrupt("Referencing invalid CargoPacket");
+		}
 	}
 }
 
@@ -1590,6 +1590,8 @@ static SettingEntry _settings_economy[] = {
 	SettingEntry("economy.smooth_economy"),
 	SettingEntry("economy.feeder_payment_share"),
 	SettingEntry("economy.infrastructure_maintenance"),
+	SettingEntry("economy.cargo_compaction_interval"),
+	SettingEntry("economy.cargo_compaction_transit"),
 	SettingEntry("difficulty.vehicle_costs"),
 	SettingEntry("difficulty.construction_cost"),
 	SettingEntry("difficulty.disasters"),
@@ -1600,6 +1602,9 @@ static SettingsPage _settings_economy_page = {_settings_economy, lengthof(_setti
 static SettingEntry _settings_linkgraph[] = {
 	SettingEntry("linkgraph.recalc_time"),
 	SettingEntry("linkgraph.recalc_interval"),
+	SettingEntry("linkgraph.jobs_per_interval"),
+	SettingEntry("linkgraph.max_join_delay"),
+	SettingEntry("linkgraph.merge_batch"),
 	SettingEntry("linkgraph.distribution_pax"),
 	SettingEntry("linkgraph.distribution_mail"),
 	SettingEntry("linkgraph.distribution_armoured"),
@@ -1607,7 +1612,11 @@ static SettingEntry _settings_linkgraph[] = {
 	SettingEntry("linkgraph.accuracy"),
 	SettingEntry("linkgraph.demand_distance"),
 	SettingEntry("linkgraph.demand_size"),
+	SettingEntry("linkgraph.demand_recalc_threshold"),
 	SettingEntry("linkgraph.short_path_saturation"),
+	SettingEntry("linkgraph.path_search_batch"),
+	SettingEntry("linkgraph.hierarchical_threshold"),
+	SettingEntry("linkgraph.region_size"),
 };
 /** Linkgraph sub-page */
 static SettingsPage _settings_linkgraph_page = {_settings_linkgraph, lengthof(_settings_linkgraph)};
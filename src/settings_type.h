@@ -103,6 +103,7 @@ struct GUISettings {
 	bool   disable_unsuitable_building;      ///< disable infrastructure building when no suitable vehicles are available
 	byte   autosave;                         ///< how often should we do autosaves?
 	bool   threaded_saves;                   ///< should we do threaded saves?
+	uint8  linkgraph_threads;                ///< number of worker threads for link graph calculations (0 = number of CPU cores), only read at startup
 	bool   keep_all_autosave;                ///< name the autosave in a different way
 	bool   autosave_on_exit;                 ///< save an autosave when you quit the game, but do not ask "Do you really want to quit?"
 	uint8  date_format_in_default_names;     ///< should the default savegame/screenshot name use long dates (31th Dec 2008), short dates (31-12-2008) or ISO dates (2008-12-31)
@@ -487,11 +488,16 @@ struct EconomySettings {
 	uint16 town_noise_population[3];         ///< population to base decision on noise evaluation (@see town_council_tolerance)
 	bool   allow_town_level_crossings;       ///< towns are allowed to build level crossings
 	bool   infrastructure_maintenance;       ///< enable monthly maintenance fee for owner infrastructure
+	uint16 cargo_compaction_interval;        ///< number of days between merging compatible cargo packets in each cargo list (0 = never)
+	uint8  cargo_compaction_transit;         ///< size of the buckets of days in transit of cargo packets which may be merged
 };
 
 struct LinkGraphSettings {
 	uint16 recalc_time;                         ///< time (in days) for recalculating each link graph component.
 	uint16 recalc_interval;                     ///< time (in days) between subsequent checks for link graphs to be calculated.
+	uint8 jobs_per_interval;                    ///< number of link graph jobs spawned and joined at once.
+	uint16 max_join_delay;                      ///< maximum number of days a link graph job may be postponed if its calculation isn't finished in time (0 = never postpone)
+	uint16 merge_batch;                         ///< number of nodes whose flows are merged into the stations per tick after joining a link graph job (0 = all at once)
 	DistributionTypeByte distribution_pax;      ///< distribution type for passengers
 	DistributionTypeByte distribution_mail;     ///< distribution type for mail
 	DistributionTypeByte distribution_armoured; ///< distribution type for armoured cargo class
@@ -499,7 +505,11 @@ struct LinkGraphSettings {
 	uint8 accuracy;                             ///< accuracy when calculating things on the link graph. low accuracy => low running time
 	uint8 demand_size;                          ///< influence of supply ("station size") on the demand function
 	uint8 demand_distance;                      ///< influence of distance between stations on the demand function
+	uint8 demand_recalc_threshold;              ///< change of supply or acceptance (in percent) beyond which the cached demands of a station are recalculated (0 = no caching)
 	uint8 short_path_saturation;                ///< percentage up to which short paths are saturated before saturating most capacious paths
+	uint8 path_search_batch;                    ///< number of source nodes whose paths are searched concurrently in the flow calculation
+	uint16 hierarchical_threshold;              ///< number of nodes beyond which components are calculated in regions (0 = never)
+	uint16 region_size;                         ///< number of nodes per region when calculating components in regions
 
 	inline DistributionType GetDistributionType(CargoID cargo) const {
 		if (IsCargoInClass(cargo, CC_PASSENGERS)) return this->distribution_pax;
@@ -62,7 +62,8 @@ Station::Station(TileIndex tile) :
 	indtype(IT_INVALID),
 	time_since_load(255),
 	time_since_unload(255),
-	last_vehicle_type(VEH_INVALID)
+	last_vehicle_type(VEH_INVALID),
+	catchment_index_area(INVALID_TILE, 0, 0)
 {
 	/* this->random_bits is set in Station::AddFacility() */
 }
@@ -126,6 +127,8 @@ Station::~Station()
 	/* Clear the persistent storage. */
 	delete this->airport.psa;
 
+	this->RemoveFromCatchmentIndex();
+
 	if (this->owner == OWNER_NONE) {
 		/* Invalidate all in case of oil rigs. */
 		InvalidateWindowClassesData(WC_STATION_LIST, 0);
@@ -353,11 +356,13 @@ static bool FindIndustryToDeliver(TileIndex ind_tile, void *user_data)
 
 /**
  * Recomputes Station::industries_near, list of industries possibly
- * accepting cargo in station's catchment radius
+ * accepting cargo in station's catchment radius. This is called whenever the
+ * catchment changes, so update the station's catchment index entry, too.
  */
 void Station::RecomputeIndustriesNear()
 {
 	this->industries_near.Clear();
+	this->UpdateCatchmentIndex();
 	if (this->rect.IsEmpty()) return;
 
 	RectAndIndustryVector riv = {
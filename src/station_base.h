@@ -19,7 +19,7 @@
 #include "industry_type.h"
 #include "linkgraph/linkgraph_type.h"
 #include "newgrf_storage.h"
-#include <map>
+#include "core/flatmap_type.hpp"
 
 typedef Pool<BaseStation, StationID, 32, 64000> StationPool;
 extern StationPool _station_pool;
@@ -28,21 +28,14 @@ static const byte INITIAL_STATION_RATING = 175;
 
 /**
  * Flow statistics telling how much flow should be sent along a link. This is
- * done by creating "flow shares" and using std::map's upper_bound() method to
- * look them up with a random number. A flow share is the difference between a
- * key in a map and the previous key. So one key in the map doesn't actually
- * mean anything by itself.
+ * done by creating "flow shares" and using a binary search (upper_bound()) on
+ * the sorted shares to look them up with a random number. A flow share is the
+ * difference between a key in a map and the previous key. So one key in the
+ * map doesn't actually mean anything by itself.
  */
 class FlowStat {
 public:
-	typedef std::map<uint32, StationID> SharesMap;
-
-	/**
-	 * Invalid constructor. This can't be called as a FlowStat must not be
-	 * empty. However, the constructor must be defined and reachable for
-	 * FlwoStat to be used in a std::map.
-	 */
-	inline FlowStat() {NOT_REACHED();}
+	typedef FlatMap<uint32, StationID> SharesMap;
 
 	/**
 	 * Create a FlowStat with an initial entry.
@@ -67,7 +60,7 @@ public:
 	inline void AppendShare(StationID st, uint flow, bool restricted = false)
 	{
 		assert(flow > 0);
-		this->shares[(--this->shares.end())->first + flow] = st;
+		this->shares[this->shares.rbegin()->first + flow] = st;
 		if (!restricted) this->unrestricted += flow;
 	}
 
@@ -116,7 +109,7 @@ public:
 	inline StationID GetViaWithRestricted(bool &is_restricted) const
 	{
 		assert(!this->shares.empty());
-		uint rand = RandomRange((--this->shares.end())->first);
+		uint rand = RandomRange(this->shares.rbegin()->first);
 		is_restricted = rand >= this->unrestricted;
 		return this->shares.upper_bound(rand)->second;
 	}
@@ -146,7 +139,7 @@ private:
 };
 
 /** Flow descriptions by origin stations. */
-class FlowStatMap : public std::map<StationID, FlowStat> {
+class FlowStatMap : public FlatMap<StationID, FlowStat, 8> {
 public:
 	void AddFlow(StationID origin, StationID via, uint amount);
 	void PassOnFlow(StationID origin, StationID via, uint amount);
@@ -466,6 +459,7 @@ public:
 	uint32 always_accepted;       ///< Bitmask of always accepted cargo types (by houses, HQs, industry tiles when industry doesn't accept cargo)
 
 	IndustryVector industries_near; ///< Cached list of industries near the station that can accept cargo, @see DeliverGoodsToIndustry()
+	TileArea catchment_index_area;  ///< Catchment area the station is registered with in the catchment index, @see FindStationsAroundTiles()
 
 	Station(TileIndex tile = INVALID_TILE);
 	~Station();
@@ -480,6 +474,8 @@ public:
 	/* virtual */ uint GetPlatformLength(TileIndex tile) const;
 	void RecomputeIndustriesNear();
 	static void RecomputeIndustriesNearForAll();
+	void UpdateCatchmentIndex();
+	void RemoveFromCatchmentIndex();
 
 	uint GetCatchmentRadius() const;
 	Rect GetCatchmentRect() const;
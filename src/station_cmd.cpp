@@ -51,8 +51,10 @@
 #include "newgrf_house.h"
 #include "company_gui.h"
 #include "linkgraph/linkgraph_base.h"
+#include "linkgraph/linkgraphschedule.h"
 #include "linkgraph/refresh.h"
 #include "widgets/station_widget.h"
+#include <algorithm>
 
 #include "table/strings.h"
 
@@ -3238,10 +3240,89 @@ static inline void byte_inc_sat(byte *p)
 	if (b != 0) *p = b;
 }
 
-static void UpdateStationRating(Station *st)
+/**
+ * Calculate the rating a cargo at a station is moving towards.
+ * @param st Station to calculate the rating for.
+ * @param ge Goods entry of the cargo at the station.
+ * @param cs Cargo to calculate the rating for.
+ * @return Target rating, not clamped yet.
+ */
+static int GetTargetStationRating(const Station *st, const GoodsEntry *ge, const CargoSpec *cs)
 {
-	bool waiting_changed = false;
+	bool skip = false;
+	int rating = 0;
+
+	if (HasBit(cs->callback_mask, CBM_CARGO_STATION_RATING_CALC)) {
+		/* Perform custom station rating. If it succeeds the speed, days in transit and
+		 * waiting cargo ratings must not be executed. */
+
+		/* NewGRFs expect last speed to be 0xFF when no vehicle has arrived yet. */
+		uint last_speed = ge->HasVehicleEverTriedLoading() ? ge->last_speed : 0xFF;
+
+		uint32 var18 = min(ge->time_since_pickup, 0xFF) | (min(ge->max_waiting_cargo, 0xFFFF) << 8) | (min(last_speed, 0xFF) << 24);
+		/* Convert to the 'old' vehicle types */
+		uint32 var10 = (st->last_vehicle_type == VEH_INVALID) ? 0x0 : (st->last_vehicle_type + 0x10);
+		uint16 callback = GetCargoCallback(CBID_CARGO_STATION_RATING_CALC, var10, var18, cs);
+		if (callback != CALLBACK_FAILED) {
+			skip = true;
+			rating = GB(callback, 0, 14);
+
+			/* Simulate a 15 bit signed value */
+			if (HasBit(callback, 14)) rating -= 0x4000;
+		}
+	}
+
+	if (!skip) {
+		int b = ge->last_speed - 85;
+		if (b >= 0) rating += b >> 2;
+
+		byte waittime = ge->time_since_pickup;
+		if (st->last_vehicle_type == VEH_SHIP) waittime >>= 2;
+		(waittime > 21) ||
+		(rating += 25, waittime > 12) ||
+		(rating += 25, waittime > 6) ||
+		(rating += 45, waittime > 3) ||
+		(rating += 35, true);
+
+		(rating -= 90, ge->max_waiting_cargo > 1500) ||
+		(rating += 55, ge->max_waiting_cargo > 1000) ||
+		(rating += 35, ge->max_waiting_cargo > 600) ||
+		(rating += 10, ge->max_waiting_cargo > 300) ||
+		(rating += 20, ge->max_waiting_cargo > 100) ||
+		(rating += 10, true);
+	}
+
+	if (Company::IsValidID(st->owner) && HasBit(st->town->statues, st->owner)) rating += 26;
+
+	byte age = ge->last_age;
+	(age >= 3) ||
+	(rating += 10, age >= 2) ||
+	(rating += 10, age >= 1) ||
+	(rating += 13, true);
+
+	return rating;
+}
+
+/**
+ * Move the rating of a cargo at a station towards the target rating, in
+ * steps of -2, -1, 0, 1 or 2.
+ * @param ge Goods entry of the cargo.
+ * @param rating Target rating.
+ */
+static inline void StepStationRating(GoodsEntry *ge, int rating)
+{
+	int or_ = ge->rating; // old rating
+	ge->rating = or_ + Clamp(Clamp(rating, 0, 255) - or_, -2, 2);
+}
 
+/**
+ * First part of updating the ratings of a station: update the ratings of all
+ * cargos without NewGRF rating callback. This only accesses the station
+ * itself, so it can be done for several stations concurrently.
+ * @param st Station to be updated.
+ */
+static void UpdateStationRatingLocal(Station *st)
+{
 	byte_inc_sat(&st->time_since_load);
 	byte_inc_sat(&st->time_since_unload);
 
@@ -3259,135 +3340,106 @@ static void UpdateStationRating(Station *st)
 		if (ge->HasRating()) {
 			byte_inc_sat(&ge->time_since_pickup);
 
-			bool skip = false;
-			int rating = 0;
-			uint waiting = ge->cargo.TotalCount();
-
-			/* num_dests is at least 1 if there is any cargo as
-			 * INVALID_STATION is also a destination.
-			 */
-			uint num_dests = (uint)ge->cargo.Packets()->MapSize();
-
-			/* Average amount of cargo per next hop, but prefer solitary stations
-			 * with only one or two next hops. They are allowed to have more
-			 * cargo waiting per next hop.
-			 * With manual cargo distribution waiting_avg = waiting / 2 as then
-			 * INVALID_STATION is the only destination.
-			 */
-			uint waiting_avg = waiting / (num_dests + 1);
-
-			if (HasBit(cs->callback_mask, CBM_CARGO_STATION_RATING_CALC)) {
-				/* Perform custom station rating. If it succeeds the speed, days in transit and
-				 * waiting cargo ratings must not be executed. */
-
-				/* NewGRFs expect last speed to be 0xFF when no vehicle has arrived yet. */
-				uint last_speed = ge->HasVehicleEverTriedLoading() ? ge->last_speed : 0xFF;
-
-				uint32 var18 = min(ge->time_since_pickup, 0xFF) | (min(ge->max_waiting_cargo, 0xFFFF) << 8) | (min(last_speed, 0xFF) << 24);
-				/* Convert to the 'old' vehicle types */
-				uint32 var10 = (st->last_vehicle_type == VEH_INVALID) ? 0x0 : (st->last_vehicle_type + 0x10);
-				uint16 callback = GetCargoCallback(CBID_CARGO_STATION_RATING_CALC, var10, var18, cs);
-				if (callback != CALLBACK_FAILED) {
-					skip = true;
-					rating = GB(callback, 0, 14);
-
-					/* Simulate a 15 bit signed value */
-					if (HasBit(callback, 14)) rating -= 0x4000;
-				}
+			/* NewGRF callbacks may only be run in the main thread. */
+			if (!HasBit(cs->callback_mask, CBM_CARGO_STATION_RATING_CALC)) {
+				StepStationRating(ge, GetTargetStationRating(st, ge, cs));
 			}
+		}
+	}
+}
 
-			if (!skip) {
-				int b = ge->last_speed - 85;
-				if (b >= 0) rating += b >> 2;
-
-				byte waittime = ge->time_since_pickup;
-				if (st->last_vehicle_type == VEH_SHIP) waittime >>= 2;
-				(waittime > 21) ||
-				(rating += 25, waittime > 12) ||
-				(rating += 25, waittime > 6) ||
-				(rating += 45, waittime > 3) ||
-				(rating += 35, true);
-
-				(rating -= 90, ge->max_waiting_cargo > 1500) ||
-				(rating += 55, ge->max_waiting_cargo > 1000) ||
-				(rating += 35, ge->max_waiting_cargo > 600) ||
-				(rating += 10, ge->max_waiting_cargo > 300) ||
-				(rating += 20, ge->max_waiting_cargo > 100) ||
-				(rating += 10, true);
-			}
+/**
+ * Second part of updating the ratings of a station: update the ratings of
+ * cargos with NewGRF rating callback and remove some of the waiting cargo if
+ * the rating is bad. This has to be done in the main thread in the order of
+ * the stations, as it uses the random generator and changes other stations.
+ * @param st Station to be updated.
+ */
+static void UpdateStationWaitingCargo(Station *st)
+{
+	bool waiting_changed = false;
 
-			if (Company::IsValidID(st->owner) && HasBit(st->town->statues, st->owner)) rating += 26;
+	const CargoSpec *cs;
+	FOR_ALL_CARGOSPECS(cs) {
+		GoodsEntry *ge = &st->goods[cs->Index()];
+		if (!ge->HasRating()) continue;
 
-			byte age = ge->last_age;
-			(age >= 3) ||
-			(rating += 10, age >= 2) ||
-			(rating += 10, age >= 1) ||
-			(rating += 13, true);
+		if (HasBit(cs->callback_mask, CBM_CARGO_STATION_RATING_CALC)) {
+			StepStationRating(ge, GetTargetStationRating(st, ge, cs));
+		}
 
-			{
-				int or_ = ge->rating; // old rating
+		int rating = ge->rating;
+		uint waiting = ge->cargo.TotalCount();
 
-				/* only modify rating in steps of -2, -1, 0, 1 or 2 */
-				ge->rating = rating = or_ + Clamp(Clamp(rating, 0, 255) - or_, -2, 2);
+		/* num_dests is at least 1 if there is any cargo as
+		 * INVALID_STATION is also a destination.
+		 */
+		uint num_dests = (uint)ge->cargo.Packets()->MapSize();
 
-				/* if rating is <= 64 and more than 100 items waiting on average per destination,
-				 * remove some random amount of goods from the station */
-				if (rating <= 64 && waiting_avg >= 100) {
-					int dec = Random() & 0x1F;
-					if (waiting_avg < 200) dec &= 7;
-					waiting -= (dec + 1) * num_dests;
-					waiting_changed = true;
-				}
+		/* Average amount of cargo per next hop, but prefer solitary stations
+		 * with only one or two next hops. They are allowed to have more
+		 * cargo waiting per next hop.
+		 * With manual cargo distribution waiting_avg = waiting / 2 as then
+		 * INVALID_STATION is the only destination.
+		 */
+		uint waiting_avg = waiting / (num_dests + 1);
+
+		/* if rating is <= 64 and more than 100 items waiting on average per destination,
+		 * remove some random amount of goods from the station */
+		if (rating <= 64 && waiting_avg >= 100) {
+			int dec = Random() & 0x1F;
+			if (waiting_avg < 200) dec &= 7;
+			waiting -= (dec + 1) * num_dests;
+			waiting_changed = true;
+		}
 
-				/* if rating is <= 127 and there are any items waiting, maybe remove some goods. */
-				if (rating <= 127 && waiting != 0) {
-					uint32 r = Random();
-					if (rating <= (int)GB(r, 0, 7)) {
-						/* Need to have int, otherwise it will just overflow etc. */
-						waiting = max((int)waiting - (int)((GB(r, 8, 2) - 1) * num_dests), 0);
-						waiting_changed = true;
-					}
-				}
+		/* if rating is <= 127 and there are any items waiting, maybe remove some goods. */
+		if (rating <= 127 && waiting != 0) {
+			uint32 r = Random();
+			if (rating <= (int)GB(r, 0, 7)) {
+				/* Need to have int, otherwise it will just overflow etc. */
+				waiting = max((int)waiting - (int)((GB(r, 8, 2) - 1) * num_dests), 0);
+				waiting_changed = true;
+			}
+		}
 
-				/* At some point we really must cap the cargo. Previously this
-				 * was a strict 4095, but now we'll have a less strict, but
-				 * increasingly aggressive truncation of the amount of cargo. */
-				static const uint WAITING_CARGO_THRESHOLD  = 1 << 12;
-				static const uint WAITING_CARGO_CUT_FACTOR = 1 <<  6;
-				static const uint MAX_WAITING_CARGO        = 1 << 15;
+		/* At some point we really must cap the cargo. Previously this
+		 * was a strict 4095, but now we'll have a less strict, but
+		 * increasingly aggressive truncation of the amount of cargo. */
+		static const uint WAITING_CARGO_THRESHOLD  = 1 << 12;
+		static const uint WAITING_CARGO_CUT_FACTOR = 1 <<  6;
+		static const uint MAX_WAITING_CARGO        = 1 << 15;
 
-				if (waiting > WAITING_CARGO_THRESHOLD) {
-					uint difference = waiting - WAITING_CARGO_THRESHOLD;
-					waiting -= (difference / WAITING_CARGO_CUT_FACTOR);
+		if (waiting > WAITING_CARGO_THRESHOLD) {
+			uint difference = waiting - WAITING_CARGO_THRESHOLD;
+			waiting -= (difference / WAITING_CARGO_CUT_FACTOR);
 
-					waiting = min(waiting, MAX_WAITING_CARGO);
-					waiting_changed = true;
-				}
+			waiting = min(waiting, MAX_WAITING_CARGO);
+			waiting_changed = true;
+		}
 
-				/* We can't truncate cargo that's already reserved for loading.
-				 * Thus StoredCount() here. */
-				if (waiting_changed && waiting < ge->cargo.AvailableCount()) {
-					/* Feed back the exact own waiting cargo at this station for the
-					 * next rating calculation. */
-					ge->max_waiting_cargo = 0;
+		/* We can't truncate cargo that's already reserved for loading.
+		 * Thus StoredCount() here. */
+		if (waiting_changed && waiting < ge->cargo.AvailableCount()) {
+			/* Feed back the exact own waiting cargo at this station for the
+			 * next rating calculation. */
+			ge->max_waiting_cargo = 0;
 
-					/* If truncating also punish the source stations' ratings to
-					 * decrease the flow of incoming cargo. */
+			/* If truncating also punish the source stations' ratings to
+			 * decrease the flow of incoming cargo. */
 
-					StationCargoAmountMap waiting_per_source;
-					ge->cargo.Truncate(ge->cargo.AvailableCount() - waiting, &waiting_per_source);
-					for (StationCargoAmountMap::iterator i(waiting_per_source.begin()); i != waiting_per_source.end(); ++i) {
-						Station *source_station = Station::GetIfValid(i->first);
-						if (source_station == NULL) continue;
+			StationCargoAmountMap waiting_per_source;
+			ge->cargo.Truncate(ge->cargo.AvailableCount() - waiting, &waiting_per_source);
+			for (StationCargoAmountMap::iterator i(waiting_per_source.begin()); i != waiting_per_source.end(); ++i) {
+				Station *source_station = Station::GetIfValid(i->first);
+				if (source_station == NULL) continue;
 
-						GoodsEntry &source_ge = source_station->goods[cs->Index()];
-						source_ge.max_waiting_cargo = max(source_ge.max_waiting_cargo, i->second);
-					}
-				} else {
-					/* If the average number per next hop is low, be more forgiving. */
-					ge->max_waiting_cargo = waiting_avg;
-				}
+				GoodsEntry &source_ge = source_station->goods[cs->Index()];
+				source_ge.max_waiting_cargo = max(source_ge.max_waiting_cargo, i->second);
 			}
+		} else {
+			/* If the average number per next hop is low, be more forgiving. */
+			ge->max_waiting_cargo = waiting_avg;
 		}
 	}
 
@@ -3399,6 +3451,57 @@ static void UpdateStationRating(Station *st)
 	}
 }
 
+/** Minimum number of stations to be updated by one rating task. */
+static const uint STATION_RATING_BATCH_SIZE = 32;
+
+/** Stations whose ratings are updated in the current tick. */
+static SmallVector<Station *, 32> _rating_stations;
+
+/** Task updating the local part of the ratings of a range of stations. */
+class StationRatingTask : public ThreadPoolTask {
+public:
+	uint first; ///< Index of the first station in _rating_stations.
+	uint last;  ///< Index behind the last station in _rating_stations.
+
+	virtual void Run()
+	{
+		for (uint i = this->first; i < this->last; ++i) UpdateStationRatingLocal(_rating_stations[i]);
+	}
+};
+
+/** Tasks for updating station ratings, kept for reuse. */
+static AutoDeleteSmallVector<StationRatingTask *, 8> _rating_tasks;
+
+/**
+ * Update the ratings of all stations due in this tick. The ratings are
+ * calculated in the workers of the link graph schedule first, if there are
+ * enough stations. Then the waiting cargo is adjusted in the order of the
+ * stations, so the result doesn't depend on the number of threads.
+ */
+static void UpdateStationRatings()
+{
+	uint count = _rating_stations.Length();
+	if (count == 0) return;
+
+	ThreadPool &workers = LinkGraphSchedule::Instance()->Workers();
+	uint num_tasks = Clamp(count / STATION_RATING_BATCH_SIZE, 1U, workers.NumThreads() + 1);
+	while (_rating_tasks.Length() < num_tasks) *_rating_tasks.Append() = new StationRatingTask();
+	for (uint i = 0; i < num_tasks; ++i) {
+		_rating_tasks[i]->first = count * i / num_tasks;
+		_rating_tasks[i]->last = count * (i + 1) / num_tasks;
+	}
+
+	/* The first task is run by this thread, the others by the workers. */
+	for (uint i = 1; i < num_tasks; ++i) workers.Enqueue(_rating_tasks[i]);
+	_rating_tasks[0]->Run();
+	for (uint i = 1; i < num_tasks; ++i) workers.Wait(_rating_tasks[i]);
+
+	for (Station **st = _rating_stations.Begin(); st != _rating_stations.End(); ++st) {
+		UpdateStationWaitingCargo(*st);
+	}
+	_rating_stations.Clear();
+}
+
 /**
  * Reroute cargo of type c at station st or in any vehicles unloading there.
  * Make sure the cargo's new next hop is neither "avoid" nor "avoid2".
@@ -3424,88 +3527,223 @@ void RerouteCargo(Station *st, CargoID c, StationID avoid, StationID avoid2)
 }
 
 /**
- * Check all next hops of cargo packets in this station for existance of a
- * a valid link they may use to travel on. Reroute any cargo not having a valid
- * link and remove timed out links found like this from the linkgraph. We're
- * not all links here as that is expensive and useless. A link no one is using
- * doesn't hurt either.
+ * Index from stations to the order lists visiting them, so that the order lists
+ * serving a link can be found without checking all orders of all order lists
+ * for each link. It is built on demand when the first timed out link of a link
+ * graph is checked. Refreshing links doesn't change any orders, so it stays
+ * valid while the link graph is being checked.
+ */
+class StationOrderListIndex {
+	/** A station and an order list visiting it. */
+	struct Entry {
+		StationID station; ///< Visited station.
+		OrderListID list;  ///< Order list visiting the station.
+
+		/**
+		 * Compare two entries by station and order list.
+		 * @param other Entry to compare with.
+		 * @return If this entry is to be sorted before the other one.
+		 */
+		inline bool operator<(const Entry &other) const
+		{
+			return this->station != other.station ? this->station < other.station : this->list < other.list;
+		}
+
+		/**
+		 * Check if two entries are equal.
+		 * @param other Entry to compare with.
+		 * @return If both entries have the same station and order list.
+		 */
+		inline bool operator==(const Entry &other) const
+		{
+			return this->station == other.station && this->list == other.list;
+		}
+	};
+
+	SmallVector<Entry, 16> entries; ///< Stations and order lists visiting them, sorted by station and order list.
+	bool valid;                     ///< If the index has been built since the last Invalidate().
+
+	/**
+	 * Find the first entry for a station.
+	 * @param station Station to look for.
+	 * @return First entry with the given station or a later one.
+	 */
+	const Entry *Find(StationID station) const
+	{
+		Entry key = {station, 0};
+		return std::lower_bound(this->entries.Begin(), this->entries.End(), key);
+	}
+
+	/** Collect the stations of all orders lists. */
+	void Build()
+	{
+		this->entries.Clear();
+		const OrderList *l;
+		FOR_ALL_ORDER_LISTS(l) {
+			for (const Order *order = l->GetFirstOrder(); order != NULL; order = order->next) {
+				if (!order->IsType(OT_GOTO_STATION) && !order->IsType(OT_IMPLICIT)) continue;
+				Entry *entry = this->entries.Append();
+				entry->station = order->GetDestination();
+				entry->list = l->index;
+			}
+		}
+		std::sort(this->entries.Begin(), this->entries.End());
+		this->entries.Resize(std::unique(this->entries.Begin(), this->entries.End()) - this->entries.Begin());
+		this->valid = true;
+	}
+
+public:
+	StationOrderListIndex() : valid(false) {}
+
+	/** Mark the index as outdated, so that it's rebuilt on next use. */
+	inline void Invalidate() { this->valid = false; }
+
+	/**
+	 * Get the order lists visiting both of two stations, sorted by ID.
+	 * @param from First station.
+	 * @param to Second station.
+	 * @param lists Output vector for the order lists.
+	 */
+	void FindOrderLists(StationID from, StationID to, SmallVector<OrderList *, 16> &lists)
+	{
+		if (!this->valid) this->Build();
+		lists.Clear();
+		const Entry *end = this->entries.End();
+		const Entry *it_from = this->Find(from);
+		const Entry *it_to = this->Find(to);
+		while (it_from != end && it_from->station == from && it_to != end && it_to->station == to) {
+			if (it_from->list < it_to->list) {
+				++it_from;
+			} else if (it_to->list < it_from->list) {
+				++it_to;
+			} else {
+				*lists.Append() = OrderList::Get(it_from->list);
+				++it_from;
+				++it_to;
+			}
+		}
+	}
+};
+
+/** Order lists by station, used for finding the vehicles serving a link. */
+static StationOrderListIndex _station_order_lists;
+
+/**
+ * Check all links of a station in a link graph for timeouts and remove or
+ * restrict timed out ones. Reroute any cargo having to travel over removed or
+ * restricted links.
  * @param from Station to check.
+ * @param c Cargo of the link graph.
  */
-void DeleteStaleLinks(Station *from)
+static void DeleteStaleLinks(Station *from, CargoID c)
 {
-	for (CargoID c = 0; c < NUM_CARGO; ++c) {
-		GoodsEntry &ge = from->goods[c];
-		LinkGraph *lg = LinkGraph::GetIfValid(ge.link_graph);
-		if (lg == NULL) continue;
-		Node node = (*lg)[ge.node];
-		for (EdgeIterator it(node.Begin()); it != node.End();) {
-			Edge edge = it->second;
-			Station *to = Station::Get((*lg)[it->first].Station());
-			assert(to->goods[c].node == it->first);
-			++it; // Do that before removing the edge. Anything else may crash.
-			assert(_date >= edge.LastUpdate());
-			uint timeout = LinkGraph::MIN_TIMEOUT_DISTANCE + (DistanceManhattan(from->xy, to->xy) >> 3);
-			if ((uint)(_date - edge.LastUpdate()) > timeout) {
-				/* Have all vehicles refresh their next hops before deciding to
-				 * remove the node. */
-				bool updated = false;
-				OrderList *l;
-				FOR_ALL_ORDER_LISTS(l) {
-					bool found_from = false;
-					bool found_to = false;
-					for (Order *order = l->GetFirstOrder(); order != NULL; order = order->next) {
-						if (!order->IsType(OT_GOTO_STATION) && !order->IsType(OT_IMPLICIT)) continue;
-						if (order->GetDestination() == from->index) {
-							found_from = true;
-							if (found_to) break;
-						} else if (order->GetDestination() == to->index) {
-							found_to = true;
-							if (found_from) break;
-						}
-					}
-					if (!found_to || !found_from) continue;
-					for (Vehicle *v = l->GetFirstSharedVehicle(); !updated && v != NULL; v = v->NextShared()) {
-						/* There is potential for optimization here:
-						 * - Usually consists of the same order list are the same. It's probably better to
-						 *   first check the first of each list, then the second of each list and so on.
-						 * - We could try to figure out if we've seen a consist with the same cargo on the
-						 *   same list already and if the consist can actually carry the cargo we're looking
-						 *   for. With conditional and refit orders this is not quite trivial, though. */
-						LinkRefresher::Run(v, false); // Don't allow merging. Otherwise lg might get deleted.
-						if (edge.LastUpdate() == _date) updated = true;
-					}
-					if (updated) break;
-				}
-				if (!updated) {
-					/* If it's still considered dead remove it. */
-					node.RemoveEdge(to->goods[c].node);
-					ge.flows.DeleteFlows(to->index);
-					RerouteCargo(from, c, to->index, from->index);
+	static SmallVector<OrderList *, 16> lists;
+
+	GoodsEntry &ge = from->goods[c];
+	LinkGraph *lg = LinkGraph::Get(ge.link_graph);
+	Node node = (*lg)[ge.node];
+	for (EdgeIterator it(node.Begin()); it != node.End();) {
+		Edge edge = it->second;
+		Station *to = Station::Get((*lg)[it->first].Station());
+		assert(to->goods[c].node == it->first);
+		++it; // Do that before removing the edge. Anything else may crash.
+		assert(_date >= edge.LastUpdate());
+		uint timeout = LinkGraph::Timeout(from->xy, to->xy);
+		if ((uint)(_date - edge.LastUpdate()) > timeout) {
+			/* Have all vehicles refresh their next hops before deciding to
+			 * remove the node. */
+			bool updated = false;
+			_station_order_lists.FindOrderLists(from->index, to->index, lists);
+			for (OrderList **l = lists.Begin(); !updated && l != lists.End(); ++l) {
+				for (Vehicle *v = (*l)->GetFirstSharedVehicle(); !updated && v != NULL; v = v->NextShared()) {
+					/* There is potential for optimization here:
+					 * - Usually consists of the same order list are the same. It's probably better to
+					 *   first check the first of each list, then the second of each list and so on.
+					 * - We could try to figure out if we've seen a consist with the same cargo on the
+					 *   same list already and if the consist can actually carry the cargo we're looking
+					 *   for. With conditional and refit orders this is not quite trivial, though. */
+					LinkRefresher::Run(v, false); // Don't allow merging. Otherwise lg might get deleted.
+					if (edge.LastUpdate() == _date) updated = true;
 				}
-			} else if (edge.LastUnrestrictedUpdate() != INVALID_DATE && (uint)(_date - edge.LastUnrestrictedUpdate()) > timeout) {
-				edge.Restrict();
-				ge.flows.RestrictFlows(to->index);
+			}
+			if (!updated) {
+				/* If it's still considered dead remove it. */
+				node.RemoveEdge(to->goods[c].node);
+				ge.flows.DeleteFlows(to->index);
 				RerouteCargo(from, c, to->index, from->index);
-			} else if (edge.LastRestrictedUpdate() != INVALID_DATE && (uint)(_date - edge.LastRestrictedUpdate()) > timeout) {
-				edge.Release();
 			}
+		} else if (edge.LastUnrestrictedUpdate() != INVALID_DATE && (uint)(_date - edge.LastUnrestrictedUpdate()) > timeout) {
+			edge.Restrict();
+			ge.flows.RestrictFlows(to->index);
+			RerouteCargo(from, c, to->index, from->index);
+		} else if (edge.LastRestrictedUpdate() != INVALID_DATE && (uint)(_date - edge.LastRestrictedUpdate()) > timeout) {
+			edge.Release();
 		}
-		assert(_date >= lg->LastCompression());
-		if ((uint)(_date - lg->LastCompression()) > LinkGraph::COMPRESSION_INTERVAL) {
-			lg->Compress();
+	}
+}
+
+/**
+ * Check the stations of a link graph for timed out links. Only the stations
+ * the link graph's expiry queue reports as due are checked. A link no one is
+ * using doesn't hurt, so links are only removed after vehicles serving them
+ * had a chance to refresh them. Compress the link graph if necessary.
+ * @param lg Link graph to check.
+ */
+static void DeleteStaleLinks(LinkGraph *lg)
+{
+	static SmallVector<NodeID, 16> expired;
+
+	lg->PopExpiredNodes(expired);
+	if (expired.Length() > 0) {
+		_station_order_lists.Invalidate();
+		for (const NodeID *node = expired.Begin(); node != expired.End(); ++node) {
+			DeleteStaleLinks(Station::Get((*lg)[*node].Station()), lg->Cargo());
+			lg->ScheduleExpiry(*node);
 		}
 	}
+
+	assert(_date >= lg->LastCompression());
+	if ((uint)(_date - lg->LastCompression()) > LinkGraph::COMPRESSION_INTERVAL) {
+		lg->Compress();
+	}
 }
 
+/** A change of a link's capacity and usage recorded by IncreaseStats while a batch is open. */
+struct LinkStatUpdate {
+	CargoID cargo;  ///< Cargo of the link.
+	StationID from; ///< Source station of the link.
+	StationID to;   ///< Destination station of the link.
+	uint capacity;  ///< Capacity to add or to refresh the link with.
+	uint usage;     ///< Usage to add or REFRESH_UNRESTRICTED or REFRESH_RESTRICTED.
+
+	/**
+	 * Compare two updates by link, so that updates of the same link end up next to each other.
+	 * @param other Update to compare with.
+	 * @return If this update's link is "smaller" than the other's.
+	 */
+	inline bool operator<(const LinkStatUpdate &other) const
+	{
+		if (this->cargo != other.cargo) return this->cargo < other.cargo;
+		if (this->from != other.from) return this->from < other.from;
+		return this->to < other.to;
+	}
+};
+
+static SmallVector<LinkStatUpdate, 16> _link_stat_updates; ///< Updates recorded in the current batch.
+static bool _link_stat_batch_open = false;                   ///< If IncreaseStats records updates instead of applying them.
+
 /**
- * Increase capacity for a link stat given by station cargo and next hop.
+ * Find the link graph and nodes for a link, creating or merging link graphs
+ * as necessary, and update the link's edge.
  * @param st Station to get the link stats from.
  * @param cargo Cargo to increase stat for.
  * @param next_station_id Station the consist will be travelling to next.
  * @param capacity Capacity to add to link stat.
- * @param usage Usage to add to link stat. If UINT_MAX refresh the link instead of increasing.
+ * @param usage Usage to add to link stat.
+ * @param refresh Capacity to refresh the link with afterwards or 0 if it isn't refreshed.
+ * @param refresh_flags Bit 0 set for an unrestricted refresh, bit 1 set for a restricted one.
  */
-void IncreaseStats(Station *st, CargoID cargo, StationID next_station_id, uint capacity, uint usage)
+static void UpdateLinkStat(Station *st, CargoID cargo, StationID next_station_id, uint capacity, uint usage, uint refresh, uint8 refresh_flags)
 {
 	GoodsEntry &ge1 = st->goods[cargo];
 	Station *st2 = Station::Get(next_station_id);
@@ -3547,16 +3785,93 @@ void IncreaseStats(Station *st, CargoID cargo, StationID next_station_id, uint c
 		}
 	}
 	if (lg != NULL) {
-		(*lg)[ge1.node].UpdateEdge(ge2.node, capacity, usage);
+		Node node = (*lg)[ge1.node];
+		bool added = node[ge2.node].Capacity() == 0;
+		if (capacity > 0) node.UpdateEdge(ge2.node, capacity, usage);
+		if (HasBit(refresh_flags, 0)) node.UpdateEdge(ge2.node, refresh, LinkGraph::REFRESH_UNRESTRICTED);
+		if (HasBit(refresh_flags, 1)) node.UpdateEdge(ge2.node, refresh, LinkGraph::REFRESH_RESTRICTED);
+		if (added) lg->ScheduleExpiry(ge1.node);
 	}
 }
 
 /**
- * Increase capacity for all link stats associated with vehicles in the given consist.
+ * Increase capacity for a link stat given by station cargo and next hop.
+ * While a batch is open the update is only recorded and applied together with
+ * all other updates of the same link when the batch is closed.
  * @param st Station to get the link stats from.
- * @param front First vehicle in the consist.
+ * @param cargo Cargo to increase stat for.
  * @param next_station_id Station the consist will be travelling to next.
+ * @param capacity Capacity to add to link stat.
+ * @param usage Usage to add to link stat. If UINT_MAX refresh the link instead of increasing.
  */
+void IncreaseStats(Station *st, CargoID cargo, StationID next_station_id, uint capacity, uint usage)
+{
+	if (_link_stat_batch_open) {
+		LinkStatUpdate *update = _link_stat_updates.Append();
+		update->cargo = cargo;
+		update->from = st->index;
+		update->to = next_station_id;
+		update->capacity = capacity;
+		update->usage = usage;
+	} else if (usage > capacity) {
+		UpdateLinkStat(st, cargo, next_station_id, 0, 0, capacity, usage == LinkGraph::REFRESH_UNRESTRICTED ? 1 : 2);
+	} else {
+		UpdateLinkStat(st, cargo, next_station_id, capacity, usage, 0, 0);
+	}
+}
+
+/**
+ * Start recording link stat updates instead of applying them one by one.
+ * Nothing may look at the link graphs until the batch is closed again.
+ */
+void OpenLinkStatBatch()
+{
+	assert(!_link_stat_batch_open);
+	_link_stat_batch_open = true;
+}
+
+/**
+ * Apply all link stat updates recorded since the batch was opened. The
+ * updates of each link are combined, so that the link graph and nodes are
+ * only looked up, and link graphs only merged, once per link. Adding
+ * capacity c to a link turns its capacity x into x + c, and refreshing it
+ * with capacity r turns it into max(x, r). Any sequence of those is
+ * max(x + a, r) for some a and r, so the combined update has exactly the same
+ * effect as applying the updates in order.
+ */
+void CloseLinkStatBatch()
+{
+	assert(_link_stat_batch_open);
+	_link_stat_batch_open = false;
+	if (_link_stat_updates.Length() == 0) return;
+
+	std::stable_sort(_link_stat_updates.Begin(), _link_stat_updates.End());
+	const LinkStatUpdate *end = _link_stat_updates.End();
+	for (const LinkStatUpdate *it = _link_stat_updates.Begin(); it != end;) {
+		const LinkStatUpdate &link = *it;
+		uint capacity = 0;
+		uint usage = 0;
+		uint refresh = 0;
+		uint8 refresh_flags = 0;
+		for (; it != end && !(link < *it); ++it) {
+			if (it->usage > it->capacity) {
+				refresh = max(refresh, it->capacity);
+				SetBit(refresh_flags, it->usage == LinkGraph::REFRESH_UNRESTRICTED ? 0 : 1);
+			} else {
+				capacity += it->capacity;
+				usage += it->usage;
+				if (refresh > 0) refresh += it->capacity;
+			}
+		}
+
+		/* Stations can't be deleted while vehicles are running, but better be safe. */
+		Station *st = Station::GetIfValid(link.from);
+		if (st == NULL || !Station::IsValidID(link.to)) continue;
+		UpdateLinkStat(st, link.cargo, link.to, capacity, usage, refresh, refresh_flags);
+	}
+	_link_stat_updates.Clear();
+}
+
 void IncreaseStats(Station *st, const Vehicle *front, StationID next_station_id)
 {
 	for (const Vehicle *v = front; v != NULL; v = v->Next()) {
@@ -3582,7 +3897,7 @@ static void StationHandleSmallTick(BaseStation *st)
 	if (b >= STATION_RATING_TICKS) b = 0;
 	st->delete_ctr = b;
 
-	if (b == 0) UpdateStationRating(Station::From(st));
+	if (b == 0) *_rating_stations.Append() = Station::From(st);
 }
 
 void OnTick_Station()
@@ -3590,14 +3905,16 @@ void OnTick_Station()
 	if (_game_mode == GM_EDITOR) return;
 
 	BaseStation *st;
-	FOR_ALL_BASE_STATIONS(st) {
-		StationHandleSmallTick(st);
+	FOR_ALL_BASE_STATIONS(st) StationHandleSmallTick(st);
+	UpdateStationRatings();
 
-		/* Clean up the link graph about once a week. */
-		if (Station::IsExpected(st) && (_tick_counter + st->index) % STATION_LINKGRAPH_TICKS == 0) {
-			DeleteStaleLinks(Station::From(st));
-		};
+	/* Clean up the link graphs about once a week. */
+	LinkGraph *lg;
+	FOR_ALL_LINK_GRAPHS(lg) {
+		if ((_tick_counter + lg->index) % STATION_LINKGRAPH_TICKS == 0) DeleteStaleLinks(lg);
+	}
 
+	FOR_ALL_BASE_STATIONS(st) {
 		/* Run STATION_ACCEPTANCE_TICKS = 250 tick interval trigger for station animation.
 		 * Station index is included so that triggers are not all done
 		 * at the same time. */
@@ -3734,54 +4051,177 @@ CommandCost CmdRenameStation(TileIndex tile, DoCommandFlag flags, uint32 p1, uin
 	return CommandCost();
 }
 
+/** Log2 of the edge length of the blocks of tiles in the station catchment index. */
+static const uint CATCHMENT_INDEX_BLOCK_BITS = 4;
+
+static SmallVector<StationID, 4> *_catchment_index = NULL; ///< Stations whose catchment may reach into each block of tiles.
+static uint _catchment_index_width = 0;  ///< Number of blocks in x direction of the catchment index.
+static uint _catchment_index_height = 0; ///< Number of blocks in y direction of the catchment index.
+
+/**
+ * Check if the catchment index has been set up for the current map.
+ * @return If the catchment index can be used.
+ */
+static inline bool IsCatchmentIndexValid()
+{
+	return _catchment_index != NULL &&
+			_catchment_index_width == MapSizeX() >> CATCHMENT_INDEX_BLOCK_BITS &&
+			_catchment_index_height == MapSizeY() >> CATCHMENT_INDEX_BLOCK_BITS;
+}
+
+/**
+ * Get the stations registered in the catchment index for a block of tiles.
+ * @param x X coordinate of a tile in the block.
+ * @param y Y coordinate of a tile in the block.
+ * @return Stations whose catchment may reach into the block.
+ */
+static inline SmallVector<StationID, 4> &GetCatchmentIndexBlock(uint x, uint y)
+{
+	return _catchment_index[(y >> CATCHMENT_INDEX_BLOCK_BITS) * _catchment_index_width + (x >> CATCHMENT_INDEX_BLOCK_BITS)];
+}
+
+/** Clear the station catchment index and size it for the current map. */
+void InitializeStationCatchmentIndex()
+{
+	delete[] _catchment_index;
+	_catchment_index_width = MapSizeX() >> CATCHMENT_INDEX_BLOCK_BITS;
+	_catchment_index_height = MapSizeY() >> CATCHMENT_INDEX_BLOCK_BITS;
+	_catchment_index = new SmallVector<StationID, 4>[_catchment_index_width * _catchment_index_height];
+
+	Station *st;
+	FOR_ALL_STATIONS(st) st->catchment_index_area.Clear();
+}
+
+/**
+ * Register the station in the catchment index with its current catchment
+ * rectangle. This has to be called whenever the station's tiles or catchment
+ * radius change.
+ */
+void Station::UpdateCatchmentIndex()
+{
+	this->RemoveFromCatchmentIndex();
+	if (this->rect.IsEmpty()) return;
+	if (!IsCatchmentIndexValid()) InitializeStationCatchmentIndex();
+
+	Rect r = this->GetCatchmentRect();
+	this->catchment_index_area = TileArea(TileXY(r.left, r.top), TileXY(r.right, r.bottom));
+	for (uint y = r.top >> CATCHMENT_INDEX_BLOCK_BITS; y <= (uint)r.bottom >> CATCHMENT_INDEX_BLOCK_BITS; y++) {
+		for (uint x = r.left >> CATCHMENT_INDEX_BLOCK_BITS; x <= (uint)r.right >> CATCHMENT_INDEX_BLOCK_BITS; x++) {
+			*GetCatchmentIndexBlock(x << CATCHMENT_INDEX_BLOCK_BITS, y << CATCHMENT_INDEX_BLOCK_BITS).Append() = this->index;
+		}
+	}
+}
+
+/** Remove the station from the catchment index. */
+void Station::RemoveFromCatchmentIndex()
+{
+	if (this->catchment_index_area.tile == INVALID_TILE) return;
+
+	if (IsCatchmentIndexValid()) {
+		uint left = TileX(this->catchment_index_area.tile);
+		uint top = TileY(this->catchment_index_area.tile);
+		uint right = left + this->catchment_index_area.w - 1;
+		uint bottom = top + this->catchment_index_area.h - 1;
+		for (uint y = top >> CATCHMENT_INDEX_BLOCK_BITS; y <= bottom >> CATCHMENT_INDEX_BLOCK_BITS; y++) {
+			for (uint x = left >> CATCHMENT_INDEX_BLOCK_BITS; x <= right >> CATCHMENT_INDEX_BLOCK_BITS; x++) {
+				SmallVector<StationID, 4> &block = GetCatchmentIndexBlock(x << CATCHMENT_INDEX_BLOCK_BITS, y << CATCHMENT_INDEX_BLOCK_BITS);
+				StationID *it = block.Find(this->index);
+				if (it != block.End()) block.Erase(it);
+			}
+		}
+	}
+	this->catchment_index_area.Clear();
+}
+
+/** A station found around a producer, together with the first of its tiles found. */
+struct FoundStation {
+	TileIndex tile; ///< First tile of the station found.
+	Station *st;    ///< The station.
+
+	/**
+	 * Compare two found stations by their tiles, which orders them like a search row by row.
+	 * @param other Found station to compare with.
+	 * @return If this station is found before the other one.
+	 */
+	inline bool operator<(const FoundStation &other) const
+	{
+		return this->tile < other.tile;
+	}
+};
+
 /**
  * Find all stations around a rectangular producer (industry, house, headquarter, ...)
+ * Only the stations registered in the catchment index for the producer's tiles
+ * are checked. The stations are returned in the order in which a search over
+ * all tiles around the producer, row by row, would encounter them.
  *
  * @param location The location/area of the producer
  * @param stations The list to store the stations in
  */
 void FindStationsAroundTiles(const TileArea &location, StationList *stations)
 {
+	/* Stations found with the first of their tiles, and stations checked already. */
+	static SmallVector<FoundStation, 16> found;
+	static SmallVector<StationID, 16> checked;
+
+	if (!IsCatchmentIndexValid()) return;
+
 	/* area to search = producer plus station catchment radius */
-	uint max_rad = (_settings_game.station.modified_catchment ? MAX_CATCHMENT : CA_UNMODIFIED);
+	int max_rad = (_settings_game.station.modified_catchment ? MAX_CATCHMENT : CA_UNMODIFIED);
 
-	uint x = TileX(location.tile);
-	uint y = TileY(location.tile);
+	int x = TileX(location.tile);
+	int y = TileY(location.tile);
 
-	uint min_x = (x > max_rad) ? x - max_rad : 0;
-	uint max_x = x + location.w + max_rad;
-	uint min_y = (y > max_rad) ? y - max_rad : 0;
-	uint max_y = y + location.h + max_rad;
+	int min_x = max(x - max_rad, 0);
+	int max_x = x + location.w + max_rad;
+	int min_y = max(y - max_rad, 0);
+	int max_y = y + location.h + max_rad;
 
 	if (min_x == 0 && _settings_game.construction.freeform_edges) min_x = 1;
 	if (min_y == 0 && _settings_game.construction.freeform_edges) min_y = 1;
-	if (max_x >= MapSizeX()) max_x = MapSizeX() - 1;
-	if (max_y >= MapSizeY()) max_y = MapSizeY() - 1;
-
-	for (uint cy = min_y; cy < max_y; cy++) {
-		for (uint cx = min_x; cx < max_x; cx++) {
-			TileIndex cur_tile = TileXY(cx, cy);
-			if (!IsTileType(cur_tile, MP_STATION)) continue;
-
-			Station *st = Station::GetByTile(cur_tile);
-			/* st can be NULL in case of waypoints */
-			if (st == NULL) continue;
-
-			if (_settings_game.station.modified_catchment) {
-				int rad = st->GetCatchmentRadius();
-				int rad_x = cx - x;
-				int rad_y = cy - y;
-
-				if (rad_x < -rad || rad_x >= rad + location.w) continue;
-				if (rad_y < -rad || rad_y >= rad + location.h) continue;
+	if (max_x >= (int)MapSizeX()) max_x = MapSizeX() - 1;
+	if (max_y >= (int)MapSizeY()) max_y = MapSizeY() - 1;
+
+	found.Clear();
+	checked.Clear();
+	for (uint by = y >> CATCHMENT_INDEX_BLOCK_BITS; by <= (y + location.h - 1U) >> CATCHMENT_INDEX_BLOCK_BITS; by++) {
+		for (uint bx = x >> CATCHMENT_INDEX_BLOCK_BITS; bx <= (x + location.w - 1U) >> CATCHMENT_INDEX_BLOCK_BITS; bx++) {
+			const SmallVector<StationID, 4> &block = GetCatchmentIndexBlock(bx << CATCHMENT_INDEX_BLOCK_BITS, by << CATCHMENT_INDEX_BLOCK_BITS);
+			for (const StationID *id = block.Begin(); id != block.End(); id++) {
+				if (checked.Include(*id)) continue;
+				Station *st = Station::Get(*id);
+				if (st->rect.IsEmpty()) continue;
+
+				/* Search the station's tiles within its own catchment radius. */
+				int rad = _settings_game.station.modified_catchment ? (int)st->GetCatchmentRadius() : max_rad;
+				int left = max(max(min_x, x - rad), st->rect.left);
+				int right = min(min(max_x, x + location.w + rad), st->rect.right + 1);
+				int top = max(max(min_y, y - rad), st->rect.top);
+				int bottom = min(min(max_y, y + location.h + rad), st->rect.bottom + 1);
+
+				bool hit = false;
+				for (int cy = top; !hit && cy < bottom; cy++) {
+					for (int cx = left; cx < right; cx++) {
+						TileIndex cur_tile = TileXY(cx, cy);
+						if (!IsTileType(cur_tile, MP_STATION) || GetStationIndex(cur_tile) != st->index) continue;
+						FoundStation *entry = found.Append();
+						entry->tile = cur_tile;
+						entry->st = st;
+						hit = true;
+						break;
+					}
+				}
 			}
-
-			/* Insert the station in the set. This will fail if it has
-			 * already been added.
-			 */
-			stations->Include(st);
 		}
 	}
+
+	std::sort(found.Begin(), found.End());
+	for (const FoundStation *it = found.Begin(); it != found.End(); it++) {
+		/* Insert the station in the set. This will fail if it has
+		 * already been added.
+		 */
+		stations->Include(it->st);
+	}
 }
 
 /**
@@ -4189,7 +4629,7 @@ void FlowStat::Invalidate()
 		if (it->first == this->unrestricted) this->unrestricted = i;
 	}
 	this->shares.swap(new_shares);
-	assert(!this->shares.empty() && this->unrestricted <= (--this->shares.end())->first);
+	assert(!this->shares.empty() && this->unrestricted <= this->shares.rbegin()->first);
 }
 
 /**
@@ -4403,7 +4843,7 @@ StationIDStack FlowStatMap::DeleteFlows(StationID via)
 		s_flows.ChangeShare(via, INT_MIN);
 		if (s_flows.GetShares()->empty()) {
 			ret.Push(f_it->first);
-			this->erase(f_it++);
+			f_it = this->erase(f_it);
 		} else {
 			++f_it;
 		}
@@ -50,6 +50,8 @@ bool SplitGroundSpriteForOverlay(const TileInfo *ti, SpriteID *ground, RailTrack
 
 void IncreaseStats(Station *st, const Vehicle *v, StationID next_station_id);
 void IncreaseStats(Station *st, CargoID cargo, StationID next_station_id, uint capacity, uint usage);
+void OpenLinkStatBatch();
+void CloseLinkStatBatch();
 void RerouteCargo(Station *st, CargoID c, StationID avoid, StationID avoid2);
 
 /**
@@ -0,0 +1,178 @@
+/* $Id$ */
+
+/*
+ * This file is part of OpenTTD.
+ * OpenTTD is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * OpenTTD is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with OpenTTD. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file thread_pool.cpp Implementation of the pool of worker threads. */
+
+#include "../stdafx.h"
+#include "thread_pool.h"
+
+/**
+ * Create a task.
+ */
+ThreadPoolTask::ThreadPoolTask() : mutex(ThreadMutex::New()), finished(true)
+{
+}
+
+/**
+ * Destroy a task. It must not be queued or running anymore.
+ */
+ThreadPoolTask::~ThreadPoolTask()
+{
+	delete this->mutex;
+}
+
+/**
+ * Check if the task has been run completely, without waiting for it.
+ * @return If the task is neither queued nor running.
+ */
+bool ThreadPoolTask::IsFinished() const
+{
+	this->mutex->BeginCritical();
+	bool finished = this->finished;
+	this->mutex->EndCritical();
+	return finished;
+}
+
+/**
+ * Create a thread pool without any threads. Tasks queued in it will be run
+ * when waiting for them until Start is called.
+ */
+ThreadPool::ThreadPool() : mutex(ThreadMutex::New()), exit(false)
+{
+}
+
+/**
+ * Stop all workers and destroy the pool.
+ */
+ThreadPool::~ThreadPool()
+{
+	this->Stop();
+	assert(this->queue.empty());
+	delete this->mutex;
+}
+
+/**
+ * Start worker threads. If the system can't create threads, less or none are
+ * started.
+ * @param num_threads Number of threads to be added to the pool.
+ */
+void ThreadPool::Start(uint num_threads)
+{
+	for (uint i = 0; i < num_threads; ++i) {
+		ThreadObject *thread;
+		if (!ThreadObject::New(&ThreadPool::WorkerProc, this, &thread)) break;
+		*this->threads.Append() = thread;
+	}
+}
+
+/**
+ * Stop all worker threads. Running tasks are finished first, tasks still in
+ * the queue stay there and will be run by whoever waits for them.
+ */
+void ThreadPool::Stop()
+{
+	if (this->threads.Length() == 0) return;
+
+	this->mutex->BeginCritical();
+	this->exit = true;
+	this->mutex->SendSignal();
+	this->mutex->EndCritical();
+
+	for (ThreadObject **thread = this->threads.Begin(); thread != this->threads.End(); ++thread) {
+		(*thread)->Join();
+		delete *thread;
+	}
+	this->threads.Clear();
+	this->exit = false;
+}
+
+/**
+ * Queue a task for execution by one of the workers.
+ * @param task Task to be queued. It must not be queued already.
+ */
+void ThreadPool::Enqueue(ThreadPoolTask *task)
+{
+	task->finished = false;
+	this->mutex->BeginCritical();
+	this->queue.push_back(task);
+	this->mutex->SendSignal();
+	this->mutex->EndCritical();
+}
+
+/**
+ * Remove a task from the queue if no worker has picked it up, yet.
+ * @param task Task to be removed.
+ * @return If the task was still queued and has been removed.
+ */
+bool ThreadPool::Dequeue(ThreadPoolTask *task)
+{
+	this->mutex->BeginCritical();
+	bool found = false;
+	for (TaskList::iterator i = this->queue.begin(); i != this->queue.end(); ++i) {
+		if (*i == task) {
+			this->queue.erase(i);
+			found = true;
+			break;
+		}
+	}
+	this->mutex->EndCritical();
+	return found;
+}
+
+/**
+ * Wait for a queued task to finish. If no worker has started it, yet, it is
+ * run in the calling thread instead.
+ * @param task Task to wait for.
+ */
+void ThreadPool::Wait(ThreadPoolTask *task)
+{
+	if (this->Dequeue(task)) {
+		task->Run();
+		task->finished = true;
+		return;
+	}
+
+	task->mutex->BeginCritical();
+	while (!task->finished) task->mutex->WaitForSignal();
+	task->mutex->EndCritical();
+}
+
+/**
+ * Main loop of the worker threads: Take tasks from the queue and run them
+ * until the pool is stopped.
+ * @param p Pool the worker belongs to.
+ */
+/* static */ void ThreadPool::WorkerProc(void *p)
+{
+	ThreadPool *pool = (ThreadPool *)p;
+	pool->mutex->BeginCritical();
+	for (;;) {
+		while (pool->queue.empty() && !pool->exit) pool->mutex->WaitForSignal();
+		if (pool->exit) break;
+
+		ThreadPoolTask *task = pool->queue.front();
+		pool->queue.pop_front();
+		/* Not all implementations wake every waiting worker for every signal. */
+		if (!pool->queue.empty()) pool->mutex->SendSignal();
+		pool->mutex->EndCritical();
+
+		task->Run();
+
+		/* The task may be deleted as soon as its mutex is released. */
+		task->mutex->BeginCritical();
+		task->finished = true;
+		task->mutex->SendSignal();
+		task->mutex->EndCritical();
+
+		pool->mutex->BeginCritical();
+	}
+	/* Pass the exit signal on to the next worker. */
+	pool->mutex->SendSignal();
+	pool->mutex->EndCritical();
+}
@@ -0,0 +1,79 @@
+/* $Id$ */
+
+/*
+ * This file is part of OpenTTD.
+ * OpenTTD is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 2.
+ * OpenTTD is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details. You should have received a copy of the GNU General Public License along with OpenTTD. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file thread_pool.h Pool of persistent worker threads. */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "thread.h"
+#include "../core/smallvec_type.hpp"
+#include <list>
+
+/**
+ * A unit of work that can be queued in a ThreadPool. A task can be queued
+ * again once it has been waited for.
+ */
+class ThreadPoolTask {
+public:
+	ThreadPoolTask();
+	virtual ~ThreadPoolTask();
+
+	/**
+	 * Do the actual work. This is called either from one of the pool's worker
+	 * threads or from the thread waiting for the task.
+	 */
+	virtual void Run() = 0;
+
+	bool IsFinished() const;
+
+private:
+	friend class ThreadPool;
+
+	ThreadMutex *mutex; ///< Mutex guarding and signalling "finished".
+	bool finished;      ///< If the task has been run completely.
+};
+
+/**
+ * Pool of worker threads taking tasks from a common queue. If no threads can
+ * be created the tasks are run by whoever waits for them. Waiting for a task
+ * that hasn't been picked up by a worker, yet, also runs it in the waiting
+ * thread. So tasks may themselves queue and wait for other tasks without
+ * risking a deadlock.
+ */
+class ThreadPool {
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	void Start(uint num_threads);
+	void Stop();
+
+	void Enqueue(ThreadPoolTask *task);
+	bool Dequeue(ThreadPoolTask *task);
+	void Wait(ThreadPoolTask *task);
+
+	/**
+	 * Get the number of worker threads currently running.
+	 * @return Number of threads.
+	 */
+	inline uint NumThreads() const { return this->threads.Length(); }
+
+private:
+	typedef std::list<ThreadPoolTask *> TaskList;
+
+	static void WorkerProc(void *pool);
+
+	ThreadMutex *mutex;                      ///< Mutex guarding the queue, signalled when tasks are queued.
+	TaskList queue;                          ///< Tasks waiting for a worker.
+	SmallVector<ThreadObject *, 8> threads;  ///< Worker threads.
+	bool exit;                               ///< If the workers should exit.
+};
+
+#endif /* THREAD_POOL_H */
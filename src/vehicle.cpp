@@ -50,8 +50,10 @@
 #include "tunnel_map.h"
 #include "depot_map.h"
 #include "gamelog.h"
+#include "cpu.h"
 #include "linkgraph/linkgraph.h"
 #include "linkgraph/refresh.h"
+#include <algorithm>
 
 #include "table/strings.h"
 
@@ -280,6 +282,121 @@ void VehicleLengthChanged(const Vehicle *u)
 	}
 }
 
+/** A vehicle in the lists of vehicles to be ticked. */
+struct TickVehicle {
+	VehicleID index; ///< ID of the vehicle, kept after the vehicle is deleted.
+	Vehicle *v;      ///< The vehicle or NULL if it has been deleted.
+};
+
+/**
+ * Comparator for sorting tick list entries by vehicle ID.
+ * @param a First entry.
+ * @param b Second entry.
+ * @return If the first entry's vehicle ID is smaller.
+ */
+static inline bool TickVehicleIDSorter(const TickVehicle &a, const TickVehicle &b)
+{
+	return a.index < b.index;
+}
+
+/**
+ * Vehicles of each type, so that CallVehicleTicks() can handle each type in
+ * its own loop. New vehicles are appended and deleted ones set to NULL.
+ * At the start of each tick the lists are compacted and sorted by vehicle ID.
+ */
+static SmallVector<TickVehicle, 64> _tick_vehicles[VEH_END];
+static uint _tick_vehicles_sorted[VEH_END]; ///< Number of entries at the start of each tick list that are sorted by vehicle ID.
+static bool _tick_vehicles_holes[VEH_END];  ///< If an entry of each tick list has been set to NULL.
+
+/** Clear the tick lists. The vehicle pool has been cleaned before. */
+static void ResetTickVehicles()
+{
+	for (VehicleType type = VEH_BEGIN; type < VEH_END; type++) {
+		_tick_vehicles[type].Clear();
+		_tick_vehicles_sorted[type] = 0;
+		_tick_vehicles_holes[type] = false;
+	}
+}
+
+/**
+ * Add a new vehicle to the tick list of its type.
+ * @param v The vehicle.
+ */
+static void AddTickVehicle(Vehicle *v)
+{
+	if (v->type >= VEH_END) return;
+	TickVehicle *entry = _tick_vehicles[v->type].Append();
+	entry->index = v->index;
+	entry->v = v;
+}
+
+/**
+ * Remove a vehicle from the tick list of its type. The entry is only set to
+ * NULL, so that it can safely be done while the list is iterated.
+ * @param v The vehicle.
+ */
+static void RemoveTickVehicle(Vehicle *v)
+{
+	if (v->type >= VEH_END) return;
+	SmallVector<TickVehicle, 64> &list = _tick_vehicles[v->type];
+	TickVehicle key = { v->index, v };
+	TickVehicle *end = list.Begin() + _tick_vehicles_sorted[v->type];
+	TickVehicle *it = std::lower_bound(list.Begin(), end, key, &TickVehicleIDSorter);
+	/* The ID may have been reused after its old vehicle was removed in the same tick.
+	 * Then the sorted entry is already NULL and the new vehicle is in the unsorted tail. */
+	if (it == end || it->v != v) {
+		for (it = end; it != list.End() && it->v != v; it++) {}
+	}
+	assert(it != list.End() && it->v == v);
+	it->v = NULL;
+	_tick_vehicles_holes[v->type] = true;
+}
+
+/**
+ * Vehicles whose daily handlers run in each tick of the day, see RunVehicleDayProc().
+ * The lists are sorted by vehicle ID unless they are marked dirty. Dirty lists may
+ * contain vehicles that have been deleted or moved to another tick, or duplicates.
+ */
+static SmallVector<VehicleID, 16> _day_proc_lists[DAY_TICKS];
+static bool _day_proc_dirty[DAY_TICKS]; ///< Whether each list in _day_proc_lists needs to be cleaned and sorted.
+
+/**
+ * Estimated cost of the daily handlers run in each tick of the day, as of the
+ * last time they were run. This is used to balance the ticks, so it must be the
+ * same on all clients and is saved.
+ */
+uint32 _day_proc_weights[DAY_TICKS];
+
+/**
+ * Add a vehicle to the list of the tick of the day its daily handlers run in.
+ * @param v The vehicle.
+ */
+static void AddDayProcVehicle(const Vehicle *v)
+{
+	*_day_proc_lists[v->day_proc_slot].Append() = v->index;
+	_day_proc_dirty[v->day_proc_slot] = true;
+}
+
+/** Fill the lists of the vehicles running their daily handlers in each tick from the vehicle pool. */
+void RebuildVehicleDayProcLists()
+{
+	for (uint i = 0; i < DAY_TICKS; i++) {
+		_day_proc_lists[i].Clear();
+		_day_proc_dirty[i] = false;
+	}
+
+	/* The vehicles are visited in ID order, so the lists are sorted. */
+	const Vehicle *v;
+	FOR_ALL_VEHICLES(v) *_day_proc_lists[v->day_proc_slot].Append() = v->index;
+}
+
+/** Clear the lists of the vehicles running their daily handlers and their costs. */
+static void ResetVehicleDayProc()
+{
+	RebuildVehicleDayProcLists();
+	MemSetT(_day_proc_weights, 0, DAY_TICKS);
+}
+
 /**
  * Vehicle constructor.
  * @param type Type of the new vehicle.
@@ -295,6 +412,9 @@ Vehicle::Vehicle(VehicleType type)
 	this->cargo_age_counter  = 1;
 	this->last_station_visited = INVALID_STATION;
 	this->last_loading_station = INVALID_STATION;
+	this->day_proc_slot        = this->index % DAY_TICKS;
+	AddTickVehicle(this);
+	AddDayProcVehicle(this);
 }
 
 /**
@@ -306,25 +426,36 @@ byte VehicleRandomBits()
 	return GB(Random(), 0, 8);
 }
 
-/* Size of the hash, 6 = 64 x 64, 7 = 128 x 128. Larger sizes will (in theory) reduce hash
- * lookup times at the expense of memory usage. */
-const int HASH_BITS = 7;
-const int HASH_SIZE = 1 << HASH_BITS;
-const int HASH_MASK = HASH_SIZE - 1;
-const int TOTAL_HASH_SIZE = 1 << (HASH_BITS * 2);
-const int TOTAL_HASH_MASK = TOTAL_HASH_SIZE - 1;
+/* Maximum size of the hash per axis, 10 = 1024. The hash has as many buckets as the
+ * map has tiles, up to 1024 x 1024. Tiles further apart share their buckets. */
+static const uint MAX_HASH_BITS = 10;
 
 /* Resolution of the hash, 0 = 1*1 tile, 1 = 2*2 tiles, 2 = 4*4 tiles, etc.
  * Profiling results show that 0 is fastest. */
 const int HASH_RES = 0;
 
-static Vehicle *_vehicle_tile_hash[TOTAL_HASH_SIZE];
+static Vehicle **_vehicle_tile_hash = NULL; ///< Chains of the vehicles in each bucket of the tile hash.
+static uint _hash_bits_x = 0;               ///< Number of bits of the x coordinate of a tile used in the hash.
+static uint _hash_bits_y = 0;               ///< Number of bits of the y coordinate of a tile used in the hash.
+static int _hash_mask_x = 0;                ///< Mask for the x coordinate in the hash.
+static int _hash_mask_y = 0;                ///< Mask for the y coordinate in the hash, already shifted by _hash_bits_x.
+
+/**
+ * Get the hash bucket of a tile.
+ * @param x X coordinate of the tile.
+ * @param y Y coordinate of the tile.
+ * @return Chain of the vehicles in the bucket.
+ */
+static inline Vehicle **GetVehicleTileHash(uint x, uint y)
+{
+	return &_vehicle_tile_hash[GB(x, HASH_RES, _hash_bits_x) | GB(y, HASH_RES, _hash_bits_y) << _hash_bits_x];
+}
 
 static Vehicle *VehicleFromTileHash(int xl, int yl, int xu, int yu, void *data, VehicleFromPosProc *proc, bool find_first)
 {
-	for (int y = yl; ; y = (y + (1 << HASH_BITS)) & (HASH_MASK << HASH_BITS)) {
-		for (int x = xl; ; x = (x + 1) & HASH_MASK) {
-			Vehicle *v = _vehicle_tile_hash[(x + y) & TOTAL_HASH_MASK];
+	for (int y = yl; ; y = (y + (1 << _hash_bits_x)) & _hash_mask_y) {
+		for (int x = xl; ; x = (x + 1) & _hash_mask_x) {
+			Vehicle *v = _vehicle_tile_hash[x + y];
 			for (; v != NULL; v = v->hash_tile_next) {
 				Vehicle *a = proc(v, data);
 				if (find_first && a != NULL) return a;
@@ -354,10 +485,10 @@ static Vehicle *VehicleFromPosXY(int x, int y, void *data, VehicleFromPosProc *p
 	const int COLL_DIST = 6;
 
 	/* Hash area to scan is from xl,yl to xu,yu */
-	int xl = GB((x - COLL_DIST) / TILE_SIZE, HASH_RES, HASH_BITS);
-	int xu = GB((x + COLL_DIST) / TILE_SIZE, HASH_RES, HASH_BITS);
-	int yl = GB((y - COLL_DIST) / TILE_SIZE, HASH_RES, HASH_BITS) << HASH_BITS;
-	int yu = GB((y + COLL_DIST) / TILE_SIZE, HASH_RES, HASH_BITS) << HASH_BITS;
+	int xl = GB((x - COLL_DIST) / TILE_SIZE, HASH_RES, _hash_bits_x);
+	int xu = GB((x + COLL_DIST) / TILE_SIZE, HASH_RES, _hash_bits_x);
+	int yl = GB((y - COLL_DIST) / TILE_SIZE, HASH_RES, _hash_bits_y) << _hash_bits_x;
+	int yu = GB((y + COLL_DIST) / TILE_SIZE, HASH_RES, _hash_bits_y) << _hash_bits_x;
 
 	return VehicleFromTileHash(xl, yl, xu, yu, data, proc, find_first);
 }
@@ -409,10 +540,7 @@ bool HasVehicleOnPosXY(int x, int y, void *data, VehicleFromPosProc *proc)
  */
 static Vehicle *VehicleFromPos(TileIndex tile, void *data, VehicleFromPosProc *proc, bool find_first)
 {
-	int x = GB(TileX(tile), HASH_RES, HASH_BITS);
-	int y = GB(TileY(tile), HASH_RES, HASH_BITS) << HASH_BITS;
-
-	Vehicle *v = _vehicle_tile_hash[(x + y) & TOTAL_HASH_MASK];
+	Vehicle *v = *GetVehicleTileHash(TileX(tile), TileY(tile));
 	for (; v != NULL; v = v->hash_tile_next) {
 		if (v->tile != tile) continue;
 
@@ -558,9 +686,7 @@ static void UpdateVehicleTileHash(Vehicle *v, bool remove)
 	if (remove) {
 		new_hash = NULL;
 	} else {
-		int x = GB(TileX(v->tile), HASH_RES, HASH_BITS);
-		int y = GB(TileY(v->tile), HASH_RES, HASH_BITS) << HASH_BITS;
-		new_hash = &_vehicle_tile_hash[(x + y) & TOTAL_HASH_MASK];
+		new_hash = GetVehicleTileHash(TileX(v->tile), TileY(v->tile));
 	}
 
 	if (old_hash == new_hash) return;
@@ -611,12 +737,42 @@ static void UpdateVehicleViewportHash(Vehicle *v, int x, int y)
 	}
 }
 
+/** Clear the vehicle hashes and size the tile hash for the current map. */
 void ResetVehicleHash()
 {
 	Vehicle *v;
 	FOR_ALL_VEHICLES(v) { v->hash_tile_current = NULL; }
 	memset(_vehicle_viewport_hash, 0, sizeof(_vehicle_viewport_hash));
-	memset(_vehicle_tile_hash, 0, sizeof(_vehicle_tile_hash));
+
+	_hash_bits_x = min(MapLogX(), MAX_HASH_BITS);
+	_hash_bits_y = min(MapLogY(), MAX_HASH_BITS);
+	_hash_mask_x = (1 << _hash_bits_x) - 1;
+	_hash_mask_y = ((1 << _hash_bits_y) - 1) << _hash_bits_x;
+	free(_vehicle_tile_hash);
+	_vehicle_tile_hash = CallocT<Vehicle *>(1 << (_hash_bits_x + _hash_bits_y));
+}
+
+/**
+ * Gather statistics about the lengths of the chains in the vehicle tile hash.
+ * @param[out] stats The statistics.
+ */
+void GetVehicleTileHashStats(VehicleTileHashStats &stats)
+{
+	MemSetT(&stats, 0);
+	stats.size_x = 1 << _hash_bits_x;
+	stats.size_y = 1 << _hash_bits_y;
+
+	uint buckets = stats.size_x * stats.size_y;
+	for (uint i = 0; i < buckets; i++) {
+		uint length = 0;
+		for (const Vehicle *v = _vehicle_tile_hash[i]; v != NULL; v = v->hash_tile_next) length++;
+		if (length == 0) continue;
+
+		stats.used_buckets++;
+		stats.vehicles += length;
+		stats.max_length = max(stats.max_length, length);
+		stats.histogram[min<uint>(FindLastBit(length), lengthof(stats.histogram) - 1)]++;
+	}
 }
 
 void ResetVehicleColourMap()
@@ -636,6 +792,8 @@ void InitializeVehicles()
 {
 	_vehicles_to_autoreplace.Reset();
 	ResetVehicleHash();
+	ResetTickVehicles();
+	ResetVehicleDayProc();
 }
 
 uint CountVehiclesInChain(const Vehicle *v)
@@ -824,6 +982,8 @@ Vehicle::~Vehicle()
 
 	UpdateVehicleTileHash(this, true);
 	UpdateVehicleViewportHash(this, INVALID_COORD, 0);
+	RemoveTickVehicle(this);
+	_day_proc_dirty[this->day_proc_slot] = true;
 	DeleteVehicleNews(this->index, INVALID_STRING_ID);
 	DeleteNewGRFInspectWindow(GetGrfSpecFeature(this->type), this->index);
 }
@@ -845,19 +1005,96 @@ void VehicleEnteredDepotThisTick(Vehicle *v)
 	v->vehstatus |= VS_STOPPED;
 }
 
+/** Estimated cost of the daily handlers of a primary vehicle, relative to those of other vehicle parts. */
+static const uint DAY_PROC_PRIMARY_WEIGHT = 16;
+
+/** Maximum number of vehicles moved to another tick of the day per tick. */
+static const uint DAY_PROC_MAX_MOVES = 64;
+
+/**
+ * Estimate the cost of the daily handlers of a vehicle. Only the game state may
+ * be taken into account, as the estimates need to be the same on all clients.
+ * Primary vehicles check for servicing, breakdowns, orders and autoreplace,
+ * while the other parts only age.
+ * @param v The vehicle.
+ * @return Estimated cost.
+ */
+static inline uint GetDayProcWeight(const Vehicle *v)
+{
+	return v->IsPrimaryVehicle() ? DAY_PROC_PRIMARY_WEIGHT : 1;
+}
+
+/**
+ * Move vehicles from a tick of the day whose daily handlers have just been run
+ * to earlier ticks with less work, so that they run once per day still.
+ * @param slot The tick of the day whose daily handlers have just been run.
+ */
+static void BalanceVehicleDayProc(uint slot)
+{
+	if (slot == 0) return;
+
+	uint total = 0;
+	for (uint i = 0; i < DAY_TICKS; i++) total += _day_proc_weights[i];
+	uint32 target = CeilDiv(total, DAY_TICKS);
+	if (_day_proc_weights[slot] <= target + DAY_PROC_PRIMARY_WEIGHT) return;
+
+	SmallVector<VehicleID, 16> &list = _day_proc_lists[slot];
+	uint moves = 0;
+	for (uint i = list.Length(); i-- > 0 && moves < DAY_PROC_MAX_MOVES && _day_proc_weights[slot] > target;) {
+		Vehicle *v = Vehicle::GetIfValid(list[i]);
+		if (v == NULL || v->day_proc_slot != slot) continue;
+
+		uint weight = GetDayProcWeight(v);
+		if (_day_proc_weights[slot] < target + weight) continue;
+
+		/* Find the earlier tick with the least work; it must not become too busy itself. */
+		uint best = 0;
+		for (uint j = 1; j < slot; j++) {
+			if (_day_proc_weights[j] < _day_proc_weights[best]) best = j;
+		}
+		if (_day_proc_weights[best] + weight > target) break;
+
+		v->day_proc_slot = best;
+		AddDayProcVehicle(v);
+		_day_proc_weights[slot] -= weight;
+		_day_proc_weights[best] += weight;
+		_day_proc_dirty[slot] = true;
+		moves++;
+	}
+}
+
 /**
  * Increases the day counter for all vehicles and calls 1-day and 32-day handlers.
- * Each tick, it processes vehicles with "index % DAY_TICKS == _date_fract",
- * so each day, all vehicles are processes in DAY_TICKS steps.
+ * Each tick, it processes the vehicles with "day_proc_slot == _date_fract",
+ * so each day, all vehicles are processes in DAY_TICKS steps. Initially that's
+ * "index % DAY_TICKS"; afterwards vehicles are moved from busy to quiet ticks.
  */
 static void RunVehicleDayProc()
 {
 	if (_game_mode != GM_NORMAL) return;
 
-	/* Run the day_proc for every DAY_TICKS vehicle starting at _date_fract. */
-	for (size_t i = _date_fract; i < Vehicle::GetPoolSize(); i += DAY_TICKS) {
-		Vehicle *v = Vehicle::Get(i);
-		if (v == NULL) continue;
+	uint slot = _date_fract;
+	if (slot >= DAY_TICKS) return;
+
+	SmallVector<VehicleID, 16> &list = _day_proc_lists[slot];
+	if (_day_proc_dirty[slot]) {
+		/* Drop deleted and moved vehicles, then sort by ID so the order is the same on all clients. */
+		VehicleID *last = list.Begin();
+		for (const VehicleID *it = list.Begin(); it != list.End(); it++) {
+			const Vehicle *v = Vehicle::GetIfValid(*it);
+			if (v != NULL && v->day_proc_slot == slot) *last++ = *it;
+		}
+		std::sort(list.Begin(), last);
+		list.Resize(std::unique(list.Begin(), last) - list.Begin());
+		_day_proc_dirty[slot] = false;
+	}
+
+	uint32 weight = 0;
+	for (uint i = 0; i < list.Length(); i++) {
+		Vehicle *v = Vehicle::GetIfValid(list[i]);
+		if (v == NULL || v->day_proc_slot != slot) continue;
+
+		weight += GetDayProcWeight(v);
 
 		/* Call the 32-day callback if needed */
 		if ((v->day_counter & 0x1F) == 0 && v->HasEngineType()) {
@@ -878,90 +1115,273 @@ static void RunVehicleDayProc()
 		/* This is called once per day for each vehicle, but not in the first tick of the day */
 		v->OnNewDay();
 	}
+	_day_proc_weights[slot] = weight;
+
+	BalanceVehicleDayProc(slot);
 }
 
-void CallVehicleTicks()
+/**
+ * Get the estimated cost of the daily handlers of the vehicles run in a tick of the day.
+ * @param slot The tick of the day.
+ * @return Cost as of the last time the tick was run.
+ */
+uint32 GetVehicleDayProcWeight(uint slot)
 {
-	_vehicles_to_autoreplace.Clear();
+	assert(slot < DAY_TICKS);
+	return _day_proc_weights[slot];
+}
 
-	RunVehicleDayProc();
+static bool _vehicle_tick_profiling = false;             ///< Whether CallVehicleTicks() is being measured.
+static VehicleTickProfile _vehicle_tick_profile_total;    ///< Sum of all measured ticks since the last reset.
+static VehicleTickProfile _vehicle_tick_profiles[VEHICLE_TICK_PROFILE_HISTORY]; ///< Ring buffer of the last measured ticks.
+static uint _vehicle_tick_profile_next = 0;               ///< Position in the ring buffer the next tick is stored at.
+static uint _vehicle_tick_profile_count = 0;              ///< Number of valid ticks in the ring buffer.
+static VehicleTickProfile *_vehicle_tick_profile = NULL;  ///< Profile of the tick being measured, NULL if not measuring.
 
-	Station *st;
-	FOR_ALL_STATIONS(st) LoadUnloadStation(st);
+/**
+ * Add the times of another profile to this one.
+ * @param other Profile to add.
+ */
+void VehicleTickProfile::Add(const VehicleTickProfile &other)
+{
+	this->date = other.date;
+	this->date_fract = other.date_fract;
+	this->ticks += other.ticks;
+	this->total += other.total;
+	for (uint i = 0; i < VTP_END; i++) this->phases[i] += other.phases[i];
+	for (uint i = 0; i < VEH_END; i++) {
+		this->types[i] += other.types[i];
+		this->vehicles[i] += other.vehicles[i];
+	}
+}
 
-	Vehicle *v;
-	FOR_ALL_VEHICLES(v) {
-		/* Vehicle could be deleted in this tick */
-		if (!v->Tick()) {
-			assert(Vehicle::Get(vehicle_index) == NULL);
-			continue;
-		}
+/**
+ * Start or stop measuring CallVehicleTicks().
+ * @param enable Whether to measure.
+ */
+void SetVehicleTickProfiling(bool enable)
+{
+	_vehicle_tick_profiling = enable;
+}
 
-		assert(Vehicle::Get(vehicle_index) == v);
+/**
+ * Check whether CallVehicleTicks() is being measured.
+ * @return If the profiler is running.
+ */
+bool IsVehicleTickProfiling()
+{
+	return _vehicle_tick_profiling;
+}
 
-		switch (v->type) {
-			default: break;
+/** Throw away all measured vehicle tick profiles. */
+void ResetVehicleTickProfiles()
+{
+	MemSetT(&_vehicle_tick_profile_total, 0);
+	_vehicle_tick_profile_next = 0;
+	_vehicle_tick_profile_count = 0;
+}
 
-			case VEH_TRAIN:
-			case VEH_ROAD:
-			case VEH_AIRCRAFT:
-			case VEH_SHIP: {
-				Vehicle *front = v->First();
+/**
+ * Get the sum of all ticks measured since the last reset.
+ * @return Profile of all measured ticks.
+ */
+const VehicleTickProfile &GetVehicleTickProfileTotal()
+{
+	return _vehicle_tick_profile_total;
+}
 
-				if (v->vcache.cached_cargo_age_period != 0) {
-					v->cargo_age_counter = min(v->cargo_age_counter, v->vcache.cached_cargo_age_period);
-					if (--v->cargo_age_counter == 0) {
-						v->cargo.AgeCargo();
-						v->cargo_age_counter = v->vcache.cached_cargo_age_period;
-					}
-				}
+/**
+ * Get the profile of one of the last measured ticks.
+ * @param age Number of measured ticks since the requested one; 0 is the last one.
+ * @return Profile of the tick or NULL if it isn't kept (anymore).
+ */
+const VehicleTickProfile *GetVehicleTickProfile(uint age)
+{
+	if (age >= _vehicle_tick_profile_count) return NULL;
+	return &_vehicle_tick_profiles[(_vehicle_tick_profile_next + VEHICLE_TICK_PROFILE_HISTORY - 1 - age) % VEHICLE_TICK_PROFILE_HISTORY];
+}
 
-				/* Do not play any sound when crashed */
-				if (front->vehstatus & VS_CRASHED) continue;
+/**
+ * Get a short name of a phase of CallVehicleTicks() for printing.
+ * @param phase The phase.
+ * @return Name of the phase.
+ */
+const char *GetVehicleTickPhaseName(VehicleTickPhase phase)
+{
+	static const char * const names[] = {
+		"day_proc", "load_unload", "tick", "cargo_aging", "sounds", "link_stats", "autoreplace",
+	};
+	assert_compile(lengthof(names) == VTP_END);
+	assert(phase < VTP_END);
+	return names[phase];
+}
 
-				/* Do not play any sound when in depot or tunnel */
-				if (v->vehstatus & VS_HIDDEN) continue;
+/** Start measuring a tick if the profiler is running. */
+static void BeginVehicleTickProfile()
+{
+	if (!_vehicle_tick_profiling) return;
 
-				/* Do not play any sound when stopped */
-				if ((front->vehstatus & VS_STOPPED) && (front->type != VEH_TRAIN || front->cur_speed == 0)) continue;
+	_vehicle_tick_profile = &_vehicle_tick_profiles[_vehicle_tick_profile_next];
+	MemSetT(_vehicle_tick_profile, 0);
+	_vehicle_tick_profile->date = _date;
+	_vehicle_tick_profile->date_fract = _date_fract;
+	_vehicle_tick_profile->ticks = 1;
+	_vehicle_tick_profile->total = ottd_rdtsc();
+}
 
-				/* Check vehicle type specifics */
-				switch (v->type) {
-					case VEH_TRAIN:
-						if (Train::From(v)->IsWagon()) continue;
-						break;
+/** Finish measuring a tick and store it in the ring buffer. */
+static void EndVehicleTickProfile()
+{
+	if (_vehicle_tick_profile == NULL) return;
 
-					case VEH_ROAD:
-						if (!RoadVehicle::From(v)->IsFrontEngine()) continue;
-						break;
+	_vehicle_tick_profile->total = ottd_rdtsc() - _vehicle_tick_profile->total;
+	_vehicle_tick_profile_total.Add(*_vehicle_tick_profile);
+	_vehicle_tick_profile_next = (_vehicle_tick_profile_next + 1) % VEHICLE_TICK_PROFILE_HISTORY;
+	_vehicle_tick_profile_count = min(_vehicle_tick_profile_count + 1, VEHICLE_TICK_PROFILE_HISTORY);
+	_vehicle_tick_profile = NULL;
+}
 
-					case VEH_AIRCRAFT:
-						if (!Aircraft::From(v)->IsNormalAircraft()) continue;
-						break;
+/** Scoped timer adding the time spent in its scope to the profile of the current tick, if it is measured. */
+class VehicleTickTimer {
+	uint64 *counter; ///< Counter to add the time to, NULL if the tick isn't measured.
+	uint64 start;    ///< CPU cycles when the timer was created.
 
-					default:
-						break;
-				}
+public:
+	/**
+	 * Measure a phase of CallVehicleTicks().
+	 * @param phase The phase.
+	 */
+	VehicleTickTimer(VehicleTickPhase phase) :
+			counter(_vehicle_tick_profile == NULL ? NULL : &_vehicle_tick_profile->phases[phase]),
+			start(this->counter == NULL ? 0 : ottd_rdtsc()) {}
 
-				v->motion_counter += front->cur_speed;
-				/* Play a running sound if the motion counter passes 256 (Do we not skip sounds?) */
-				if (GB(v->motion_counter, 0, 8) < front->cur_speed) PlayVehicleSound(v, VSE_RUNNING);
+	/**
+	 * Measure the tick handlers of a vehicle type.
+	 * @param type The vehicle type.
+	 */
+	VehicleTickTimer(VehicleType type) :
+			counter(_vehicle_tick_profile == NULL ? NULL : &_vehicle_tick_profile->types[type]),
+			start(this->counter == NULL ? 0 : ottd_rdtsc()) {}
 
-				/* Play an alternating running sound every 16 ticks */
-				if (GB(v->tick_counter, 0, 4) == 0) {
-					/* Play running sound when speed > 0 and not braking */
-					bool running = (front->cur_speed > 0) && !(front->vehstatus & (VS_STOPPED | VS_TRAIN_SLOWING));
-					PlayVehicleSound(v, running ? VSE_RUNNING_16 : VSE_STOPPED_16);
-				}
+	~VehicleTickTimer()
+	{
+		if (this->counter != NULL) *this->counter += ottd_rdtsc() - this->start;
+	}
+};
 
-				break;
+/** Remove the deleted vehicles from the tick lists and sort them by vehicle ID. */
+static void PrepareTickVehicles()
+{
+	for (VehicleType type = VEH_BEGIN; type < VEH_END; type++) {
+		SmallVector<TickVehicle, 64> &list = _tick_vehicles[type];
+		if (_tick_vehicles_holes[type]) {
+			TickVehicle *last = list.Begin();
+			for (const TickVehicle *it = list.Begin(); it != list.End(); it++) {
+				if (it->v != NULL) *last++ = *it;
 			}
+			list.Resize(last - list.Begin());
+			_tick_vehicles_holes[type] = false;
+		}
+		if (_tick_vehicles_sorted[type] != list.Length()) {
+			std::sort(list.Begin(), list.End(), &TickVehicleIDSorter);
+			_tick_vehicles_sorted[type] = list.Length();
 		}
 	}
+}
 
+/**
+ * Run the tick handler of all vehicles of a type. Vehicles added while doing
+ * so are ticked, too; deleted ones are skipped.
+ * @tparam T Vehicle class to be ticked.
+ */
+template <class T>
+static void TickVehicles()
+{
+	VehicleTickTimer timer(T::EXPECTED_TYPE);
+	SmallVector<TickVehicle, 64> &list = _tick_vehicles[T::EXPECTED_TYPE];
+	uint ticked = 0;
+	for (uint i = 0; i < list.Length(); i++) {
+		Vehicle *v = list[i].v;
+		if (v == NULL) continue;
+		T::From(v)->T::Tick();
+		ticked++;
+	}
+	if (_vehicle_tick_profile != NULL) _vehicle_tick_profile->vehicles[T::EXPECTED_TYPE] = ticked;
+}
+
+/**
+ * Age the cargo of all vehicles of a type whose aging period has passed.
+ * @param type Vehicle type, one which can carry cargo.
+ */
+static void AgeVehicleCargo(VehicleType type)
+{
+	const TickVehicle *end = _tick_vehicles[type].End();
+	for (const TickVehicle *it = _tick_vehicles[type].Begin(); it != end; it++) {
+		Vehicle *v = it->v;
+		if (v == NULL || v->vcache.cached_cargo_age_period == 0) continue;
+
+		v->cargo_age_counter = min(v->cargo_age_counter, v->vcache.cached_cargo_age_period);
+		if (--v->cargo_age_counter == 0) {
+			v->cargo.AgeCargo();
+			v->cargo_age_counter = v->vcache.cached_cargo_age_period;
+		}
+	}
+}
+
+/**
+ * Check if a vehicle makes running sounds at all.
+ * @param v Vehicle to check.
+ * @return If the vehicle is the one making the sounds of its consist.
+ */
+static inline bool MakesRunningSounds(const Train *v) { return !v->IsWagon(); }
+static inline bool MakesRunningSounds(const RoadVehicle *v) { return v->IsFrontEngine(); }
+static inline bool MakesRunningSounds(const Ship *v) { return true; }
+static inline bool MakesRunningSounds(const Aircraft *v) { return v->IsNormalAircraft(); }
+
+/**
+ * Play the running sounds of all moving vehicles of a type.
+ * @tparam T Vehicle class to play the sounds for.
+ */
+template <class T>
+static void PlayVehicleRunningSounds()
+{
+	const TickVehicle *end = _tick_vehicles[T::EXPECTED_TYPE].End();
+	for (const TickVehicle *it = _tick_vehicles[T::EXPECTED_TYPE].Begin(); it != end; it++) {
+		if (it->v == NULL) continue;
+		T *v = T::From(it->v);
+		Vehicle *front = v->First();
+
+		/* Do not play any sound when crashed */
+		if (front->vehstatus & VS_CRASHED) continue;
+
+		/* Do not play any sound when in depot or tunnel */
+		if (v->vehstatus & VS_HIDDEN) continue;
+
+		/* Do not play any sound when stopped */
+		if ((front->vehstatus & VS_STOPPED) && (front->type != VEH_TRAIN || front->cur_speed == 0)) continue;
+
+		/* Check vehicle type specifics */
+		if (!MakesRunningSounds(v)) continue;
+
+		v->motion_counter += front->cur_speed;
+		/* Play a running sound if the motion counter passes 256 (Do we not skip sounds?) */
+		if (GB(v->motion_counter, 0, 8) < front->cur_speed) PlayVehicleSound(v, VSE_RUNNING);
+
+		/* Play an alternating running sound every 16 ticks */
+		if (GB(v->tick_counter, 0, 4) == 0) {
+			/* Play running sound when speed > 0 and not braking */
+			bool running = (front->cur_speed > 0) && !(front->vehstatus & (VS_STOPPED | VS_TRAIN_SLOWING));
+			PlayVehicleSound(v, running ? VSE_RUNNING_16 : VSE_STOPPED_16);
+		}
+	}
+}
+
+/** Autoreplace and autorenew the vehicles that entered a depot in this tick. */
+static void AutoreplaceVehicles()
+{
 	Backup<CompanyByte> cur_company(_current_company, FILE_LINE);
 	for (AutoreplaceMap::iterator it = _vehicles_to_autoreplace.Begin(); it != _vehicles_to_autoreplace.End(); it++) {
-		v = it->first;
+		Vehicle *v = it->first;
 		/* Autoreplace needs the current company set as the vehicle owner */
 		cur_company.Change(v->owner);
 
@@ -1007,6 +1427,65 @@ void CallVehicleTicks()
 	cur_company.Restore();
 }
 
+void CallVehicleTicks()
+{
+	_vehicles_to_autoreplace.Clear();
+
+	BeginVehicleTickProfile();
+
+	{
+		VehicleTickTimer timer(VTP_DAY_PROC);
+		RunVehicleDayProc();
+	}
+
+	/* Departures of busy networks update the same links many times per tick.
+	 * Collect the updates and apply them once per link. */
+	OpenLinkStatBatch();
+
+	{
+		VehicleTickTimer timer(VTP_LOAD_UNLOAD);
+		LoadUnloadStations();
+	}
+
+	{
+		VehicleTickTimer timer(VTP_TICK);
+		PrepareTickVehicles();
+
+		/* Run the vehicles type by type, in the order of their IDs. */
+		TickVehicles<Train>();
+		TickVehicles<RoadVehicle>();
+		TickVehicles<Ship>();
+		TickVehicles<Aircraft>();
+		TickVehicles<EffectVehicle>();
+		TickVehicles<DisasterVehicle>();
+	}
+
+	{
+		VehicleTickTimer timer(VTP_CARGO_AGING);
+		for (VehicleType type = VEH_BEGIN; type < VEH_COMPANY_END; type++) AgeVehicleCargo(type);
+	}
+
+	{
+		VehicleTickTimer timer(VTP_SOUNDS);
+		PlayVehicleRunningSounds<Train>();
+		PlayVehicleRunningSounds<RoadVehicle>();
+		PlayVehicleRunningSounds<Ship>();
+		PlayVehicleRunningSounds<Aircraft>();
+	}
+
+	{
+		VehicleTickTimer timer(VTP_LINK_STATS);
+		CloseLinkStatBatch();
+	}
+
+	{
+		VehicleTickTimer timer(VTP_AUTOREPLACE);
+		AutoreplaceVehicles();
+	}
+
+	EndVehicleTickProfile();
+}
+
 /**
  * Add vehicle sprite for drawing to the screen.
  * @param v Vehicle to draw.
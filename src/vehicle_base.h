@@ -241,6 +241,7 @@ public:
 	uint16 cargo_age_counter;           ///< Ticks till cargo is aged next.
 
 	byte day_counter;                   ///< Increased by one for each day
+	byte day_proc_slot;                 ///< Tick of the day (#_date_fract) the daily handlers of the vehicle are run in.
 	byte tick_counter;                  ///< Increased by one for each tick
 	byte running_ticks;                 ///< Number of ticks this vehicle was not stopped this day
 
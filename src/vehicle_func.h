@@ -21,6 +21,7 @@
 #include "newgrf_config.h"
 #include "track_type.h"
 #include "livery.h"
+#include "date_type.h"
 
 #define is_custom_sprite(x) (x >= 0xFD)
 #define IS_CUSTOM_FIRSTHEAD_SPRITE(x) (x == 0xFD)
@@ -185,4 +186,57 @@ void GetVehicleSet(VehicleSet &set, Vehicle *v, uint8 num_vehicles);
 
 void CheckCargoCapacity(Vehicle *v);
 
+/** Statistics about the chains of vehicles in the buckets of the vehicle tile hash. */
+struct VehicleTileHashStats {
+	uint size_x;        ///< Number of buckets in x direction.
+	uint size_y;        ///< Number of buckets in y direction.
+	uint used_buckets;  ///< Number of buckets containing vehicles.
+	uint vehicles;      ///< Number of vehicles in the hash.
+	uint max_length;    ///< Length of the longest chain.
+	uint histogram[8];  ///< Number of chains with a length of 1, 2-3, 4-7, ... and 128 or more.
+};
+
+void GetVehicleTileHashStats(VehicleTileHashStats &stats);
+
+void RebuildVehicleDayProcLists();
+uint32 GetVehicleDayProcWeight(uint slot);
+
+/** Parts of CallVehicleTicks() measured by the vehicle tick profiler. */
+enum VehicleTickPhase {
+	VTP_DAY_PROC,    ///< Daily handlers of the vehicles.
+	VTP_LOAD_UNLOAD, ///< Loading and unloading at stations.
+	VTP_TICK,        ///< Tick handlers of the vehicles, split by vehicle type in VehicleTickProfile::types.
+	VTP_CARGO_AGING, ///< Aging the cargo in the vehicles.
+	VTP_SOUNDS,      ///< Running sounds of the vehicles.
+	VTP_LINK_STATS,  ///< Applying the link statistics collected in the tick.
+	VTP_AUTOREPLACE, ///< Autoreplacing and autorenewing vehicles.
+	VTP_END,         ///< End marker.
+};
+
+/**
+ * Time spent in CallVehicleTicks() in one or more ticks. Times are CPU cycles
+ * counted by ottd_rdtsc(); they are only meaningful relative to each other.
+ */
+struct VehicleTickProfile {
+	Date date;                ///< Date of the (last) measured tick.
+	uint16 date_fract;        ///< Fraction of the date of the (last) measured tick.
+	uint32 ticks;             ///< Number of measured ticks.
+	uint64 total;             ///< Time spent in CallVehicleTicks().
+	uint64 phases[VTP_END];   ///< Time spent in each phase.
+	uint64 types[VEH_END];    ///< Time spent in the tick handlers of each vehicle type.
+	uint64 vehicles[VEH_END]; ///< Number of ticked vehicles of each type.
+
+	void Add(const VehicleTickProfile &other);
+};
+
+/** Number of ticks the vehicle tick profiler keeps the profiles of. */
+static const uint VEHICLE_TICK_PROFILE_HISTORY = 256;
+
+void SetVehicleTickProfiling(bool enable);
+bool IsVehicleTickProfiling();
+void ResetVehicleTickProfiles();
+const VehicleTickProfile &GetVehicleTickProfileTotal();
+const VehicleTickProfile *GetVehicleTickProfile(uint age);
+const char *GetVehicleTickPhaseName(VehicleTickPhase phase);
+
 #endif /* VEHICLE_FUNC_H */